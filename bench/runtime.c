@@ -0,0 +1,243 @@
+#define _DEFAULT_SOURCE
+#include "../src/backend/ir/opt.h"
+#include "../src/log.h"
+#include "../src/util.h"
+
+#include <dirent.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Runtime benchmark for the code boa generates
+// Builds every program in bench/programs/ with the linux_nasm target at every optimization level (with `-rdtsc`,
+// so the binary times `main` itself), runs each one a number of times and writes the statistics to a JSON file
+// All levels have to agree on the exit code of a program, otherwise one of them got miscompiled
+//
+// Usage: ./nob bench runtime [-runs <N>] [-o <results.json>] [-label <text>] [-program <name>]
+
+#define PROGRAMS_DIR "bench/programs"
+#define OUT_DIR "build/bench"
+#define COMPILER "./build/boa"
+#define MAX_RUNS 1000
+
+typedef struct {
+    double min, median, mean, stddev;
+} Summary;
+
+typedef struct {
+    char name[256];
+    size_t opt_level;
+    int exit_code;
+    Summary cycles;
+    Summary wall_ns;
+} Result;
+
+typedef struct {
+    Result *items;
+    size_t count;
+    size_t capacity;
+} Results;
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static Summary summarize(double *samples, size_t count) {
+    ASSERT(count > 0, "Need at least one sample");
+    qsort(samples, count, sizeof(*samples), compare_doubles);
+    Summary s = {.min = samples[0]};
+    s.median = count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+    for (size_t i = 0; i < count; i++) s.mean += samples[i];
+    s.mean /= count;
+    for (size_t i = 0; i < count; i++) s.stddev += (samples[i] - s.mean) * (samples[i] - s.mean);
+    s.stddev = count > 1 ? sqrt(s.stddev / (count - 1)) : 0;
+    return s;
+}
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Runs `exe` once with a pipe on fd 3 to collect the cycle count of `main`
+static bool run_timed(const char *exe, int *exit_code, double *cycles, double *wall_ns) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return false;
+    }
+
+    double begin = now_ns();
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        if (fds[1] != 3) {
+            dup2(fds[1], 3);
+            close(fds[1]);
+        }
+        execl(exe, exe, (char *)NULL);
+        perror("execl");
+        _exit(127);
+    }
+    close(fds[1]);
+
+    uint64_t tsc = 0;
+    size_t got = 0;
+    while (got < sizeof(tsc)) {
+        ssize_t n = read(fds[0], (char *)&tsc + got, sizeof(tsc) - got);
+        if (n <= 0) break;
+        got += n;
+    }
+    close(fds[0]);
+
+    int status;
+    if (waitpid(pid, &status, 0) == -1) {
+        perror("waitpid");
+        return false;
+    }
+    *wall_ns = now_ns() - begin;
+
+    if (!WIFEXITED(status)) {
+        log_diagnostic(LL_ERROR, "%s didn't exit normally", exe);
+        return false;
+    }
+    if (got != sizeof(tsc)) {
+        log_diagnostic(LL_ERROR, "%s didn't report its cycle count (was it built with -rdtsc?)", exe);
+        return false;
+    }
+    *exit_code = WEXITSTATUS(status);
+    *cycles = (double)tsc;
+    return true;
+}
+
+static void write_summary(FILE *f, const char *name, const Summary *s) {
+    fprintf(f, "\"%s\": {\"min\": %.0f, \"median\": %.0f, \"mean\": %.1f, \"stddev\": %.1f}", name, s->min, s->median,
+            s->mean, s->stddev);
+}
+
+static bool write_json(const char *path, const char *label, size_t runs, const Results *results) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        log_diagnostic(LL_ERROR, "Failed to open %s for writing", path);
+        return false;
+    }
+    fprintf(f, "{\n");
+    fprintf(f, "  \"label\": \"%s\",\n", label);
+    fprintf(f, "  \"timestamp\": %lld,\n", (long long)time(NULL));
+    fprintf(f, "  \"runs\": %zu,\n", runs);
+    fprintf(f, "  \"results\": [\n");
+    for (size_t i = 0; i < results->count; i++) {
+        const Result *r = &results->items[i];
+        fprintf(f, "    {\"program\": \"%s\", \"opt_level\": %zu, \"exit_code\": %d, ", r->name, r->opt_level,
+                r->exit_code);
+        write_summary(f, "cycles", &r->cycles);
+        fprintf(f, ", ");
+        write_summary(f, "wall_ns", &r->wall_ns);
+        fprintf(f, "}%s\n", i + 1 < results->count ? "," : "");
+    }
+    fprintf(f, "  ]\n");
+    fprintf(f, "}\n");
+    fclose(f);
+    return true;
+}
+
+static bool bench_program(const char *name, size_t runs, Results *out, Arena *arena) {
+    int reference_exit = -1;
+    for (size_t level = 0; level <= OPT_LEVEL_MAX; level++) {
+        char src[512], exe[512], opt[16];
+        snprintf(src, sizeof(src), PROGRAMS_DIR "/%s.boa", name);
+        snprintf(exe, sizeof(exe), OUT_DIR "/%s_O%zu", name, level);
+        snprintf(opt, sizeof(opt), "-O%zu", level);
+
+        int code = run_program(COMPILER, 5, (char *[]){src, "-o", exe, opt, "-rdtsc", NULL});
+        if (code != 0) {
+            log_diagnostic(LL_ERROR, "Failed to build %s at %s (exit code: %d)", src, opt, code);
+            return false;
+        }
+
+        double cycles[MAX_RUNS], wall[MAX_RUNS];
+        int exit_code = -1;
+        for (size_t r = 0; r < runs; r++) {
+            if (!run_timed(exe, &exit_code, &cycles[r], &wall[r])) return false;
+        }
+        if (reference_exit == -1) reference_exit = exit_code;
+        if (exit_code != reference_exit) {
+            log_diagnostic(LL_ERROR, "%s exits with %d at %s but with %d at -O0", name, exit_code, opt, reference_exit);
+            return false;
+        }
+
+        Result res = {.opt_level = level, .exit_code = exit_code};
+        snprintf(res.name, sizeof(res.name), "%s", name);
+        res.cycles = summarize(cycles, runs);
+        res.wall_ns = summarize(wall, runs);
+        da_push(out, res, arena);
+
+        printf("%-12s -O%zu  cycles: median %12.0f  min %12.0f  stddev %10.1f   wall: median %8.3fms\n", name, level,
+               res.cycles.median, res.cycles.min, res.cycles.stddev, res.wall_ns.median / 1e6);
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    size_t runs = 10;
+    const char *out_path = OUT_DIR "/runtime.json";
+    const char *label = "";
+    const char *only = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-runs") == 0 && i + 1 < argc) {
+            runs = strtoull(argv[++i], NULL, 10);
+            ASSERT(runs > 0 && runs <= MAX_RUNS, "-runs has to be between 1 and %d", MAX_RUNS);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "-label") == 0 && i + 1 < argc) {
+            label = argv[++i];
+        } else if (strcmp(argv[i], "-program") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else {
+            log_diagnostic(LL_ERROR,
+                           "Unknown flag %s (usage: runtime [-runs <N>] [-o <results.json>] [-label <text>] "
+                           "[-program <name>])",
+                           argv[i]);
+            return 1;
+        }
+    }
+
+    struct dirent **entries = NULL;
+    int entry_count = scandir(PROGRAMS_DIR, &entries, NULL, alphasort);
+    if (entry_count < 0) {
+        log_diagnostic(LL_ERROR, "Failed to open " PROGRAMS_DIR " (run this from the root of the repo)");
+        return 1;
+    }
+
+    Arena arena = arena_new(1024 * 1024);
+    Results results = {0};
+    bool ok = true;
+    for (int i = 0; i < entry_count; i++) {
+        const char *file_name = entries[i]->d_name;
+        size_t len = strlen(file_name);
+        if (ok && len > 4 && strcmp(file_name + len - 4, ".boa") == 0) {
+            char name[256];
+            snprintf(name, sizeof(name), "%.*s", (int)(len - 4), file_name);
+            if (only == NULL || strcmp(only, name) == 0) ok = bench_program(name, runs, &results, &arena);
+        }
+        free(entries[i]);
+    }
+    free(entries);
+
+    if (ok) ok = write_json(out_path, label, runs, &results);
+    if (ok) log_diagnostic(LL_INFO, "Wrote %zu results to %s", results.count, out_path);
+
+    arena_free(&arena);
+    return ok ? 0 : 1;
+}
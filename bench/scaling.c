@@ -0,0 +1,273 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../src/arena.h"
+#include "../src/backend/codegen/nasm_x86_64_linux.h"
+#include "../src/backend/ir/opt.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/frontend/lexer.h"
+#include "../src/frontend/parser.h"
+#include "../src/log.h"
+#include "../src/util.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Scaling-regression suite
+// Compiles families of generated inputs at doubling sizes, times every compiler phase and fits the growth
+// exponent k of `t = c * n^k` (least squares in log-log space)
+// A phase fails when k is noticeably above what O(n log n) would give over the measured range
+// The IR passes are a phase of their own, run at the level `-O<level>` picks like for boa (codegen gets it too)
+//
+// Usage: ./nob bench scaling [-quick] [-runs <N>] [-family <name>] [-O<level>]
+// The full ranges need a few GBs of RAM per million lines, `-quick` stops every family early
+
+typedef enum {
+    PH_LEX,
+    PH_PARSE,
+    PH_IR,
+    PH_OPT,
+    PH_CODEGEN,
+    PH_COUNT,
+} Phase;
+
+static const char *phase_names[PH_COUNT] = {
+    [PH_LEX] = "lex",
+    [PH_PARSE] = "parse",
+    [PH_IR] = "ir",
+    [PH_OPT] = "opt",
+    [PH_CODEGEN] = "codegen",
+};
+
+typedef struct {
+    char *items;
+    size_t count;
+    size_t capacity;
+} Source;
+
+typedef void (*GenerateFn)(Source *out, size_t n);
+
+typedef struct {
+    const char *name;
+    const char *unit;
+    size_t min, max;
+    // upper bound for `-quick`
+    size_t quick_max;
+    GenerateFn generate;
+} Family;
+
+// Anything faster than this is timer noise and is left out of the fit
+#define NOISE_FLOOR_SECONDS 0.002
+// Slack on top of the O(n log n) exponent for cache effects and noisy machines
+#define EXPONENT_SLACK 0.15
+
+static void source_printf(Source *s, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int needed = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    ASSERT(needed >= 0, "vsnprintf failed");
+
+    if (s->count + needed + 1 > s->capacity) {
+        size_t new_cap = s->capacity == 0 ? 4096 : s->capacity;
+        while (new_cap < s->count + needed + 1) new_cap *= 2;
+        s->items = realloc(s->items, new_cap);
+        ASSERT(s->items, "Buy more RAM LOLOL");
+        s->capacity = new_cap;
+    }
+
+    va_start(ap, fmt);
+    vsnprintf(s->items + s->count, needed + 1, fmt, ap);
+    va_end(ap);
+    s->count += needed;
+}
+
+// n straight-line statements in a single function
+static void generate_lines(Source *out, size_t n) {
+    source_printf(out, "def main() {\n    let v = 1;\n");
+    for (size_t i = 0; i < n; i++) source_printf(out, "    v = v + %zu * 2 - 3;\n", i % 1000);
+    source_printf(out, "    return v;\n}\n");
+}
+
+// n nested scopes, every level defines a variable and reads the outermost one
+static void generate_scopes(Source *out, size_t n) {
+    source_printf(out, "def main() {\n    let v0 = 1;\n");
+    for (size_t i = 1; i <= n; i++) source_printf(out, "if v0 {\nlet v%zu = v0 + %zu;\n", i, i);
+    for (size_t i = 1; i <= n; i++) source_printf(out, "}\n");
+    source_printf(out, "    return v0;\n}\n");
+}
+
+// n small functions
+static void generate_functions(Source *out, size_t n) {
+    for (size_t i = 0; i < n; i++) source_printf(out, "def f%zu(a, b) {\n    let c = a + b * %zu;\n    return c;\n}\n", i, i);
+    source_printf(out, "def main() {\n    return f0(1, 2);\n}\n");
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static bool compile_timed(const Source *src, size_t level, double out[PH_COUNT]) {
+    // tokens, the AST and the IR all live here, with room for the garbage left behind by `da_push`
+    Arena arena = arena_new(src->count * 256 + 1024 * 1024);
+    FILE *sink = fopen("/dev/null", "wb");
+    ASSERT(sink, "Failed to open /dev/null");
+    SourceFile file = {.src = {.items = src->items, .count = src->count, .capacity = src->count}, .name = "bench"};
+    bool ok = false;
+
+    double t0 = now_seconds();
+    Lexer l = {.begin_of_src = file.src.items, .file = FILE_VIEW_FROM_FILE(file), .arena = &arena};
+    Tokens tokens = {0};
+    if (!lexer_run(&l, &tokens)) goto defer;
+
+    double t1 = now_seconds();
+    Parser p = {
+        .arena = &arena,
+        .origin = FILE_VIEW_FROM_FILE(file),
+        .tokens = {.count = tokens.count, .items = tokens.items},
+    };
+    AstRoot root = {0};
+    if (!parser_parse(&p, &root)) goto defer;
+
+    double t2 = now_seconds();
+    Module mod = {0};
+    if (!generate_module(&root, &mod, &arena)) goto defer;
+
+    double t3 = now_seconds();
+    if (!optimize_module(&mod, level, UNROLL_FACTOR_DEFAULT, &arena)) goto defer;
+
+    double t4 = now_seconds();
+    if (!nasm_x86_64_linux_generate_file(sink, &mod, &(TargetOptions){.opt_level = level}, &arena)) goto defer;
+    fflush(sink);
+    double t5 = now_seconds();
+
+    out[PH_LEX] = t1 - t0;
+    out[PH_PARSE] = t2 - t1;
+    out[PH_IR] = t3 - t2;
+    out[PH_OPT] = t4 - t3;
+    out[PH_CODEGEN] = t5 - t4;
+    ok = true;
+
+defer:
+    fclose(sink);
+    arena_free(&arena);
+    return ok;
+}
+
+// Least squares slope of log(t) over log(n)
+// `lo` and `hi` receive the range of n that was actually fitted
+static bool fit_exponent(const double *ns, const double *ts, size_t count, double *out, double *lo, double *hi) {
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (ts[i] < NOISE_FLOOR_SECONDS) continue;
+        if (used == 0) *lo = ns[i];
+        *hi = ns[i];
+        double x = log(ns[i]), y = log(ts[i]);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        used++;
+    }
+    if (used < 3) return false;
+    double denom = used * sxx - sx * sx;
+    if (denom == 0) return false;
+    *out = (used * sxy - sx * sy) / denom;
+    return true;
+}
+
+// The exponent n log n looks like when fitted over [lo, hi]
+static double n_log_n_exponent(double lo, double hi) {
+    if (lo < 2) lo = 2;
+    return 1.0 + log(log(hi) / log(lo)) / log(hi / lo);
+}
+
+int main(int argc, char **argv) {
+    bool quick = false;
+    size_t runs = 3;
+    const char *only = NULL;
+    size_t level = OPT_LEVEL_DEFAULT;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-quick") == 0) {
+            quick = true;
+        } else if (strcmp(argv[i], "-runs") == 0 && i + 1 < argc) {
+            runs = strtoull(argv[++i], NULL, 10);
+            ASSERT(runs > 0, "-runs has to be at least 1");
+        } else if (strcmp(argv[i], "-family") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else if (strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '0' && argv[i][2] <= '0' + OPT_LEVEL_MAX &&
+                   argv[i][3] == 0) {
+            level = argv[i][2] - '0';
+        } else {
+            log_diagnostic(LL_ERROR,
+                           "Unknown flag %s (usage: scaling [-quick] [-runs <N>] [-family <name>] [-O<level>])", argv[i]);
+            return 1;
+        }
+    }
+
+    Family families[] = {
+        {.name = "lines", .unit = "lines", .min = 10000, .max = 10000000, .quick_max = 640000, .generate = generate_lines},
+        {.name = "scopes", .unit = "nested scopes", .min = 1, .max = 10000, .quick_max = 5000, .generate = generate_scopes},
+        {.name = "functions", .unit = "functions", .min = 1, .max = 100000, .quick_max = 25000, .generate = generate_functions},
+    };
+    size_t family_count = sizeof(families) / sizeof(*families);
+
+    bool failed = false;
+    printf("-O%zu\n", level);
+    printf("%-10s %-8s %10s %8s %6s\n", "family", "phase", "points", "exponent", "limit");
+    for (size_t f = 0; f < family_count; f++) {
+        Family *fam = &families[f];
+        if (only != NULL && strcmp(only, fam->name) != 0) continue;
+        size_t max = quick ? fam->quick_max : fam->max;
+
+        double ns[64] = {0};
+        double ts[PH_COUNT][64] = {0};
+        size_t count = 0;
+        for (size_t n = fam->min; n <= max && count < 64; n *= 2) {
+            Source src = {0};
+            fam->generate(&src, n);
+
+            double best[PH_COUNT];
+            for (Phase ph = 0; ph < PH_COUNT; ph++) best[ph] = INFINITY;
+            for (size_t r = 0; r < runs; r++) {
+                double t[PH_COUNT];
+                if (!compile_timed(&src, level, t)) {
+                    log_diagnostic(LL_ERROR, "Failed to compile the %s family at n = %zu", fam->name, n);
+                    return 1;
+                }
+                for (Phase ph = 0; ph < PH_COUNT; ph++) best[ph] = t[ph] < best[ph] ? t[ph] : best[ph];
+            }
+            free(src.items);
+
+            ns[count] = (double)n;
+            for (Phase ph = 0; ph < PH_COUNT; ph++) ts[ph][count] = best[ph];
+            count++;
+            fprintf(stderr, "  %s n=%-9zu lex %.4fs parse %.4fs ir %.4fs opt %.4fs codegen %.4fs\n", fam->name, n,
+                    best[PH_LEX], best[PH_PARSE], best[PH_IR], best[PH_OPT], best[PH_CODEGEN]);
+        }
+
+        for (Phase ph = 0; ph < PH_COUNT; ph++) {
+            double k = 0, lo = 0, hi = 0;
+            if (!fit_exponent(ns, ts[ph], count, &k, &lo, &hi)) {
+                printf("%-10s %-8s %10zu %8s %6s  (below noise floor)\n", fam->name, phase_names[ph], count, "-", "-");
+                continue;
+            }
+            double limit = n_log_n_exponent(lo, hi) + EXPONENT_SLACK;
+            bool ok = k <= limit;
+            failed |= !ok;
+            printf("%-10s %-8s %10zu %8.2f %6.2f  %s\n", fam->name, phase_names[ph], count, k, limit,
+                   ok ? "ok" : "SUPERLINEAR");
+        }
+    }
+
+    if (failed) {
+        log_diagnostic(LL_ERROR, "Some phases grow faster than O(n log n)");
+        return 1;
+    }
+    return 0;
+}
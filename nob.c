@@ -7,7 +7,8 @@
 
 #define BUILD_DIR "build"
 #define TEST_DIR "tests"
-#define SOURCES "src/log.c", "src/frontend/lexer.c", "src/arena.c", "src/frontend/parser.c", "src/backend/ir/ssa.c", "src/backend/codegen/nasm_x86_64_linux.c", "src/util.c", "src/config.c", "src/target.c" 
+#define BENCH_DIR "bench"
+#define SOURCES "src/log.c", "src/frontend/lexer.c", "src/arena.c", "src/frontend/parser.c", "src/backend/ir/ssa.c", "src/backend/ir/cfg.c", "src/backend/ir/ssa_form.c", "src/backend/ir/constfold.c", "src/backend/ir/dce.c", "src/backend/ir/gvn.c", "src/backend/ir/licm.c", "src/backend/ir/indvars.c", "src/backend/ir/ifconv.c", "src/backend/ir/inline.c", "src/backend/ir/tailcall.c", "src/backend/ir/unroll.c", "src/backend/ir/opt.c", "src/backend/codegen/nasm_x86_64_linux.c", "src/backend/codegen/regalloc.c", "src/backend/codegen/x86_64.c", "src/backend/codegen/peephole.c", "src/util.c", "src/config.c", "src/target.c" 
 
 // #ifdef _WIN32
 //     @sa.pohod ty <3
@@ -16,7 +17,9 @@
 
 void common_flags(Cmd *cmd);
 
+[[nodiscard]] bool build_compiler();
 [[nodiscard]] bool run_tests();
+[[nodiscard]] bool run_bench(const char *name, int argc, char **argv);
 
 int main(int argc, char *argv[]) {
     NOB_GO_REBUILD_URSELF(argc, argv);
@@ -30,6 +33,23 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        if (argc < 3) {
+            nob_log(NOB_ERROR, "Usage: %s bench <name> [ARGS] (see the " BENCH_DIR "/ directory)", argv[0]);
+            return 1;
+        }
+        // some benchmarks drive the compiler itself
+        if (!build_compiler()) return 1;
+        if (!run_bench(argv[2], argc - 3, argv + 3)) return 1;
+        return 0;
+    }
+
+    if (!build_compiler()) return 1;
+
+    return 0;
+}
+
+bool build_compiler() {
     Cmd cmd = {0};
 
     mkdir_if_not_exists(BUILD_DIR);
@@ -38,9 +58,13 @@ int main(int argc, char *argv[]) {
     cmd_append(&cmd, "cc", SOURCES, "src/main.c", "-o", BUILD_DIR "/boa");
     common_flags(&cmd);
 
-    if (!nob_cmd_run_sync_and_reset(&cmd)) return 1;
+    return nob_cmd_run_sync_and_reset(&cmd);
+}
 
-    return 0;
+// Every .c file in the test directory is a test of its own, headers hold what they share
+static bool is_test_source(const char *name) {
+    size_t len = strlen(name);
+    return *name != '.' && len > 2 && strcmp(name + len - 2, ".c") == 0;
 }
 
 bool run_tests() {
@@ -54,7 +78,7 @@ bool run_tests() {
     Procs test_compilations = {0};
 
     for (int i = 0; i < (int)test_paths.count; i++) {
-        if (*test_paths.items[i] == '.') continue;
+        if (!is_test_source(test_paths.items[i])) continue;
         char *path = temp_sprintf(TEST_DIR "/%s", test_paths.items[i]);
 
         char *exe_path = temp_sprintf(BUILD_DIR "/" TEST_DIR "/%s", test_paths.items[i]);
@@ -75,7 +99,7 @@ bool run_tests() {
     }
 
     for (int i = 0; i < (int)test_paths.count; i++) {
-        if (*test_paths.items[i] == '.') continue;
+        if (!is_test_source(test_paths.items[i])) continue;
 
         char *exe_path = temp_sprintf("./" BUILD_DIR "/" TEST_DIR "/%s", test_paths.items[i]);
         exe_path[strlen(exe_path) - 2] = 0; // strip .c suffix
@@ -90,4 +114,30 @@ bool run_tests() {
     return true;
 }
 
+bool run_bench(const char *name, int argc, char **argv) {
+    mkdir_if_not_exists(BUILD_DIR);
+    mkdir_if_not_exists(BUILD_DIR "/" BENCH_DIR);
+
+    Cmd cmd = {0};
+    char *path = temp_sprintf(BENCH_DIR "/%s.c", name);
+    char *exe_path = temp_sprintf("./" BUILD_DIR "/" BENCH_DIR "/%s", name);
+
+    cmd_append(&cmd, "cc");
+    common_flags(&cmd);
+    cmd_append(&cmd, SOURCES, path, "-o", exe_path, "-lm");
+    if (!nob_cmd_run_sync_and_reset(&cmd)) {
+        nob_log(NOB_WARNING, "Failed to build %s benchmark", path);
+        return false;
+    }
+
+    cmd_append(&cmd, exe_path);
+    for (int i = 0; i < argc; i++) cmd_append(&cmd, argv[i]);
+    if (!nob_cmd_run_sync_and_reset(&cmd)) {
+        nob_log(NOB_WARNING, "%s benchmark failed", exe_path);
+        return false;
+    }
+
+    return true;
+}
+
 void common_flags(Cmd *cmd) { cmd_append(cmd, "-Wall", "-Wextra", "-Werror", "-std=c23", "-O3", "-g", "-Wno-nonnull", "-Wno-format-overflow" ); }
@@ -16,6 +16,11 @@ void *arena_alloc(Arena *arena, size_t size) {
     arena->used += size;
     return buf;
 }
+void *arena_alloc_zeroed(Arena *arena, size_t size) {
+    void *buf = arena_alloc(arena, size);
+    memset(buf, 0, size);
+    return buf;
+}
 void arena_free(Arena *arena) {
     ASSERT(arena, "House keeping");
     ASSERT(arena->buffer, "House keeping");
@@ -10,6 +10,7 @@ typedef struct {
 
 Arena arena_new(size_t size);
 void* arena_alloc(Arena* arena, size_t size);
+void* arena_alloc_zeroed(Arena* arena, size_t size);
 void arena_free(Arena* arena);
 
 #endif
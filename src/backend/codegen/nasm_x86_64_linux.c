@@ -1,47 +1,111 @@
 #include "nasm_x86_64_linux.h"
 #include "../../util.h"
+#include "../ir/cfg.h"
+#include "regalloc.h"
+#include "x86_64.h"
 #include <stdio.h>
 
-static bool generate_nasm_function(FILE *sink, const Function *func);
-static bool generate_nasm_statement(FILE *sink, const Statement *st);
-
-static void emit_return_some(FILE *sink, const Statement *ret);
-static void emit_return_none(FILE *sink, const Statement *ret_none);
-
-static void emit_add(FILE *sink, const Statement *st);
-static void emit_sub(FILE *sink, const Statement *st);
-static void emit_imul(FILE *sink, const Statement *st);
-static void emit_div(FILE *sink, const Statement *st);
-static void emit_assign(FILE *sink, const Statement *st);
-static void emit_call(FILE *sink, const Statement *st);
-
-static void emit_add_reg_value(FILE *sink, const char *reg, const Value *value);
-static void emit_sub_reg_value(FILE *sink, const char *reg, const Value *value);
-static void emit_imul_reg_value(FILE *sink, const char *reg, const Value *value);
-static void move_value_into_register(FILE *sink, const char *reg, const Value *value);
-static void move_value_into_value(FILE *sink, const Value *from, const Value *into);
-
-static void value_asm_repr(FILE *sink, const Value *value);
+// The instructions of the function that is being generated, printed once the peephole optimizer is done with them
+// Without it (at -O0) nothing looks at them again, so they go to `sink` right away
+typedef struct {
+    Instrs code;
+    FILE *sink;
+    // attached to the next instruction
+    const char *comment;
+    Arena *arena;
+} Emitter;
+
+static void emit_rdtsc_prelude(FILE *sink);
+static bool generate_nasm_function(FILE *sink, Emitter *e, const Function *func, const TargetOptions *opts,
+                                   const FunctionNames *clobbering);
+static void generate_nasm_blocks(Emitter *e, const Function *func);
+static bool generate_nasm_statement(Emitter *e, const Function *func, const Statement *st);
+
+static void emit_return_some(Emitter *e, const Function *func, const Statement *ret);
+static void emit_return_none(Emitter *e, const Statement *ret_none);
+
+static void emit_add(Emitter *e, const Function *func, const Statement *st);
+static void emit_sub(Emitter *e, const Function *func, const Statement *st);
+static void emit_imul(Emitter *e, const Function *func, const Statement *st);
+static void emit_div(Emitter *e, const Function *func, const Statement *st);
+static void emit_compare(Emitter *e, const Function *func, const Statement *st);
+static void emit_compare_branch(Emitter *e, const Function *func, const Statement *cmp, const Statement *jz);
+static void emit_select(Emitter *e, const Function *func, const Statement *st, const Statement *cmp);
+static void emit_assign(Emitter *e, const Function *func, const Statement *st);
+static void emit_call(Emitter *e, const Function *func, const Statement *st);
+static bool emit_tail_call(Emitter *e, const Function *func, const Statement *st);
+static void emit_frame_teardown(Emitter *e);
+
+static void emit(Emitter *e, Opcode op, Operand a, Operand b);
+static void emit_comment(Emitter *e, const char *text);
+static void emit_binop(Emitter *e, const Function *func, Opcode op, const Statement *st);
+static bool emit_mul_by_const(Emitter *e, const Function *func, const Statement *st);
+static bool emit_div_by_const(Emitter *e, const Function *func, const Statement *st);
+static void emit_op_reg_value(Emitter *e, const Function *func, Opcode op, Register reg, const Value *value);
+static void store_rax(Emitter *e, const Function *func, const Value *into);
+static void move_value_into_register(Emitter *e, const Function *func, Register reg, const Value *value);
+static void move_value_into_value(Emitter *e, const Function *func, const Value *from, const Value *into);
+
+static void layout_frame(const Function *func);
+static size_t frame_size(void);
+static Operand slot_operand(size_t slot);
+static Operand value_operand(const Function *func, const Value *value);
+static Register value_register(const Value *value);
+static bool fits_imm32(const Function *func, const Value *value);
 
 static size_t f_count = 0;
-
-const char *idx_to_reg[] = {
-    "rdi", "rsi", "rdx", "rcx", "r8", "r9",
+// multiplications and divisions by constants avoid imul and div from 1 on
+static size_t opt_level = 0;
+// where the temps of the function that is being generated live
+static RegAllocation allocation;
+// true if `regalloc_linear_scan` gave the temps of the function registers, false if they all live in stack slots
+// Only then tail calls become jumps and a leaf function can go without a frame (see `layout_frame`)
+static bool allocated = false;
+static const FunctionNames *clobbering_functions = NULL;
+// false if the function addresses its stack from rsp and never sets up rbp, see `layout_frame`
+static bool frame_pointer = true;
+
+// The 128 bytes below rsp that signal handlers leave alone, a leaf function can keep its slots there
+#define RED_ZONE_SLOTS 16
+// Loop headers start at a multiple of this many bytes
+#define LOOP_ALIGNMENT 16
+
+static const Register arg_registers[] = {
+    REG_RDI, REG_RSI, REG_RDX, REG_RCX, REG_R8, REG_R9,
 };
 
-bool nasm_x86_64_linux_generate_file(FILE *sink, const Module *mod) {
+static const Operand none = {0};
+
+bool nasm_x86_64_linux_generate_file(FILE *sink, const Module *mod, const TargetOptions *opts, Arena *arena) {
+    // functions with inline asm may write any register
+    FunctionNames clobbering = {0};
+    for (size_t i = 0; i < mod->functions.count; i++) {
+        if (function_has_asm(&mod->functions.items[i])) {
+            da_push(&clobbering, mod->functions.items[i].name, arena);
+        }
+    }
 
     // prelude of some sorts
     fprintf(sink, "section .text\n");
     fprintf(sink, "global _start\n");
     fprintf(sink, "_start:\n");
-    fprintf(sink, "  call main\n");
-    fprintf(sink, "  mov rsi, rax\n");
-    fprintf(sink, "  mov rax, 60\n");
-    fprintf(sink, "  mov rdi, rsi\n");
-    fprintf(sink, "  syscall\n");
+    if (opts->rdtsc) {
+        emit_rdtsc_prelude(sink);
+    } else {
+        fprintf(sink, "  call main\n");
+        fprintf(sink, "  mov rsi, rax\n");
+        fprintf(sink, "  mov rax, 60\n");
+        fprintf(sink, "  mov rdi, rsi\n");
+        fprintf(sink, "  syscall\n");
+    }
 
-    for (size_t i = 0; i < mod->functions.count; i++) { generate_nasm_function(sink, &mod->functions.items[i]); }
+    // one buffer for all of them, it only grows to the size of the largest function
+    Emitter e = {.sink = sink, .arena = arena};
+    opt_level = opts->opt_level;
+    clobbering_functions = &clobbering;
+    for (size_t i = 0; i < mod->functions.count; i++) {
+        generate_nasm_function(sink, &e, &mod->functions.items[i], opts, &clobbering);
+    }
 
     fprintf(sink, "section .data\n");
     for (size_t i = 0; i < mod->strings.count; i++) {
@@ -51,85 +115,220 @@ bool nasm_x86_64_linux_generate_file(FILE *sink, const Module *mod) {
     return true;
 }
 
-static bool generate_nasm_function(FILE *sink, const Function *func) {
-    fprintf(sink, STR_FMT ":\n", STR_ARG(func->name));
-    fprintf(sink, "  push rbp\n");
-    fprintf(sink, "  mov rbp, rsp\n");
-    fprintf(sink, "  sub rsp, %ld\n", func->max_temps * 8);
+// Same as the plain prelude, but `main` is timed with the TSC
+// [rsp + 8] holds the start timestamp and later the delta, [rsp] the exit code (two pushes keep `main` aligned)
+// The delta goes to fd 3 as 8 raw bytes, if nobody opened it the write just fails with EBADF
+static void emit_rdtsc_prelude(FILE *sink) {
+    fprintf(sink, "  lfence\n");
+    fprintf(sink, "  rdtsc\n");
+    fprintf(sink, "  shl rdx, 32\n");
+    fprintf(sink, "  or rax, rdx\n");
+    fprintf(sink, "  push rax\n");
+    fprintf(sink, "  push rax\n");
+    fprintf(sink, "  call main\n");
+    fprintf(sink, "  mov qword [rsp], rax\n");
+    fprintf(sink, "  rdtscp\n");
+    fprintf(sink, "  lfence\n");
+    fprintf(sink, "  shl rdx, 32\n");
+    fprintf(sink, "  or rax, rdx\n");
+    fprintf(sink, "  sub rax, qword [rsp + 8]\n");
+    fprintf(sink, "  mov qword [rsp + 8], rax\n");
+    fprintf(sink, "  mov rax, 1\n");
+    fprintf(sink, "  mov rdi, 3\n");
+    fprintf(sink, "  lea rsi, [rsp + 8]\n");
+    fprintf(sink, "  mov rdx, 8\n");
+    fprintf(sink, "  syscall\n");
+    fprintf(sink, "  mov rdi, qword [rsp]\n");
+    fprintf(sink, "  mov rax, 60\n");
+    fprintf(sink, "  syscall\n");
+}
+
+static bool generate_nasm_function(FILE *sink, Emitter *e, const Function *func, const TargetOptions *opts,
+                                   const FunctionNames *clobbering) {
+    allocated = opts->opt_level > 0 && func->cfg.blocks.count > 0 && !function_has_asm(func);
+    if (allocated) {
+        regalloc_linear_scan(func, clobbering, &allocation, e->arena);
+    } else {
+        regalloc_stack_only(func, &allocation, e->arena);
+    }
+
+    layout_frame(func);
+
+    e->code.count = 0;
+    emit(e, X_LABEL, op_function(func->name), none);
+    if (frame_pointer) {
+        emit(e, X_PUSH, op_reg(REG_RBP), none);
+        emit(e, X_MOV, op_reg(REG_RBP), op_reg(REG_RSP));
+    }
+    for (size_t i = 0; i < allocation.saved_count; i++) emit(e, X_PUSH, op_reg(allocation.saved[i]), none);
+    if (frame_pointer && frame_size() > 0) emit(e, X_SUB, op_reg(REG_RSP), op_imm(frame_size()));
 
-    for (size_t i = 0; i < func->body.count; i++) { generate_nasm_statement(sink, &func->body.items[i]); }
+    if (func->cfg.blocks.count == 0) {
+        for (size_t i = 0; i < func->body.count; i++) { generate_nasm_statement(e, func, &func->body.items[i]); }
+    } else {
+        generate_nasm_blocks(e, func);
+    }
 
-    fprintf(sink, "ret%ld:\n", f_count);
-    fprintf(sink, "  mov rsp, rbp\n");
-    fprintf(sink, "  pop rbp\n");
-    fprintf(sink, "  ret\n");
+    emit(e, X_LABEL, op_label(LK_RETURN, f_count), none);
+    emit_frame_teardown(e);
+    emit(e, X_RET, none, none);
     f_count++;
 
+    if (opts->opt_level > 0) peephole_optimize(&e->code);
+    for (size_t i = 0; i < e->code.count; i++) x86_print_instr(sink, &e->code.items[i]);
+
     return true;
 }
 
-static bool generate_nasm_statement(FILE *sink, const Statement *st) {
+// Lays the reachable blocks out in reverse postorder, unreachable ones aren't emitted at all
+// A block whose fall through successor doesn't come right after it gets an explicit jump
+// A comparison that only feeds the ST_JZ right after it never needs its 0 or 1, the jump tests the flags instead
+static void generate_nasm_blocks(Emitter *e, const Function *func) {
+    const Cfg *cfg = &func->cfg;
+    uint32_t *uses = arena_alloc_zeroed(e->arena, sizeof(*uses) * (func->max_temps + 1));
+    ValueRefs refs = {0};
+    for (size_t i = 0; i < func->body.count; i++) {
+        // only reads through the pointers
+        statement_uses((Function *)func, (Statement *)&func->body.items[i], &refs, e->arena);
+        for (size_t k = 0; k < refs.count; k++) {
+            if (refs.items[k]->type == VT_TEMP) uses[refs.items[k]->index]++;
+        }
+    }
+
+    for (size_t i = 0; i < cfg->rpo.count; i++) {
+        BlockId b = cfg->rpo.items[i];
+        const BasicBlock *block = &cfg->blocks.items[b];
+        // a block that is jumped back to from further down heads a loop, starting it on a fresh 16 bytes keeps the
+        // first instructions of every iteration in one fetch block
+        for (size_t p = 0; opt_level > 0 && p < block->preds.count; p++) {
+            uint32_t from = cfg->blocks.items[block->preds.items[p]].rpo_index;
+            if (from != BLOCK_UNREACHABLE && from >= block->rpo_index) {
+                emit(e, X_ALIGN, op_imm(LOOP_ALIGNMENT), none);
+                break;
+            }
+        }
+        emit(e, X_LABEL, op_label(LK_BLOCK, b), none);
+        for (size_t j = block->begin; j < block->end; j++) {
+            const Statement *st = &func->body.items[j];
+            if (allocated && statement_is_tail_call(func, j) && emit_tail_call(e, func, st)) {
+                // the return after it is never reached
+                if (j + 1 < block->end) j++;
+                continue;
+            }
+            if (j + 1 < block->end && statement_is_comparison(st->type)) {
+                const Statement *next = &func->body.items[j + 1];
+                if (next->type == ST_JZ && next->jz.cond.type == VT_TEMP &&
+                    next->jz.cond.index == st->binop.result.index && uses[st->binop.result.index] == 1) {
+                    emit_comment(e, "compare and jz");
+                    emit_compare_branch(e, func, st, next);
+                    j++;
+                    continue;
+                }
+                if (next->type == ST_SELECT && next->select.cond.type == VT_TEMP &&
+                    next->select.cond.index == st->binop.result.index && uses[st->binop.result.index] == 1) {
+                    emit_comment(e, "compare and select");
+                    emit_select(e, func, next, st);
+                    j++;
+                    continue;
+                }
+            }
+            generate_nasm_statement(e, func, st);
+        }
+
+        if (block->end > block->begin && !statement_falls_through(func->body.items[block->end - 1].type)) continue;
+        BlockId next = i + 1 < cfg->rpo.count ? cfg->rpo.items[i + 1] : BLOCK_UNREACHABLE;
+        BlockId fallthrough = cfg_fallthrough(func, b);
+        if (fallthrough == BLOCK_UNREACHABLE && next != BLOCK_UNREACHABLE) {
+            // falls off the end of the function
+            emit(e, X_JMP, op_label(LK_RETURN, f_count), none);
+        } else if (fallthrough != BLOCK_UNREACHABLE && fallthrough != next) {
+            emit(e, X_JMP, op_label(LK_BLOCK, fallthrough), none);
+        }
+    }
+}
+
+static bool generate_nasm_statement(Emitter *e, const Function *func, const Statement *st) {
     switch (st->type) {
     case ST_RETURN: {
-        fprintf(sink, "; return something\n");
-        emit_return_some(sink, st);
+        emit_comment(e, "return something");
+        emit_return_some(e, func, st);
         return true;
     }
     case ST_RETURN_EMPTY: {
-        fprintf(sink, "; return nothing\n");
-        emit_return_none(sink, st);
+        emit_comment(e, "return nothing");
+        emit_return_none(e, st);
         return true;
     }
     case ST_ADD: {
-        fprintf(sink, "; add\n");
-        emit_add(sink, st);
+        emit_comment(e, "add");
+        emit_add(e, func, st);
         return true;
     }
     case ST_SUB: {
-        fprintf(sink, "; sub\n");
-        emit_sub(sink, st);
+        emit_comment(e, "sub");
+        emit_sub(e, func, st);
         return true;
     }
     case ST_MUL: {
-        fprintf(sink, "; mul\n");
-        emit_imul(sink, st);
+        emit_comment(e, "mul");
+        emit_imul(e, func, st);
         return true;
     }
     case ST_DIV: {
-        fprintf(sink, "; div\n");
-        emit_div(sink, st);
+        emit_comment(e, "div");
+        emit_div(e, func, st);
+        return true;
+    }
+    case ST_EQ:
+    case ST_NE:
+    case ST_LT:
+    case ST_LE:
+    case ST_GT:
+    case ST_GE: {
+        emit_comment(e, "compare");
+        emit_compare(e, func, st);
         return true;
     }
     case ST_ASSIGN: {
-        fprintf(sink, "; assign\n");
-        emit_assign(sink, st);
+        emit_comment(e, "assign");
+        emit_assign(e, func, st);
         return true;
     }
     case ST_CALL: {
-        fprintf(sink, "; call\n");
-        emit_call(sink, st);
+        emit_comment(e, "call");
+        emit_call(e, func, st);
         return true;
     }
     case ST_LABEL: {
-        fprintf(sink, "; label\n");
-        fprintf(sink, "  .l%zu:\n", st->label);
+        emit_comment(e, "label");
+        emit(e, X_LABEL, op_label(LK_IR, st->label), none);
         return true;
     }
     case ST_JZ: {
-        fprintf(sink, "; jz\n");
-        move_value_into_register(sink, "rax", &st->jz.cond);
-        fprintf(sink, "  cmp rax, 0\n");
-        fprintf(sink, "  jz .l%zu\n", st->jz.to);
+        emit_comment(e, "jz");
+        Register reg = value_register(&st->jz.cond);
+        if (reg == REG_NONE) {
+            move_value_into_register(e, func, REG_RAX, &st->jz.cond);
+            reg = REG_RAX;
+        }
+        emit(e, X_CMP, op_reg(reg), op_imm(0));
+        emit(e, X_JZ, op_label(LK_IR, st->jz.to), none);
         return true;
     }
     case ST_JMP: {
-        fprintf(sink, "; jmp\n");
-        fprintf(sink, "  jmp .l%zu\n", st->jmp);
+        emit_comment(e, "jmp");
+        emit(e, X_JMP, op_label(LK_IR, st->jmp), none);
+        return true;
+    }
+    case ST_SELECT: {
+        emit_comment(e, "select");
+        emit_select(e, func, st, NULL);
         return true;
     }
+    case ST_PHI: UNREACHABLE("from_ssa runs before the code generator");
     case ST_ASM: {
-        fprintf(sink, "; asm\n");
-        fprintf(sink, STR_FMT "\n", STR_ARG(st->asm));
+        emit_comment(e, "asm");
+        emit(e, X_ASM, op_text(ir_name(func, st->asm)), none);
         return true;
     }
     }
@@ -137,152 +336,410 @@ static bool generate_nasm_statement(FILE *sink, const Statement *st) {
     return false;
 }
 
-static void emit_return_some(FILE *sink, const Statement *ret) {
+static void emit_return_some(Emitter *e, const Function *func, const Statement *ret) {
     ASSERT(ret->type == ST_RETURN, "This function should only be called when the type of the statement is ST_RETURN");
-    move_value_into_register(sink, "rax", &ret->ret.value);
-    fprintf(sink, "  jmp ret%ld\n", f_count);
+    move_value_into_register(e, func, REG_RAX, &ret->ret.value);
+    emit(e, X_JMP, op_label(LK_RETURN, f_count), none);
 }
 
-static void emit_return_none(FILE *sink, const Statement *ret_none) {
+static void emit_return_none(Emitter *e, const Statement *ret_none) {
     ASSERT(ret_none->type == ST_RETURN_EMPTY,
            "This function should only be called when the type of the statement is ST_RETURN_EMPTY");
-    fprintf(sink, "  jmp ret%ld\n", f_count);
+    emit(e, X_JMP, op_label(LK_RETURN, f_count), none);
 }
 
-static void emit_add(FILE *sink, const Statement *st) {
+static void emit_add(Emitter *e, const Function *func, const Statement *st) {
     ASSERT(st->type == ST_ADD, "This function should only be called when the type of the statement is ST_ADD");
     ASSERT(st->binop.result.type == VT_TEMP, "we can't add to a constant");
-    move_value_into_register(sink, "rax", &st->binop.l);
-
-    emit_add_reg_value(sink, "rax", &st->binop.r);
-    fprintf(sink, "  mov qword [rbp - %ld], rax\n", (st->binop.result.temp + 1) * 8);
+    emit_binop(e, func, X_ADD, st);
 }
 
-static void emit_sub(FILE *sink, const Statement *st) {
+static void emit_sub(Emitter *e, const Function *func, const Statement *st) {
     ASSERT(st->type == ST_SUB, "This function should only be called when the type of the statement is ST_SUB");
     ASSERT(st->binop.result.type == VT_TEMP, "we can't sub a constant");
-    move_value_into_register(sink, "rax", &st->binop.l);
-
-    emit_sub_reg_value(sink, "rax", &st->binop.r);
-    fprintf(sink, "  mov qword [rbp - %ld], rax\n", (st->binop.result.temp + 1) * 8);
+    emit_binop(e, func, X_SUB, st);
 }
 
-static void emit_imul(FILE *sink, const Statement *st) {
+static void emit_imul(Emitter *e, const Function *func, const Statement *st) {
     ASSERT(st->type == ST_MUL, "This function should only be called when the type of the statement is ST_MUL");
     ASSERT(st->binop.result.type == VT_TEMP, "we can't mul a constant");
-    move_value_into_register(sink, "rax", &st->binop.l);
-
-    emit_imul_reg_value(sink, "rax", &st->binop.r);
-    fprintf(sink, "  mov qword [rbp - %ld], rax\n", (st->binop.result.temp + 1) * 8);
+    if (opt_level > 0 && emit_mul_by_const(e, func, st)) return;
+    emit_binop(e, func, X_IMUL, st);
 }
 
-static void emit_div(FILE *sink, const Statement *st) {
+static void emit_div(Emitter *e, const Function *func, const Statement *st) {
     // ugh x86_64 is so weird
     // rax low bits
     // rdi high bits
     ASSERT(st->type == ST_DIV, "This function should only be called when the type of the statement is ST_DIV");
     ASSERT(st->binop.result.type == VT_TEMP, "we can't div a constant");
-    move_value_into_register(sink, "rax", &st->binop.l);
-    fprintf(sink, "  xor rdx, rdx\n");
-    move_value_into_register(sink, "rcx", &st->binop.r);
-    fprintf(sink, "  div rcx\n");
-    fprintf(sink, "  mov qword [rbp - %ld], rax\n", (st->binop.result.temp + 1) * 8);
+    if (opt_level > 0 && emit_div_by_const(e, func, st)) return;
+    move_value_into_register(e, func, REG_RAX, &st->binop.l);
+    emit(e, X_XOR, op_reg(REG_RDX), op_reg(REG_RDX));
+    move_value_into_register(e, func, REG_RCX, &st->binop.r);
+    emit(e, X_DIV, op_reg(REG_RCX), none);
+    store_rax(e, func, &st->binop.result);
 }
 
-static void emit_assign(FILE *sink, const Statement *st) {
+static void emit_compare(Emitter *e, const Function *func, const Statement *st) {
+    ASSERT(st->binop.result.type == VT_TEMP, "we can't compare into a constant");
+    // values are unsigned, hence below/above
+    Opcode set = X_COUNT;
+    switch (st->type) {
+    case ST_EQ: set = X_SETE; break;
+    case ST_NE: set = X_SETNE; break;
+    case ST_LT: set = X_SETB; break;
+    case ST_LE: set = X_SETBE; break;
+    case ST_GT: set = X_SETA; break;
+    case ST_GE: set = X_SETAE; break;
+    default: UNREACHABLE("This function should only be called for comparisons");
+    }
+    move_value_into_register(e, func, REG_RAX, &st->binop.l);
+    emit_op_reg_value(e, func, X_CMP, REG_RAX, &st->binop.r);
+    emit(e, set, op_reg8(REG_RAX), none);
+    emit(e, X_MOVZX, op_reg(REG_RAX), op_reg8(REG_RAX));
+    store_rax(e, func, &st->binop.result);
+}
+
+// cmp + jcc, which the CPU fuses into one branch
+// ST_JZ jumps when the comparison is false, so it takes the opposite condition
+static void emit_compare_branch(Emitter *e, const Function *func, const Statement *cmp, const Statement *jz) {
+    Opcode jump = X_COUNT;
+    switch (cmp->type) {
+    case ST_EQ: jump = X_JNE; break;
+    case ST_NE: jump = X_JE; break;
+    case ST_LT: jump = X_JAE; break;
+    case ST_LE: jump = X_JA; break;
+    case ST_GT: jump = X_JBE; break;
+    case ST_GE: jump = X_JB; break;
+    default: UNREACHABLE("This function should only be called for comparisons");
+    }
+    Register reg = value_register(&cmp->binop.l);
+    if (reg == REG_NONE) {
+        move_value_into_register(e, func, REG_RAX, &cmp->binop.l);
+        reg = REG_RAX;
+    }
+    emit_op_reg_value(e, func, X_CMP, reg, &cmp->binop.r);
+    emit(e, jump, op_label(LK_IR, jz->jz.to), none);
+}
+
+static Opcode cmov_opcode(StatementType comparison) {
+    switch (comparison) {
+    case ST_EQ: return X_CMOVE;
+    case ST_NE: return X_CMOVNE;
+    case ST_LT: return X_CMOVB;
+    case ST_LE: return X_CMOVBE;
+    case ST_GT: return X_CMOVA;
+    case ST_GE: return X_CMOVAE;
+    default: UNREACHABLE("Only comparisons set the flags a cmov reads");
+    }
+    return X_COUNT;
+}
+
+// cmp (or a test of the condition when `cmp` is NULL) + cmovcc, `cmp` is the comparison that computes the
+// condition of `st` and nothing else reads
+// The result starts out as the value for a false condition and the cmov puts the other one in, mov leaves the
+// flags alone so both can go after the cmp
+static void emit_select(Emitter *e, const Function *func, const Statement *st, const Statement *cmp) {
+    ASSERT(st->type == ST_SELECT, "This function should only be called when the type of the statement is ST_SELECT");
+    ASSERT(st->select.result.type == VT_TEMP, "The result of a select is always a temp");
+    StatementType when = ST_NE;
+    const Value *l = &st->select.cond;
+    if (cmp != NULL) {
+        when = cmp->type;
+        l = &cmp->binop.l;
+    }
+    Register reg = value_register(l);
+    if (reg == REG_NONE) {
+        move_value_into_register(e, func, REG_RAX, l);
+        reg = REG_RAX;
+    }
+    if (cmp != NULL) emit_op_reg_value(e, func, X_CMP, reg, &cmp->binop.r);
+    else emit(e, X_CMP, op_reg(reg), op_imm(0));
+
+    Value if_true = ir_select_value(func, st, true), if_false = ir_select_value(func, st, false);
+    Register result = value_register(&st->select.result);
+    if (result == REG_NONE) result = REG_RAX;
+    // moving the false value into the register that holds the true one would lose it, so they trade places
+    if (result == value_register(&if_true) && result != value_register(&if_false)) {
+        Value v = if_true;
+        if_true = if_false;
+        if_false = v;
+        when = negate_comparison(when);
+    }
+    move_value_into_register(e, func, result, &if_false);
+    // cmov doesn't take an immediate
+    Operand from = value_operand(func, &if_true);
+    if (from.kind != OPK_REG && from.kind != OPK_MEM) {
+        Register scratch = result == REG_RAX ? REG_RCX : REG_RAX;
+        emit(e, X_MOV, op_reg(scratch), from);
+        from = op_reg(scratch);
+    }
+    emit(e, cmov_opcode(when), op_reg(result), from);
+    if (result == REG_RAX) store_rax(e, func, &st->select.result);
+}
+
+static void emit_assign(Emitter *e, const Function *func, const Statement *st) {
     ASSERT(st->type == ST_ASSIGN, "This function should only be called when the type of the statement is ST_ASSIGN");
 
-    move_value_into_value(sink, &st->assign.value, &st->assign.place);
+    move_value_into_value(e, func, &st->assign.value, &st->assign.place);
 }
 
-static void emit_call(FILE *sink, const Statement *st) {
+static void emit_call(Emitter *e, const Function *func, const Statement *st) {
     ASSERT(st->type == ST_CALL, "This function should only be called when the type of the statement is ST_CALL");
 
     // here the ir generator or something else up top already checked that the function exists
     // and enough of the arguments are provided so now we just poop
-    for (size_t i = 0; i < st->call.args.count && i < 6; i++) {
-        move_value_into_register(sink, idx_to_reg[i], &st->call.args.items[i]);
+    const IrCall *call = ir_call(func, st->call.id);
+    size_t extra = call->args_count > 6 ? call->args_count - 6 : 0;
+    if (extra & 1) {
+        // align to 16 bytes, above the arguments so the callee finds its 7th one right over the return address
+        emit(e, X_SUB, op_reg(REG_RSP), op_imm(8));
     }
-
-    size_t extra = st->call.args.count > 6 ? st->call.args.count - 6 : 0;
-    for (size_t i = st->call.args.count; i-- > 6;) {
-        fprintf(sink, "  push ");
-        value_asm_repr(sink, &st->call.args.items[i]);
-        fprintf(sink, "\n");
+    // the stack arguments go first, the registers they might live in still hold them
+    for (size_t i = call->args_count; i-- > 6;) {
+        Value arg = ir_call_arg(func, call, i);
+        if (!fits_imm32(func, &arg)) {
+            move_value_into_register(e, func, REG_RAX, &arg);
+            emit(e, X_PUSH, op_reg(REG_RAX), none);
+        } else {
+            emit(e, X_PUSH, value_operand(func, &arg), none);
+        }
     }
 
-    if (extra & 1) {
-        // align to 16 bytes
-        fprintf(sink, "  sub rsp, 8\n");
+    for (size_t i = 0; i < call->args_count && i < 6; i++) {
+        Value arg = ir_call_arg(func, call, i);
+        move_value_into_register(e, func, arg_registers[i], &arg);
     }
 
-    fprintf(sink, "  call " STR_FMT "\n", STR_ARG(st->call.name));
-    if (st->call.returns) {
-        fprintf(sink, "  mov ");
-        value_asm_repr(sink, &st->call.return_v);
-        fprintf(sink, ", rax\n");
-    }
+    emit(e, X_CALL, op_function(ir_name(func, call->name)), none);
+    if (st->call.return_v.type != VT_NONE) store_rax(e, func, &st->call.return_v);
     if (extra != 0) {
         size_t cleanup_size = (extra + (extra & 1)) * 8;
-        fprintf(sink, "  add rsp, %zu\n", cleanup_size);
+        emit(e, X_ADD, op_reg(REG_RSP), op_imm(cleanup_size));
     }
 }
 
-static void move_value_into_value(FILE *sink, const Value *from, const Value *into) {
-    move_value_into_register(sink, "rax", from);
+// The callee returns straight to our caller, so the frame goes away first and the call becomes a jump
+// Only arguments that go in registers work, stack arguments would have to overwrite our caller's
+// Functions with inline asm don't preserve rbx and friends, so calls to them stay calls
+static bool emit_tail_call(Emitter *e, const Function *func, const Statement *st) {
+    const IrCall *call = ir_call(func, st->call.id);
+    StringView name = ir_name(func, call->name);
+    if (call->args_count > sizeof(arg_registers) / sizeof(*arg_registers)) return false;
+    for (size_t i = 0; i < clobbering_functions->count; i++) {
+        const StringView *candidate = &clobbering_functions->items[i];
+        if (candidate->count == name.count && strncmp(name.items, candidate->items, name.count) == 0) return false;
+    }
+
+    emit_comment(e, "tail call");
+    for (size_t i = 0; i < call->args_count; i++) {
+        Value arg = ir_call_arg(func, call, i);
+        move_value_into_register(e, func, arg_registers[i], &arg);
+    }
+    emit_frame_teardown(e);
+    emit(e, X_JMP, op_function(name), none);
+    return true;
+}
 
-    fprintf(sink, "  mov ");
-    value_asm_repr(sink, into);
-    fprintf(sink, ", rax\n");
+// Restores the callee saved registers and the caller's frame, leaving the return address on top of the stack
+static void emit_frame_teardown(Emitter *e) {
+    if (!frame_pointer) {
+        // nothing moved rsp since the pushes of the prologue
+        for (size_t i = allocation.saved_count; i-- > 0;) emit(e, X_POP, op_reg(allocation.saved[i]), none);
+        return;
+    }
+    if (allocation.saved_count > 0) {
+        emit(e, X_LEA, op_reg(REG_RSP), op_mem(REG_RBP, -(int32_t)allocation.saved_count * 8));
+        for (size_t i = allocation.saved_count; i-- > 0;) emit(e, X_POP, op_reg(allocation.saved[i]), none);
+    } else {
+        emit(e, X_MOV, op_reg(REG_RSP), op_reg(REG_RBP));
+    }
+    emit(e, X_POP, op_reg(REG_RBP), none);
 }
 
-static void emit_add_reg_value(FILE *sink, const char *reg, const Value *value) {
-    fprintf(sink, "  add %s, ", reg);
-    value_asm_repr(sink, value);
-    fprintf(sink, "\n");
+static void emit(Emitter *e, Opcode op, Operand a, Operand b) {
+    Instr instr = {.op = op, .a = a, .b = b, .comment = e->comment};
+    e->comment = NULL;
+    if (opt_level == 0) {
+        x86_print_instr(e->sink, &instr);
+        return;
+    }
+    da_push(&e->code, instr, e->arena);
 }
 
-static void emit_sub_reg_value(FILE *sink, const char *reg, const Value *value) {
-    fprintf(sink, "  sub %s, ", reg);
-    value_asm_repr(sink, value);
-    fprintf(sink, "\n");
+// The comment of a statement that turns into no instructions at all gets replaced by the one of the next statement
+static void emit_comment(Emitter *e, const char *text) { e->comment = text; }
+
+static void move_value_into_value(Emitter *e, const Function *func, const Value *from, const Value *into) {
+    Register into_reg = value_register(into);
+    if (into_reg != REG_NONE) {
+        move_value_into_register(e, func, into_reg, from);
+        return;
+    }
+    Register from_reg = value_register(from);
+    if (from_reg == REG_NONE) {
+        move_value_into_register(e, func, REG_RAX, from);
+        from_reg = REG_RAX;
+    }
+
+    emit(e, X_MOV, value_operand(func, into), op_reg(from_reg));
 }
 
-static void emit_imul_reg_value(FILE *sink, const char *reg, const Value *value) {
-    fprintf(sink, "  imul %s, ", reg);
-    value_asm_repr(sink, value);
-    fprintf(sink, "\n");
+// `result = l op r` for add, sub and imul, straight into the register of the result if it has one
+static void emit_binop(Emitter *e, const Function *func, Opcode op, const Statement *st) {
+    ASSERT(st->binop.result.type == VT_TEMP, "The result of a binop is always a temp");
+    Register reg = value_register(&st->binop.result);
+    // writing `l` into the result first would overwrite `r`
+    if (reg == REG_NONE || reg == value_register(&st->binop.r)) reg = REG_RAX;
+
+    move_value_into_register(e, func, reg, &st->binop.l);
+    emit_op_reg_value(e, func, op, reg, &st->binop.r);
+    if (reg == REG_RAX) store_rax(e, func, &st->binop.result);
 }
 
-static void move_value_into_register(FILE *sink, const char *reg, const Value *value) {
-    fprintf(sink, "  mov %s, ", reg);
-    value_asm_repr(sink, value);
-    fprintf(sink, "\n");
+// x * c with a shift and/or a lea for c = 0, 1, 2^k and 3, 5 or 9 times 2^k, false (and nothing emitted) otherwise
+static bool emit_mul_by_const(Emitter *e, const Function *func, const Statement *st) {
+    const Value *x = &st->binop.l, *c = &st->binop.r;
+    if (x->type == VT_CONST) {
+        x = &st->binop.r;
+        c = &st->binop.l;
+    }
+    if (c->type != VT_CONST || x->type == VT_CONST) return false;
+
+    uint64_t factor = ir_const_value(func, *c);
+    uint8_t shift = factor == 0 ? 0 : __builtin_ctzll(factor);
+    uint64_t odd = factor == 0 ? 0 : factor >> shift;
+    if (odd != 0 && odd != 1 && odd != 3 && odd != 5 && odd != 9) return false;
+
+    Register reg = value_register(&st->binop.result);
+    if (reg == REG_NONE) reg = REG_RAX;
+    if (factor == 0) {
+        emit(e, X_MOV, op_reg(reg), op_imm(0));
+    } else {
+        move_value_into_register(e, func, reg, x);
+        // reg + reg * 2, 4 or 8
+        if (odd != 1) emit(e, X_LEA, op_reg(reg), op_mem_index(reg, reg, odd - 1, 0));
+        if (shift != 0) emit(e, X_SHL, op_reg(reg), op_imm(shift));
+    }
+    if (reg == REG_RAX) store_rax(e, func, &st->binop.result);
+    return true;
 }
 
-static void value_asm_repr(FILE *sink, const Value *value) {
-    switch (value->type) {
-    case VT_CONST: {
-        fprintf(sink, "%ld", value->constant);
-        break;
+// x / c for a constant c other than 0 (which has to trap), a shift for powers of two and a multiplication by the
+// magic number of c for everything else
+static bool emit_div_by_const(Emitter *e, const Function *func, const Statement *st) {
+    if (st->binop.r.type != VT_CONST || st->binop.l.type == VT_CONST) return false;
+    uint64_t d = ir_const_value(func, st->binop.r);
+    if (d == 0) return false;
+
+    if ((d & (d - 1)) == 0) {
+        Register reg = value_register(&st->binop.result);
+        if (reg == REG_NONE) reg = REG_RAX;
+        move_value_into_register(e, func, reg, &st->binop.l);
+        if (d != 1) emit(e, X_SHR, op_reg(reg), op_imm(__builtin_ctzll(d)));
+        if (reg == REG_RAX) store_rax(e, func, &st->binop.result);
+        return true;
     }
-    case VT_TEMP: {
-        fprintf(sink, "qword [rbp - %ld]", (value->temp + 1) * 8);
-        break;
+
+    // mul takes the dividend from a register or memory, and the add step reads it again once rdx is overwritten
+    Operand n = value_operand(func, &st->binop.l);
+    if (n.kind != OPK_MEM && (n.kind != OPK_REG || n.reg == REG_RDX)) {
+        emit(e, X_MOV, op_reg(REG_RCX), n);
+        n = op_reg(REG_RCX);
+    }
+    DivMagic magic = unsigned_div_magic(d);
+    emit(e, X_MOV, op_reg(REG_RAX), op_imm((int64_t)magic.multiplier));
+    emit(e, X_MUL, n, none);
+    Register q = REG_RDX;
+    if (magic.add) {
+        emit(e, X_MOV, op_reg(REG_RAX), n);
+        emit(e, X_SUB, op_reg(REG_RAX), op_reg(REG_RDX));
+        emit(e, X_SHR, op_reg(REG_RAX), op_imm(1));
+        emit(e, X_ADD, op_reg(REG_RAX), op_reg(REG_RDX));
+        q = REG_RAX;
+    }
+    if (magic.shift != 0) emit(e, X_SHR, op_reg(q), op_imm(magic.shift));
+    emit(e, X_MOV, value_operand(func, &st->binop.result), op_reg(q));
+    return true;
+}
+
+static void emit_op_reg_value(Emitter *e, const Function *func, Opcode op, Register reg, const Value *value) {
+    if (!fits_imm32(func, value)) {
+        move_value_into_register(e, func, REG_RCX, value);
+        emit(e, op, op_reg(reg), op_reg(REG_RCX));
+        return;
+    }
+    emit(e, op, op_reg(reg), value_operand(func, value));
+}
+
+// Only mov takes a 64 bit immediate, everything else sign extends a 32 bit one
+static bool fits_imm32(const Function *func, const Value *value) {
+    if (value->type != VT_CONST) return true;
+    int64_t c = (int64_t)ir_const_value(func, *value);
+    return c >= INT32_MIN && c <= INT32_MAX;
+}
+
+static void store_rax(Emitter *e, const Function *func, const Value *into) {
+    emit(e, X_MOV, value_operand(func, into), op_reg(REG_RAX));
+}
+
+static void move_value_into_register(Emitter *e, const Function *func, Register reg, const Value *value) {
+    emit(e, X_MOV, op_reg(reg), value_operand(func, value));
+}
+
+// A function that calls nothing and whose slots fit in the red zone needs no frame: rsp stays where the pushes
+// of the saved registers left it, and the slots sit right below it
+// Inline asm is written against `[rbp - N]`, so functions that have some always get the frame
+// Functions that aren't `allocated` keep it too, everything about them stays as plain as at -O0
+static void layout_frame(const Function *func) {
+    frame_pointer = true;
+    if (!allocated || allocation.slot_count > RED_ZONE_SLOTS) return;
+    for (size_t i = 0; i < func->body.count; i++) {
+        if (func->body.items[i].type == ST_CALL || func->body.items[i].type == ST_ASM) return;
     }
-    case VT_STRING: {
-        fprintf(sink, "str_%zu", (value->string_index));
-        break;
+    frame_pointer = false;
+}
+
+// Bytes the prologue reserves for the slots
+// The return address and rbp take 16 bytes, so the saved registers and the slots have to come to a multiple of 16
+// too for rsp to be aligned at every call, which the stack arguments of `emit_call` rely on
+static size_t frame_size(void) {
+    size_t slots = allocation.slot_count + ((allocation.saved_count + allocation.slot_count) & 1);
+    return slots * 8;
+}
+
+// Stack slot `slot` of the function, below the saved registers either way
+static Operand slot_operand(size_t slot) {
+    if (!frame_pointer) return op_mem(REG_RSP, -(int32_t)(slot + 1) * 8);
+    return op_mem(REG_RBP, -(int32_t)(allocation.saved_count + slot + 1) * 8);
+}
+
+static Operand value_operand(const Function *func, const Value *value) {
+    switch (value->type) {
+    case VT_NONE: UNREACHABLE("An unused result has no location");
+    case VT_CONST: return op_imm(ir_const_value(func, *value));
+    case VT_TEMP: {
+        Register reg = allocation.regs[value->index];
+        if (reg != REG_NONE) return op_reg(reg);
+        return slot_operand(allocation.slots[value->index]);
     }
+    case VT_STRING: return op_string(value->index);
     case VT_ARG: {
-        if (value->arg_index < 6) {
-            fprintf(sink, "%s", idx_to_reg[(value->arg_index)]);
-        } else {
-            fprintf(sink, "[rbp + %zu]", ((value->arg_index - 6) * 8) + 16);
-        }
-        break;
+        if (value->index < 6) return op_reg(arg_registers[value->index]);
+        // above the return address, and without a frame pointer also above the saved registers
+        if (!frame_pointer) return op_mem(REG_RSP, ((value->index - 6) * 8) + 8 + allocation.saved_count * 8);
+        return op_mem(REG_RBP, ((value->index - 6) * 8) + 16);
     }
     }
+    UNREACHABLE("oh no");
+    return none;
+}
+
+// The register `value` lives in, REG_NONE if it's in memory or not a temp
+static Register value_register(const Value *value) {
+    if (value->type != VT_TEMP) return REG_NONE;
+    return allocation.regs[value->index];
 }
 
 // NOTES:
@@ -297,4 +754,4 @@ static void value_asm_repr(FILE *sink, const Value *value) {
 //   Extra to ze stack
 // RBX, RSP, RBP, and R12–R15 if used must be saved and restored before returning
 // Ze stack must be alligned to 16 bytes
-// Could implement a `red zone`
+// The 128 bytes below rsp are a `red zone` leaf functions can use without moving rsp
@@ -1,9 +1,10 @@
 #ifndef NASM_X86_64_LINUX_H
 #define NASM_X86_64_LINUX_H
 
+#include "../../target.h"
 #include "../ir/ssa.h"
 #include <stdio.h>
 
-bool nasm_x86_64_linux_generate_file(FILE* sink, const Module* mod);
+bool nasm_x86_64_linux_generate_file(FILE* sink, const Module* mod, const TargetOptions* opts, Arena* arena);
 
 #endif
@@ -0,0 +1,171 @@
+#include "x86_64.h"
+#include "../../util.h"
+
+// A rule looks at the instruction at `i` (never a deleted one) and the ones after it, and rewrites
+// them in place, deleting means turning into X_NOP
+// Return: true if it changed something
+typedef bool (*PeepholeRule)(Instrs *code, size_t i);
+
+// The instruction after `i` that does something, `code->count` if there's none
+static size_t next_instr(const Instrs *code, size_t i) {
+    for (i++; i < code->count; i++) {
+        if (code->items[i].op != X_NOP) break;
+    }
+    return i;
+}
+
+static bool is_reg(const Operand *o) { return o->kind == OPK_REG; }
+
+static bool is_conditional_jump(Opcode op) {
+    switch (op) {
+    case X_JZ:
+    case X_JE:
+    case X_JNE:
+    case X_JB:
+    case X_JBE:
+    case X_JA:
+    case X_JAE: return true;
+    default: return false;
+    }
+}
+
+static bool reads_flags(Opcode op) {
+    switch (op) {
+    case X_SETE:
+    case X_SETNE:
+    case X_SETB:
+    case X_SETBE:
+    case X_SETA:
+    case X_SETAE:
+    case X_CMOVE:
+    case X_CMOVNE:
+    case X_CMOVB:
+    case X_CMOVBE:
+    case X_CMOVA:
+    case X_CMOVAE: return true;
+    default: return is_conditional_jump(op);
+    }
+}
+
+static bool writes_flags(Opcode op) {
+    switch (op) {
+    case X_ADD:
+    case X_SUB:
+    case X_IMUL:
+    case X_MUL:
+    case X_DIV:
+    case X_SHL:
+    case X_SHR:
+    case X_XOR:
+    case X_CMP:
+    case X_TEST: return true;
+    default: return false;
+    }
+}
+
+// false if nothing reads the flags before they get overwritten
+// The code generator never keeps flags alive across a jump or into a block, inline asm might read them though
+static bool flags_live_after(const Instrs *code, size_t i) {
+    for (size_t j = next_instr(code, i); j < code->count; j = next_instr(code, j)) {
+        Opcode op = code->items[j].op;
+        if (reads_flags(op) || op == X_ASM) return true;
+        if (writes_flags(op)) return false;
+        if (op == X_LABEL || op == X_JMP || op == X_CALL || op == X_RET) return false;
+    }
+    return false;
+}
+
+// mov reg, reg
+static bool remove_self_move(Instrs *code, size_t i) {
+    Instr *in = &code->items[i];
+    if (in->op != X_MOV || !is_reg(&in->a) || !operands_equal(&in->a, &in->b)) return false;
+    in->op = X_NOP;
+    return true;
+}
+
+// mov [m], reg / mov reg2, [m] reads back what was just stored, and mov reg, [m] / mov [m], reg stores what is
+// already there
+static bool forward_store_to_load(Instrs *code, size_t i) {
+    Instr *first = &code->items[i];
+    if (first->op != X_MOV) return false;
+    size_t j = next_instr(code, i);
+    if (j == code->count || code->items[j].op != X_MOV) return false;
+    Instr *second = &code->items[j];
+
+    if (first->a.kind == OPK_MEM && is_reg(&first->b) && is_reg(&second->a) &&
+        operands_equal(&first->a, &second->b)) {
+        second->b = first->b;
+        if (operands_equal(&second->a, &second->b)) second->op = X_NOP;
+        return true;
+    }
+    if (is_reg(&first->a) && first->b.kind == OPK_MEM && operands_equal(&first->a, &second->b) &&
+        operands_equal(&first->b, &second->a)) {
+        second->op = X_NOP;
+        return true;
+    }
+    return false;
+}
+
+static bool is_label_or_padding(Opcode op) { return op == X_LABEL || op == X_ALIGN; }
+
+// A jump to a label that comes right after it, with only other labels (and the padding in front of them) in between
+static bool remove_jump_to_next(Instrs *code, size_t i) {
+    Instr *in = &code->items[i];
+    if (in->op != X_JMP && !is_conditional_jump(in->op)) return false;
+    for (size_t j = next_instr(code, i); j < code->count && is_label_or_padding(code->items[j].op);
+         j = next_instr(code, j)) {
+        if (operands_equal(&code->items[j].a, &in->a)) {
+            in->op = X_NOP;
+            return true;
+        }
+    }
+    return false;
+}
+
+// cmp reg, 0 -> test reg, reg, which sets the same flags with a shorter encoding
+static bool cmp_zero_to_test(Instrs *code, size_t i) {
+    Instr *in = &code->items[i];
+    if (in->op != X_CMP || !is_reg(&in->a) || in->b.kind != OPK_IMM || in->b.imm != 0) return false;
+    in->op = X_TEST;
+    in->b = in->a;
+    return true;
+}
+
+// mov reg, 0 -> xor reg32, reg32 (which also clears the upper half), but only where the flags are dead
+static bool mov_zero_to_xor(Instrs *code, size_t i) {
+    Instr *in = &code->items[i];
+    if (in->op != X_MOV || !is_reg(&in->a) || in->b.kind != OPK_IMM || in->b.imm != 0) return false;
+    if (flags_live_after(code, i)) return false;
+    in->op = X_XOR;
+    in->a = op_reg32(in->a.reg);
+    in->b = in->a;
+    return true;
+}
+
+// New rules go here, they run in this order on every instruction until none of them applies anywhere
+static const PeepholeRule rules[] = {
+    remove_self_move, forward_store_to_load, remove_jump_to_next, cmp_zero_to_test, mov_zero_to_xor,
+};
+
+bool peephole_optimize(Instrs *code) {
+    bool changed = false;
+    bool again = true;
+    while (again) {
+        again = false;
+        for (size_t i = 0; i < code->count; i++) {
+            if (code->items[i].op == X_NOP) continue;
+            for (size_t r = 0; r < sizeof(rules) / sizeof(*rules) && code->items[i].op != X_NOP; r++) {
+                again |= rules[r](code, i);
+            }
+        }
+        changed |= again;
+    }
+
+    // a deleted instruction stays around as long as it still has a comment to print
+    size_t kept = 0;
+    for (size_t i = 0; i < code->count; i++) {
+        if (code->items[i].op != X_NOP || code->items[i].comment) code->items[kept++] = code->items[i];
+    }
+    code->count = kept;
+    return changed;
+}
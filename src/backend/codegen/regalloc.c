@@ -0,0 +1,289 @@
+#include "regalloc.h"
+#include "../../util.h"
+#include "../ir/cfg.h"
+#include <stdlib.h>
+
+// Handed out in this order, the argument registers come after r10 and r11 since calls and the incoming arguments
+// get in their way
+static const Register caller_saved[] = {REG_R10, REG_R11, REG_RSI, REG_RDI, REG_R8, REG_R9};
+// Cost a push and a pop in the prologue and epilogue, so they come last
+static const Register callee_saved[] = {REG_RBX, REG_R12, REG_R13, REG_R14, REG_R15};
+
+typedef struct {
+    uint32_t temp;
+    // positions in the linearized body, both inclusive
+    uint32_t start;
+    uint32_t end;
+    // live on both sides of a call
+    bool crosses_call;
+    bool crosses_clobbering_call;
+    // overlaps a call (arguments included) or the reads of the incoming arguments, so an argument register would
+    // get overwritten under it
+    bool blocks_arg_regs;
+} Interval;
+
+typedef struct {
+    uint32_t *items;
+    size_t count;
+    size_t capacity;
+} Positions;
+
+typedef uint64_t Word;
+#define WORD_BITS 64
+
+static bool bit_get(const Word *set, uint32_t i) { return (set[i / WORD_BITS] >> (i % WORD_BITS)) & 1; }
+static void bit_set(Word *set, uint32_t i) { set[i / WORD_BITS] |= (Word)1 << (i % WORD_BITS); }
+
+static Word *bitsets_new(size_t count, size_t words, Arena *arena) {
+    Word *sets = arena_alloc(arena, sizeof(*sets) * (count * words + 1));
+    memset(sets, 0, sizeof(*sets) * count * words);
+    return sets;
+}
+
+static bool is_callee_saved(Register r) {
+    return r == REG_RBX || r == REG_R12 || r == REG_R13 || r == REG_R14 || r == REG_R15;
+}
+
+static bool is_arg_register(Register r) { return r == REG_RSI || r == REG_RDI || r == REG_R8 || r == REG_R9; }
+
+static bool register_allowed(const Interval *iv, Register r) {
+    if (iv->crosses_clobbering_call) return false;
+    if (is_callee_saved(r)) return true;
+    if (iv->crosses_call) return false;
+    return !(is_arg_register(r) && iv->blocks_arg_regs);
+}
+
+static bool is_clobbering_call(const Function *f, const Statement *st, const FunctionNames *clobbering) {
+    StringView name = ir_name(f, ir_call(f, st->call.id)->name);
+    for (size_t i = 0; i < clobbering->count; i++) {
+        const StringView *candidate = &clobbering->items[i];
+        if (candidate->count == name.count && strncmp(name.items, candidate->items, name.count) == 0) return true;
+    }
+    return false;
+}
+
+// Number of positions in `ps` (sorted) that are below `p`
+static size_t positions_below(const Positions *ps, uint32_t p) {
+    size_t lo = 0, hi = ps->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (ps->items[mid] < p) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static bool crosses(const Positions *ps, uint32_t start, uint32_t end) {
+    return positions_below(ps, end) > positions_below(ps, start + 1);
+}
+
+static int compare_intervals(const void *a, const void *b) {
+    const Interval *x = a, *y = b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return (x->temp > y->temp) - (x->temp < y->temp);
+}
+
+void regalloc_stack_only(const Function *f, RegAllocation *out, Arena *arena) {
+    *out = (RegAllocation){0};
+    out->regs = arena_alloc(arena, sizeof(*out->regs) * (f->max_temps + 1));
+    out->slots = arena_alloc(arena, sizeof(*out->slots) * (f->max_temps + 1));
+    for (size_t i = 0; i < f->max_temps; i++) {
+        out->regs[i] = REG_NONE;
+        out->slots[i] = i;
+    }
+    out->slot_count = f->max_temps;
+}
+
+// Positions every statement of the reachable blocks in layout order (statement `k` of the layout is at 2k) and
+// computes the live interval of every temp from block liveness
+static void build_intervals(const Function *f, const FunctionNames *clobbering, Interval *intervals, Arena *arena) {
+    const Cfg *cfg = &f->cfg;
+    size_t temps = f->max_temps;
+    size_t words = (temps + WORD_BITS - 1) / WORD_BITS;
+    size_t blocks = cfg->blocks.count;
+    Word *use = bitsets_new(blocks, words, arena);
+    Word *def = bitsets_new(blocks, words, arena);
+    Word *live_in = bitsets_new(blocks, words, arena);
+    Word *live_out = bitsets_new(blocks, words, arena);
+
+    ValueRefs refs = {0};
+    for (size_t i = 0; i < cfg->rpo.count; i++) {
+        BlockId b = cfg->rpo.items[i];
+        const BasicBlock *block = &cfg->blocks.items[b];
+        for (uint32_t j = block->begin; j < block->end; j++) {
+            Statement *st = (Statement *)&f->body.items[j];
+            // only reads through the pointers
+            statement_uses((Function *)f, st, &refs, arena);
+            for (size_t k = 0; k < refs.count; k++) {
+                if (refs.items[k]->type != VT_TEMP) continue;
+                uint32_t t = refs.items[k]->index;
+                if (!bit_get(&def[b * words], t)) bit_set(&use[b * words], t);
+            }
+            Value *d = statement_def(st);
+            if (d != NULL) bit_set(&def[b * words], d->index);
+        }
+    }
+
+    // live_out(b) = union of live_in(s), live_in(b) = use(b) + (live_out(b) - def(b)), until nothing changes
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = cfg->rpo.count; i-- > 0;) {
+            BlockId b = cfg->rpo.items[i];
+            const BasicBlock *block = &cfg->blocks.items[b];
+            Word *out = &live_out[b * words], *in = &live_in[b * words];
+            for (size_t w = 0; w < words; w++) {
+                Word o = 0;
+                for (size_t s = 0; s < block->succs.count; s++) o |= live_in[block->succs.items[s] * words + w];
+                Word n = use[b * words + w] | (o & ~def[b * words + w]);
+                changed |= o != out[w] || n != in[w];
+                out[w] = o;
+                in[w] = n;
+            }
+        }
+    }
+
+    for (size_t t = 0; t < temps; t++) intervals[t] = (Interval){.temp = t, .start = UINT32_MAX, .end = 0};
+#define EXTEND(t, p)                                                                                                   \
+    do {                                                                                                               \
+        if ((p) < intervals[t].start) intervals[t].start = (p);                                                       \
+        if ((p) > intervals[t].end) intervals[t].end = (p);                                                           \
+    } while (0)
+
+    Positions calls = {0};
+    Positions clobbering_calls = {0};
+    uint32_t last_arg_access = 0;
+    bool reads_args = false;
+    uint32_t pos = 0;
+    for (size_t i = 0; i < cfg->rpo.count; i++) {
+        BlockId b = cfg->rpo.items[i];
+        const BasicBlock *block = &cfg->blocks.items[b];
+        uint32_t block_start = pos;
+        for (uint32_t j = block->begin; j < block->end; j++, pos += 2) {
+            Statement *st = (Statement *)&f->body.items[j];
+            statement_uses((Function *)f, st, &refs, arena);
+            for (size_t k = 0; k < refs.count; k++) {
+                if (refs.items[k]->type == VT_TEMP) EXTEND(refs.items[k]->index, pos);
+                if (refs.items[k]->type == VT_ARG) {
+                    reads_args = true;
+                    last_arg_access = pos;
+                }
+            }
+            Value *d = statement_def(st);
+            if (d != NULL) EXTEND(d->index, pos);
+            if (st->type == ST_ASSIGN && st->assign.place.type == VT_ARG) {
+                reads_args = true;
+                last_arg_access = pos;
+            }
+            if (st->type == ST_CALL) {
+                da_push(&calls, pos, arena);
+                if (is_clobbering_call(f, st, clobbering)) {
+                    da_push(&clobbering_calls, pos, arena);
+                }
+            }
+        }
+        uint32_t block_end = pos > block_start ? pos - 1 : pos;
+        for (size_t t = 0; t < temps; t++) {
+            if (bit_get(&live_in[b * words], t)) EXTEND(t, block_start);
+            if (bit_get(&live_out[b * words], t)) EXTEND(t, block_end);
+        }
+    }
+#undef EXTEND
+
+    for (size_t t = 0; t < temps; t++) {
+        Interval *iv = &intervals[t];
+        if (iv->start == UINT32_MAX) continue;
+        iv->crosses_call = crosses(&calls, iv->start, iv->end);
+        iv->crosses_clobbering_call = crosses(&clobbering_calls, iv->start, iv->end);
+        iv->blocks_arg_regs = (reads_args && iv->start <= last_arg_access) ||
+                              positions_below(&calls, iv->end + 1) > positions_below(&calls, iv->start);
+    }
+}
+
+// Stack coloring: the spilled temps go through the slots like the intervals went through the registers, a slot
+// whose last temp died before the next one starts gets reused, which in start order takes as many slots as there
+// are spilled temps live at once
+static void assign_slots(const Interval *intervals, size_t temps, RegAllocation *out, Arena *arena) {
+    // indexed by slot, where the interval of the temp last put there ends
+    uint32_t *slot_end = arena_alloc(arena, sizeof(*slot_end) * (temps + 1));
+    for (size_t i = 0; i < temps && intervals[i].start != UINT32_MAX; i++) {
+        const Interval *cur = &intervals[i];
+        if (out->regs[cur->temp] != REG_NONE) continue;
+        // like a register, a slot isn't free yet at the position its temp is last read
+        size_t slot = 0;
+        while (slot < out->slot_count && slot_end[slot] >= cur->start) slot++;
+        if (slot == out->slot_count) out->slot_count++;
+        slot_end[slot] = cur->end;
+        out->slots[cur->temp] = slot;
+    }
+}
+
+void regalloc_linear_scan(const Function *f, const FunctionNames *clobbering, RegAllocation *out, Arena *arena) {
+    ASSERT(f->cfg.blocks.count > 0, "The allocator works on the CFG");
+    ASSERT(!function_has_asm(f), "Inline asm expects every temp in its stack slot");
+    regalloc_stack_only(f, out, arena);
+    out->slot_count = 0;
+
+    size_t temps = f->max_temps;
+    Interval *intervals = arena_alloc(arena, sizeof(*intervals) * (temps + 1));
+    build_intervals(f, clobbering, intervals, arena);
+    qsort(intervals, temps, sizeof(*intervals), compare_intervals);
+
+    bool used[REG_COUNT] = {0};
+    bool free_regs[REG_COUNT] = {0};
+    for (size_t i = 0; i < sizeof(caller_saved) / sizeof(*caller_saved); i++) free_regs[caller_saved[i]] = true;
+    for (size_t i = 0; i < sizeof(callee_saved) / sizeof(*callee_saved); i++) free_regs[callee_saved[i]] = true;
+    // intervals that currently hold a register, at most one per register
+    const Interval *active[REG_COUNT];
+    size_t active_count = 0;
+
+    for (size_t i = 0; i < temps && intervals[i].start != UINT32_MAX; i++) {
+        const Interval *cur = &intervals[i];
+
+        // an interval that ends where `cur` starts still holds its register, the code generator may read an
+        // operand after it wrote the result
+        size_t kept = 0;
+        for (size_t a = 0; a < active_count; a++) {
+            if (active[a]->end < cur->start) {
+                free_regs[out->regs[active[a]->temp]] = true;
+            } else {
+                active[kept++] = active[a];
+            }
+        }
+        active_count = kept;
+
+        Register chosen = REG_NONE;
+        for (size_t r = 0; chosen == REG_NONE && r < sizeof(caller_saved) / sizeof(*caller_saved); r++) {
+            if (free_regs[caller_saved[r]] && register_allowed(cur, caller_saved[r])) chosen = caller_saved[r];
+        }
+        for (size_t r = 0; chosen == REG_NONE && r < sizeof(callee_saved) / sizeof(*callee_saved); r++) {
+            if (free_regs[callee_saved[r]] && register_allowed(cur, callee_saved[r])) chosen = callee_saved[r];
+        }
+
+        if (chosen == REG_NONE) {
+            // spill whichever interval ends last, `cur` itself if nothing it could take over ends after it
+            size_t victim = active_count;
+            for (size_t a = 0; a < active_count; a++) {
+                if (!register_allowed(cur, out->regs[active[a]->temp])) continue;
+                if (victim == active_count || active[a]->end > active[victim]->end) victim = a;
+            }
+            if (victim == active_count || active[victim]->end <= cur->end) continue;
+            chosen = out->regs[active[victim]->temp];
+            out->regs[active[victim]->temp] = REG_NONE;
+            active[victim] = active[--active_count];
+        }
+
+        out->regs[cur->temp] = chosen;
+        free_regs[chosen] = false;
+        used[chosen] = true;
+        active[active_count++] = cur;
+    }
+
+    for (size_t r = 0; r < sizeof(callee_saved) / sizeof(*callee_saved); r++) {
+        if (used[callee_saved[r]]) out->saved[out->saved_count++] = callee_saved[r];
+    }
+    assign_slots(intervals, temps, out, arena);
+}
@@ -0,0 +1,42 @@
+#ifndef REGALLOC_H_
+#define REGALLOC_H_
+
+#include "../ir/ssa.h"
+#include "x86_64.h"
+#include <stdint.h>
+
+typedef struct {
+    StringView *items;
+    size_t count;
+    size_t capacity;
+} FunctionNames;
+
+// Where every temp of a function lives
+typedef struct {
+    // indexed by temp, REG_NONE if the temp lives in a stack slot
+    uint8_t *regs;
+    // indexed by temp, the stack slot of the temps without a register
+    uint32_t *slots;
+    size_t slot_count;
+    // callee saved registers the function writes, in the order the prologue pushes them
+    Register saved[REG_COUNT];
+    size_t saved_count;
+} RegAllocation;
+
+/*
+ * Puts temp `i` of `f` into stack slot `i` and uses no registers
+ * This is the layout of unoptimized code, and the one inline asm is written against
+ */
+void regalloc_stack_only(const Function *f, RegAllocation *out, Arena *arena);
+
+/*
+ * Linear scan (Poletto and Sarkar) over the body of `f` laid out in reverse postorder, `f->cfg` has to be up to date
+ * Live intervals come from block liveness, so a temp that is live around a loop covers the whole loop
+ * An interval that crosses a call only gets a callee saved register, one that crosses a call to a function in
+ * `clobbering` (which don't follow the ABI, like the ones with inline asm) always lives in a stack slot
+ * rax, rcx and rdx are never handed out, the code generator uses them as scratch registers
+ * Spilled temps whose intervals don't overlap share a stack slot
+ */
+void regalloc_linear_scan(const Function *f, const FunctionNames *clobbering, RegAllocation *out, Arena *arena);
+
+#endif
@@ -0,0 +1,147 @@
+#include "x86_64.h"
+#include "../../util.h"
+
+const char *register_names[REG_COUNT] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+};
+
+static const char *register32_names[REG_COUNT] = {
+    "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d",
+};
+
+static const char *register8_names[REG_COUNT] = {
+    "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b",
+};
+
+static const char *opcode_names[X_COUNT] = {
+    [X_ALIGN] = "align",    [X_MOV] = "mov",        [X_MOVZX] = "movzx",    [X_LEA] = "lea",
+    [X_ADD] = "add",        [X_SUB] = "sub",        [X_IMUL] = "imul",      [X_MUL] = "mul",
+    [X_DIV] = "div",        [X_SHL] = "shl",        [X_SHR] = "shr",        [X_XOR] = "xor",
+    [X_CMP] = "cmp",        [X_TEST] = "test",      [X_SETE] = "sete",      [X_SETNE] = "setne",
+    [X_SETB] = "setb",      [X_SETBE] = "setbe",    [X_SETA] = "seta",      [X_SETAE] = "setae",
+    [X_JMP] = "jmp",        [X_JZ] = "jz",          [X_JE] = "je",          [X_JNE] = "jne",
+    [X_JB] = "jb",          [X_JBE] = "jbe",        [X_JA] = "ja",          [X_JAE] = "jae",
+    [X_CMOVE] = "cmove",    [X_CMOVNE] = "cmovne",  [X_CMOVB] = "cmovb",    [X_CMOVBE] = "cmovbe",
+    [X_CMOVA] = "cmova",    [X_CMOVAE] = "cmovae",  [X_CALL] = "call",      [X_PUSH] = "push",
+    [X_POP] = "pop",        [X_RET] = "ret",
+};
+
+Operand op_reg(Register reg) { return (Operand){.kind = OPK_REG, .reg = reg}; }
+Operand op_reg32(Register reg) { return (Operand){.kind = OPK_REG32, .reg = reg}; }
+Operand op_reg8(Register reg) { return (Operand){.kind = OPK_REG8, .reg = reg}; }
+Operand op_imm(int64_t imm) { return (Operand){.kind = OPK_IMM, .imm = imm}; }
+Operand op_mem(Register base, int32_t disp) { return op_mem_index(base, REG_NONE, 1, disp); }
+Operand op_mem_index(Register base, Register index, uint8_t scale, int32_t disp) {
+    return (Operand){.kind = OPK_MEM, .mem = {.base = base, .index = index, .scale = scale, .disp = disp}};
+}
+Operand op_string(uint32_t index) { return (Operand){.kind = OPK_STRING, .string = index}; }
+Operand op_label(LabelKind kind, uint32_t index) {
+    return (Operand){.kind = OPK_LABEL, .label = {.kind = kind, .index = index}};
+}
+Operand op_function(StringView name) {
+    return (Operand){.kind = OPK_FUNCTION, .count = name.count, .text = name.items};
+}
+Operand op_text(StringView text) { return (Operand){.kind = OPK_TEXT, .count = text.count, .text = text.items}; }
+
+bool operands_equal(const Operand *a, const Operand *b) {
+    if (a->kind != b->kind) return false;
+    switch (a->kind) {
+    case OPK_NONE: return true;
+    case OPK_REG:
+    case OPK_REG32:
+    case OPK_REG8: return a->reg == b->reg;
+    case OPK_IMM: return a->imm == b->imm;
+    case OPK_MEM:
+        return a->mem.base == b->mem.base && a->mem.index == b->mem.index && a->mem.scale == b->mem.scale &&
+               a->mem.disp == b->mem.disp;
+    case OPK_STRING: return a->string == b->string;
+    case OPK_LABEL: return a->label.kind == b->label.kind && a->label.index == b->label.index;
+    case OPK_FUNCTION:
+    case OPK_TEXT:
+        return a->count == b->count && strncmp(a->text, b->text, a->count) == 0;
+    }
+    UNREACHABLE("oh no");
+    return false;
+}
+
+static void print_label(FILE *sink, const Operand *label) {
+    switch (label->label.kind) {
+    case LK_BLOCK: fprintf(sink, ".b%u", label->label.index); break;
+    case LK_IR: fprintf(sink, ".l%u", label->label.index); break;
+    case LK_RETURN: fprintf(sink, "ret%u", label->label.index); break;
+    }
+}
+
+// `lea` takes the address itself, so its memory operand has no size
+static void print_operand(FILE *sink, const Operand *operand, bool sized) {
+    switch (operand->kind) {
+    case OPK_NONE: UNREACHABLE("Missing operand");
+    case OPK_REG: fprintf(sink, "%s", register_names[operand->reg]); break;
+    case OPK_REG32: fprintf(sink, "%s", register32_names[operand->reg]); break;
+    case OPK_REG8: fprintf(sink, "%s", register8_names[operand->reg]); break;
+    case OPK_IMM: fprintf(sink, "%ld", operand->imm); break;
+    case OPK_MEM: {
+        if (sized) fprintf(sink, "qword ");
+        fprintf(sink, "[%s", register_names[operand->mem.base]);
+        if (operand->mem.index != REG_NONE) {
+            fprintf(sink, " + %s * %u", register_names[operand->mem.index], operand->mem.scale);
+        }
+        int32_t disp = operand->mem.disp;
+        if (disp != 0) fprintf(sink, " %c %ld", disp < 0 ? '-' : '+', labs((long)disp));
+        fprintf(sink, "]");
+        break;
+    }
+    case OPK_STRING: fprintf(sink, "str_%u", operand->string); break;
+    case OPK_LABEL: print_label(sink, operand); break;
+    case OPK_FUNCTION:
+    case OPK_TEXT: fprintf(sink, "%.*s", (int)operand->count, operand->text); break;
+    }
+}
+
+void x86_print_instr(FILE *sink, const Instr *instr) {
+    if (instr->comment) fprintf(sink, "; %s\n", instr->comment);
+    switch (instr->op) {
+    case X_LABEL: {
+        if (instr->a.kind == OPK_FUNCTION) {
+            fprintf(sink, "%.*s:\n", (int)instr->a.count, instr->a.text);
+        } else {
+            // block labels are indented like the code, the epilogue isn't
+            if (instr->a.label.kind != LK_RETURN) fprintf(sink, "  ");
+            print_label(sink, &instr->a);
+            fprintf(sink, ":\n");
+        }
+        return;
+    }
+    case X_ASM: fprintf(sink, "%.*s\n", (int)instr->a.count, instr->a.text); return;
+    case X_NOP: return;
+    default: break;
+    }
+
+    ASSERT(instr->op < X_COUNT && opcode_names[instr->op] != NULL, "Invalid opcode %d", instr->op);
+    fprintf(sink, "  %s", opcode_names[instr->op]);
+    if (instr->a.kind != OPK_NONE) {
+        fprintf(sink, " ");
+        print_operand(sink, &instr->a, instr->op != X_LEA);
+    }
+    if (instr->b.kind != OPK_NONE) {
+        fprintf(sink, ", ");
+        print_operand(sink, &instr->b, instr->op != X_LEA);
+    }
+    fprintf(sink, "\n");
+}
+
+DivMagic unsigned_div_magic(uint64_t d) {
+    ASSERT(d > 1 && (d & (d - 1)) != 0, "Powers of two are a plain shift");
+    typedef unsigned __int128 u128;
+    // 2^(l - 1) < d < 2^l
+    uint8_t l = 64 - __builtin_clzll(d);
+
+    // m = ceil(2^(63 + l) / d) is below 2^64, and it's exact enough if m * d - 2^(63 + l) <= 2^(l - 1)
+    u128 p = (u128)1 << (63 + l);
+    u128 m = p / d + (p % d != 0);
+    if (m * d - p <= (u128)1 << (l - 1)) return (DivMagic){.multiplier = (uint64_t)m, .shift = l - 1};
+
+    // otherwise the 65 bit multiplier 2^64 + m' goes in as m' plus the add step
+    u128 m_prime = (((u128)1 << 64) * (((u128)1 << l) - d)) / d + 1;
+    return (DivMagic){.multiplier = (uint64_t)m_prime, .shift = l - 1, .add = true};
+}
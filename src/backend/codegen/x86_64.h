@@ -0,0 +1,190 @@
+#ifndef X86_64_H_
+#define X86_64_H_
+
+#include "../../arena.h"
+#include "../../sv.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// General purpose registers in encoding order
+typedef enum {
+    REG_RAX,
+    REG_RCX,
+    REG_RDX,
+    REG_RBX,
+    REG_RSP,
+    REG_RBP,
+    REG_RSI,
+    REG_RDI,
+    REG_R8,
+    REG_R9,
+    REG_R10,
+    REG_R11,
+    REG_R12,
+    REG_R13,
+    REG_R14,
+    REG_R15,
+    REG_COUNT,
+} Register;
+
+#define REG_NONE REG_COUNT
+
+extern const char *register_names[REG_COUNT];
+
+typedef enum {
+    OPK_NONE,
+    OPK_REG,
+    // the low 32 bits of a register, writing them clears the upper half
+    OPK_REG32,
+    // the low byte of a register
+    OPK_REG8,
+    OPK_IMM,
+    // qword [base + index * scale + disp], index is REG_NONE for plain [base + disp]
+    OPK_MEM,
+    // address of the string literal `str_<index>`
+    OPK_STRING,
+    OPK_LABEL,
+    OPK_FUNCTION,
+    // raw text, inline asm
+    OPK_TEXT,
+} OperandKind;
+
+typedef enum {
+    // `.b<index>:`, a basic block
+    LK_BLOCK,
+    // `.l<index>:`, an IR label (blocks start with one once they are built)
+    LK_IR,
+    // `ret<index>:`, the epilogue of function number `index`
+    LK_RETURN,
+} LabelKind;
+
+// 16 bytes, a function is kept whole until the peephole optimizer is done with it
+// The enums are stored in uint8_t fields for that, `kind` is an OperandKind, registers are Registers
+typedef struct {
+    uint8_t kind;
+    // length of `text`
+    uint32_t count;
+    union {
+        uint8_t reg;
+        int64_t imm;
+        struct {
+            uint8_t base;
+            uint8_t index;
+            uint8_t scale;
+            int32_t disp;
+        } mem;
+        uint32_t string;
+        struct {
+            // LabelKind
+            uint8_t kind;
+            uint32_t index;
+        } label;
+        // the name of an OPK_FUNCTION, the text of an OPK_TEXT, `count` bytes long
+        const char *text;
+    };
+} Operand;
+
+typedef enum {
+    // a label definition, `a` is an OPK_LABEL or OPK_FUNCTION
+    X_LABEL,
+    // inline asm, copied as is
+    X_ASM,
+    // deleted by the peephole optimizer, prints nothing
+    X_NOP,
+    // `align <a>`, pads with nops up to the next multiple of `a` bytes
+    X_ALIGN,
+    X_MOV,
+    X_MOVZX,
+    X_LEA,
+    X_ADD,
+    X_SUB,
+    X_IMUL,
+    // rdx:rax = rax * operand, unsigned
+    X_MUL,
+    X_DIV,
+    X_SHL,
+    X_SHR,
+    X_XOR,
+    X_CMP,
+    X_TEST,
+    X_SETE,
+    X_SETNE,
+    X_SETB,
+    X_SETBE,
+    X_SETA,
+    X_SETAE,
+    X_JMP,
+    X_JZ,
+    // conditional jumps on the flags of an unsigned cmp
+    X_JE,
+    X_JNE,
+    X_JB,
+    X_JBE,
+    X_JA,
+    X_JAE,
+    // `a = b` if the flags of an unsigned cmp say so, `b` is a register or memory
+    X_CMOVE,
+    X_CMOVNE,
+    X_CMOVB,
+    X_CMOVBE,
+    X_CMOVA,
+    X_CMOVAE,
+    X_CALL,
+    X_PUSH,
+    X_POP,
+    X_RET,
+    X_COUNT,
+} Opcode;
+
+typedef struct {
+    // Opcode
+    uint8_t op;
+    Operand a;
+    Operand b;
+    // printed as `; <comment>` above the instruction, even once it is deleted (the IR statement it starts)
+    const char *comment;
+} Instr;
+
+typedef struct {
+    Instr *items;
+    size_t count;
+    size_t capacity;
+} Instrs;
+
+Operand op_reg(Register reg);
+Operand op_reg32(Register reg);
+Operand op_reg8(Register reg);
+Operand op_imm(int64_t imm);
+Operand op_mem(Register base, int32_t disp);
+Operand op_mem_index(Register base, Register index, uint8_t scale, int32_t disp);
+Operand op_string(uint32_t index);
+Operand op_label(LabelKind kind, uint32_t index);
+Operand op_function(StringView name);
+Operand op_text(StringView text);
+
+bool operands_equal(const Operand *a, const Operand *b);
+
+// Writes `instr` as a line of NASM
+void x86_print_instr(FILE *sink, const Instr *instr);
+
+// Constants for dividing an unsigned 64 bit value by a constant with a multiplication (Granlund and Montgomery)
+typedef struct {
+    uint64_t multiplier;
+    uint8_t shift;
+    // without `add`: n / d = mulhi(n, multiplier) >> shift
+    // with `add`:    q = mulhi(n, multiplier), n / d = (((n - q) >> 1) + q) >> shift
+    bool add;
+} DivMagic;
+
+// `d` has to be at least 2 and not a power of two
+DivMagic unsigned_div_magic(uint64_t d);
+
+/*
+ * Rewrites `code` (the body of one function) with local rules over neighbouring instructions until none applies
+ * Labels and inline asm end the window of a rule
+ * Return: true if anything changed
+ */
+bool peephole_optimize(Instrs *code);
+
+#endif
@@ -0,0 +1,237 @@
+#include "cfg.h"
+#include "../../util.h"
+#include <string.h>
+
+bool statement_ends_block(StatementType type) {
+    return type == ST_JZ || !statement_falls_through(type);
+}
+
+bool statement_falls_through(StatementType type) {
+    return type != ST_JMP && type != ST_RETURN && type != ST_RETURN_EMPTY;
+}
+
+bool statement_is_tail_call(const Function *f, size_t i) {
+    const Statement *st = &f->body.items[i];
+    if (st->type != ST_CALL) return false;
+    // falling off the end returns whatever the call left in rax
+    if (i + 1 == f->body.count || f->body.items[i + 1].type == ST_RETURN_EMPTY) return true;
+    const Statement *ret = &f->body.items[i + 1];
+    return ret->type == ST_RETURN && st->call.return_v.type == VT_TEMP && ret->ret.value.type == VT_TEMP &&
+           ret->ret.value.index == st->call.return_v.index;
+}
+
+static void add_edge(Cfg *cfg, BlockId from, BlockId to, Arena *arena) {
+    da_push(&cfg->blocks.items[from].succs, to, arena);
+    da_push(&cfg->blocks.items[to].preds, from, arena);
+}
+
+static BlockId label_block(const Cfg *cfg, IrLabel label) {
+    ASSERT(label < cfg->label_blocks.count && cfg->label_blocks.items[label] != BLOCK_UNREACHABLE,
+           "Jump to a label that isn't in the function");
+    return cfg->label_blocks.items[label];
+}
+
+BlockId cfg_fallthrough(const Function *f, BlockId b) {
+    const BasicBlock *block = &f->cfg.blocks.items[b];
+    if (block->end > block->begin && !statement_falls_through(f->body.items[block->end - 1].type)) {
+        return BLOCK_UNREACHABLE;
+    }
+    return b + 1 < f->cfg.blocks.count ? b + 1 : BLOCK_UNREACHABLE;
+}
+
+IrLabel cfg_block_label(const Function *f, BlockId b) {
+    const BasicBlock *block = &f->cfg.blocks.items[b];
+    ASSERT(block->begin < block->end && f->body.items[block->begin].type == ST_LABEL,
+           "Every block starts with a label while the function is in SSA form");
+    return f->body.items[block->begin].label;
+}
+
+// Iterative DFS, so deep chains of blocks don't recurse
+// Successors are visited last to first, which puts the fall through block right after its predecessor in the RPO
+static void number_blocks(Cfg *cfg, Arena *arena) {
+    size_t count = cfg->blocks.count;
+    for (size_t i = 0; i < count; i++) cfg->blocks.items[i].rpo_index = BLOCK_UNREACHABLE;
+
+    // pairs of a block and how many of its successors were visited already, the postorder goes into `rpo` and
+    // gets reversed in place
+    BlockIds *stack = &cfg->dfs;
+    stack->count = 0;
+    da_push(stack, 0, arena);
+    da_push(stack, 0, arena);
+    // marks blocks as seen until the real numbers are known
+    cfg->blocks.items[0].rpo_index = 0;
+    while (stack->count > 0) {
+        BlockId b = stack->items[stack->count - 2];
+        uint32_t *visited_succs = &stack->items[stack->count - 1];
+        const BasicBlock *block = &cfg->blocks.items[b];
+        if (*visited_succs < block->succs.count) {
+            BlockId s = block->succs.items[block->succs.count - 1 - (*visited_succs)++];
+            if (cfg->blocks.items[s].rpo_index == BLOCK_UNREACHABLE) {
+                cfg->blocks.items[s].rpo_index = 0;
+                da_push(stack, s, arena);
+                da_push(stack, 0, arena);
+            }
+            continue;
+        }
+        stack->count -= 2;
+        da_push(&cfg->rpo, b, arena);
+    }
+
+    for (size_t i = 0, j = cfg->rpo.count; i + 1 < j; i++, j--) {
+        BlockId b = cfg->rpo.items[i];
+        cfg->rpo.items[i] = cfg->rpo.items[j - 1];
+        cfg->rpo.items[j - 1] = b;
+    }
+    for (size_t i = 0; i < cfg->rpo.count; i++) cfg->blocks.items[cfg->rpo.items[i]].rpo_index = i;
+}
+
+// Appends a block starting at statement `begin`, with the edge arrays an earlier build left in its slot
+static void push_block(Cfg *cfg, uint32_t begin, Arena *arena) {
+    if (cfg->blocks.count < cfg->block_slots) {
+        BasicBlock *block = &cfg->blocks.items[cfg->blocks.count++];
+        block->begin = begin;
+        block->preds.count = 0;
+        block->succs.count = 0;
+        block->dom_children.count = 0;
+        return;
+    }
+    BasicBlock block = {.begin = begin};
+    da_push(&cfg->blocks, block, arena);
+    cfg->block_slots = cfg->blocks.count;
+}
+
+void cfg_clear(Cfg *cfg) {
+    cfg->blocks.count = 0;
+    cfg->rpo.count = 0;
+    cfg->label_blocks.count = 0;
+}
+
+void cfg_build(Function *f, Arena *arena) {
+    Cfg *cfg = &f->cfg;
+    cfg_clear(cfg);
+
+    for (uint32_t i = 0; i < f->body.count; i++) {
+        bool leader = i == 0 || f->body.items[i].type == ST_LABEL || statement_ends_block(f->body.items[i - 1].type);
+        if (!leader) continue;
+        if (cfg->blocks.count > 0) cfg->blocks.items[cfg->blocks.count - 1].end = i;
+        push_block(cfg, i, arena);
+    }
+    // the entry block always exists, even for an empty body
+    if (cfg->blocks.count == 0) push_block(cfg, 0, arena);
+    cfg->blocks.items[cfg->blocks.count - 1].end = f->body.count;
+
+    for (size_t i = 0; i < f->label_count; i++) {
+        da_push(&cfg->label_blocks, BLOCK_UNREACHABLE, arena);
+    }
+    for (BlockId b = 0; b < cfg->blocks.count; b++) {
+        const BasicBlock *block = &cfg->blocks.items[b];
+        if (block->begin < block->end && f->body.items[block->begin].type == ST_LABEL) {
+            IrLabel label = f->body.items[block->begin].label;
+            ASSERT(label < f->label_count, "Label out of range");
+            cfg->label_blocks.items[label] = b;
+        }
+    }
+
+    for (BlockId b = 0; b < cfg->blocks.count; b++) {
+        const BasicBlock *block = &cfg->blocks.items[b];
+        BlockId fallthrough = cfg_fallthrough(f, b);
+        if (fallthrough != BLOCK_UNREACHABLE) add_edge(cfg, b, fallthrough, arena);
+        if (block->begin == block->end) continue;
+
+        const Statement *last = &f->body.items[block->end - 1];
+        if (last->type == ST_JMP) add_edge(cfg, b, label_block(cfg, last->jmp), arena);
+        if (last->type == ST_JZ) {
+            ASSERT(fallthrough != BLOCK_UNREACHABLE, "A conditional jump can't be the last statement of a function");
+            BlockId taken = label_block(cfg, last->jz.to);
+            if (taken != fallthrough) add_edge(cfg, b, taken, arena);
+        }
+    }
+
+    number_blocks(cfg, arena);
+}
+
+static BlockId intersect(const Cfg *cfg, BlockId a, BlockId b) {
+    while (a != b) {
+        while (cfg->blocks.items[a].rpo_index > cfg->blocks.items[b].rpo_index) a = cfg->blocks.items[a].idom;
+        while (cfg->blocks.items[b].rpo_index > cfg->blocks.items[a].rpo_index) b = cfg->blocks.items[b].idom;
+    }
+    return a;
+}
+
+void cfg_compute_dominators(Function *f, Arena *arena) {
+    Cfg *cfg = &f->cfg;
+    ASSERT(cfg->rpo.count > 0 && cfg->rpo.items[0] == 0, "The CFG has to be built first");
+    for (size_t i = 0; i < cfg->blocks.count; i++) {
+        cfg->blocks.items[i].idom = BLOCK_UNREACHABLE;
+        cfg->blocks.items[i].dom_children.count = 0;
+    }
+    // the entry is its own dominator while iterating, which stops `intersect` there
+    cfg->blocks.items[0].idom = 0;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < cfg->rpo.count; i++) {
+            BlockId b = cfg->rpo.items[i];
+            const BasicBlock *block = &cfg->blocks.items[b];
+            BlockId idom = BLOCK_UNREACHABLE;
+            for (size_t j = 0; j < block->preds.count; j++) {
+                BlockId p = block->preds.items[j];
+                if (cfg->blocks.items[p].idom == BLOCK_UNREACHABLE) continue;
+                idom = idom == BLOCK_UNREACHABLE ? p : intersect(cfg, p, idom);
+            }
+            if (idom != block->idom) {
+                cfg->blocks.items[b].idom = idom;
+                changed = true;
+            }
+        }
+    }
+
+    cfg->blocks.items[0].idom = BLOCK_UNREACHABLE;
+    for (size_t i = 1; i < cfg->rpo.count; i++) {
+        BlockId b = cfg->rpo.items[i];
+        da_push(&cfg->blocks.items[cfg->blocks.items[b].idom].dom_children, b, arena);
+    }
+}
+
+bool cfg_dominates(const Cfg *cfg, BlockId a, BlockId b) {
+    // every idom comes before its block in reverse postorder, so the walk can stop once it passes `a`, which makes
+    // the test for a forward edge constant time even deep down the dominator tree
+    uint32_t limit = cfg->blocks.items[a].rpo_index;
+    while (b != BLOCK_UNREACHABLE && cfg->blocks.items[b].rpo_index > limit) b = cfg->blocks.items[b].idom;
+    return a == b;
+}
+
+void cfg_natural_loop(const Function *f, BlockId header, BlockIds *out, Arena *arena) {
+    const Cfg *cfg = &f->cfg;
+    out->count = 0;
+    BlockIds work = {0};
+    for (size_t i = 0; i < cfg->blocks.items[header].preds.count; i++) {
+        BlockId p = cfg->blocks.items[header].preds.items[i];
+        if (cfg->blocks.items[p].rpo_index != BLOCK_UNREACHABLE && cfg_dominates(cfg, header, p)) {
+            da_push(&work, p, arena);
+        }
+    }
+    if (work.count == 0) return;
+
+    // walks the predecessors backwards from the back edges, the header stops the walk
+    bool *in_loop = arena_alloc(arena, sizeof(*in_loop) * cfg->blocks.count);
+    memset(in_loop, 0, sizeof(*in_loop) * cfg->blocks.count);
+    in_loop[header] = true;
+    while (work.count > 0) {
+        BlockId b = work.items[--work.count];
+        if (in_loop[b]) continue;
+        in_loop[b] = true;
+        for (size_t i = 0; i < cfg->blocks.items[b].preds.count; i++) {
+            BlockId p = cfg->blocks.items[b].preds.items[i];
+            if (!in_loop[p] && cfg->blocks.items[p].rpo_index != BLOCK_UNREACHABLE) {
+                da_push(&work, p, arena);
+            }
+        }
+    }
+    for (size_t i = 0; i < cfg->rpo.count; i++) {
+        if (in_loop[cfg->rpo.items[i]]) {
+            da_push(out, cfg->rpo.items[i], arena);
+        }
+    }
+}
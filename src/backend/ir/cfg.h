@@ -0,0 +1,43 @@
+#ifndef CFG_H_
+#define CFG_H_
+
+#include "ssa.h"
+
+/*
+ * Splits the body of `f` into basic blocks and fills `f->cfg` (replacing whatever was there)
+ * A block starts at the first statement, at every label and right after every jump or return
+ * A conditional jump to the block it would fall through to anyway gets a single edge
+ */
+void cfg_build(Function *f, Arena *arena);
+// Empties `cfg` to mark it stale, keeping its arrays for the next `cfg_build`
+void cfg_clear(Cfg *cfg);
+
+/*
+ * Fills `idom` and `dom_children` of every block of `f->cfg` (which has to be built)
+ * Uses the iterative algorithm of Cooper, Harvey and Kennedy over the RPO
+ */
+void cfg_compute_dominators(Function *f, Arena *arena);
+// true if every path from the entry to `b` goes through `a` (a block dominates itself)
+bool cfg_dominates(const Cfg *cfg, BlockId a, BlockId b);
+
+/*
+ * The blocks of the natural loop headed by `header`, in reverse postorder (so `header` comes first): every block
+ * that reaches a back edge into `header` without going through `header`
+ * Empty if no block `header` dominates jumps back to it, needs the dominators
+ */
+void cfg_natural_loop(const Function *f, BlockId header, BlockIds *out, Arena *arena);
+
+// true for statements that end a basic block
+bool statement_ends_block(StatementType type);
+// false for statements after which control never reaches the next statement
+bool statement_falls_through(StatementType type);
+// true for a call at `i` whose result (or lack of one) goes straight back to the caller of `f`
+bool statement_is_tail_call(const Function *f, size_t i);
+
+// The label `b` starts with, which every block has while `f` is in SSA form (see `to_ssa`)
+IrLabel cfg_block_label(const Function *f, BlockId b);
+
+// The block control falls into from the bottom of `b`, BLOCK_UNREACHABLE if it jumps away or leaves the function
+BlockId cfg_fallthrough(const Function *f, BlockId b);
+
+#endif
@@ -0,0 +1,453 @@
+#include "../../util.h"
+#include "cfg.h"
+#include "passes.h"
+
+static bool is_const(const Function *f, Value v, ConstValue c) {
+    return v.type == VT_CONST && ir_const_value(f, v) == c;
+}
+
+// false if the operation can't be folded, a division by zero has to trap at runtime
+static bool fold_binop(StatementType type, ConstValue l, ConstValue r, ConstValue *out) {
+    switch (type) {
+    case ST_ADD: *out = l + r; return true;
+    case ST_SUB: *out = l - r; return true;
+    case ST_MUL: *out = l * r; return true;
+    case ST_DIV: {
+        if (r == 0) return false;
+        *out = l / r;
+        return true;
+    }
+    case ST_EQ: *out = l == r; return true;
+    case ST_NE: *out = l != r; return true;
+    case ST_LT: *out = l < r; return true;
+    case ST_LE: *out = l <= r; return true;
+    case ST_GT: *out = l > r; return true;
+    case ST_GE: *out = l >= r; return true;
+    default: return false;
+    }
+}
+
+// The value `st` always produces, like `x + 0` or `x * 0`
+static bool simplify_binop(Function *f, const Statement *st, Value *out, Arena *arena) {
+    Value l = st->binop.l, r = st->binop.r;
+    if (l.type == VT_CONST && r.type == VT_CONST) {
+        ConstValue c = 0;
+        if (!fold_binop(st->type, ir_const_value(f, l), ir_const_value(f, r), &c)) return false;
+        *out = ir_const(f, c, arena);
+        return true;
+    }
+
+    switch (st->type) {
+    case ST_ADD: {
+        if (is_const(f, l, 0)) *out = r;
+        else if (is_const(f, r, 0)) *out = l;
+        else return false;
+        return true;
+    }
+    case ST_SUB: {
+        if (is_const(f, r, 0)) *out = l;
+        else if (ir_values_equal(f, l, r)) *out = ir_const(f, 0, arena);
+        else return false;
+        return true;
+    }
+    case ST_MUL: {
+        if (is_const(f, l, 1)) *out = r;
+        else if (is_const(f, r, 1)) *out = l;
+        else if (is_const(f, l, 0) || is_const(f, r, 0)) *out = ir_const(f, 0, arena);
+        else return false;
+        return true;
+    }
+    case ST_DIV: {
+        if (!is_const(f, r, 1)) return false;
+        *out = l;
+        return true;
+    }
+    case ST_EQ:
+    case ST_LE:
+    case ST_GE: {
+        if (!ir_values_equal(f, l, r)) return false;
+        *out = ir_const(f, 1, arena);
+        return true;
+    }
+    case ST_NE:
+    case ST_LT:
+    case ST_GT: {
+        if (!ir_values_equal(f, l, r)) return false;
+        *out = ir_const(f, 0, arena);
+        return true;
+    }
+    default: return false;
+    }
+}
+
+// The value `select` always takes, the one its constant condition picks or the one both of its values agree on
+static bool select_unique_value(const Function *f, const Statement *select, Value *out) {
+    Value cond = select->select.cond;
+    if (cond.type == VT_CONST) {
+        *out = ir_select_value(f, select, ir_const_value(f, cond) != 0);
+        return true;
+    }
+    Value if_true = ir_select_value(f, select, true), if_false = ir_select_value(f, select, false);
+    if (!ir_values_equal(f, if_true, if_false)) return false;
+    *out = if_true;
+    return true;
+}
+
+// The value every argument of `phi` agrees on (ignoring the phi itself, which loops feed back into it)
+static bool phi_unique_value(const Function *f, const Statement *phi, Value *out) {
+    Value unique = {0};
+    for (size_t i = 0; i < phi->phi.args_count; i++) {
+        Value v = f->phi_args.items[phi->phi.args_begin + i].value;
+        if (v.type == VT_TEMP && v.index == phi->phi.result.index) continue;
+        if (unique.type != VT_NONE && !ir_values_equal(f, unique, v)) return false;
+        unique = v;
+    }
+    *out = unique;
+    return unique.type != VT_NONE;
+}
+
+bool fold_constants(Function *f, Arena *arena) {
+    // what every use of a temp can be replaced with, VT_NONE if it has to stay
+    Value *replacement = arena_alloc(arena, sizeof(*replacement) * (f->max_temps + 1));
+    memset(replacement, 0, sizeof(*replacement) * f->max_temps);
+
+    ValueRefs uses = {0};
+    bool changed_any = false;
+    bool changed = true;
+    // walking in RPO sees definitions before their uses, only values flowing around loops need another round
+    while (changed) {
+        changed = false;
+        for (size_t r = 0; r < f->cfg.rpo.count; r++) {
+            const BasicBlock *block = &f->cfg.blocks.items[f->cfg.rpo.items[r]];
+            for (size_t i = block->begin; i < block->end; i++) {
+                Statement *st = &f->body.items[i];
+                statement_uses(f, st, &uses, arena);
+                for (size_t j = 0; j < uses.count; j++) {
+                    Value *v = uses.items[j];
+                    if (v->type != VT_TEMP || replacement[v->index].type == VT_NONE) continue;
+                    *v = replacement[v->index];
+                    changed = true;
+                }
+
+                Value *def = statement_def(st);
+                if (def == NULL || replacement[def->index].type != VT_NONE) continue;
+                Value value = {0};
+                switch (st->type) {
+                case ST_ASSIGN: value = st->assign.value; break;
+                case ST_PHI: phi_unique_value(f, st, &value); break;
+                case ST_SELECT: {
+                    if (!select_unique_value(f, st, &value)) break;
+                    Value place = st->select.result;
+                    *st = (Statement){.type = ST_ASSIGN, .assign = {.place = place, .value = value}};
+                    changed = true;
+                    break;
+                }
+                case ST_ADD:
+                case ST_SUB:
+                case ST_MUL:
+                case ST_DIV:
+                case ST_EQ:
+                case ST_NE:
+                case ST_LT:
+                case ST_LE:
+                case ST_GT:
+                case ST_GE: {
+                    if (!simplify_binop(f, st, &value, arena)) break;
+                    Value place = st->binop.result;
+                    *st = (Statement){.type = ST_ASSIGN, .assign = {.place = place, .value = value}};
+                    changed = true;
+                    break;
+                }
+                default: break;
+                }
+                if (value.type == VT_NONE || value.type == VT_ARG) continue;
+                replacement[statement_def(st)->index] = value;
+                changed = true;
+            }
+        }
+        changed_any |= changed;
+    }
+    return changed_any;
+}
+
+// Lattice of SCCP, a temp only ever moves down from unknown to constant to varying
+typedef enum {
+    LATTICE_UNKNOWN,
+    LATTICE_CONST,
+    LATTICE_VARYING,
+} LatticeKind;
+
+typedef struct {
+    LatticeKind kind;
+    ConstValue value;
+} LatticeValue;
+
+typedef struct {
+    uint32_t *items;
+    size_t count;
+    size_t capacity;
+} Worklist;
+
+typedef struct {
+    BlockId from;
+    BlockId to;
+} Edge;
+
+typedef struct {
+    Edge *items;
+    size_t count;
+    size_t capacity;
+} Edges;
+
+typedef struct {
+    Function *f;
+    LatticeValue *values;
+    // statements that read each temp, `users[user_begin[t]..user_begin[t + 1])` for temp `t`
+    uint32_t *user_begin;
+    uint32_t *users;
+    uint32_t *block_of;
+    bool *reachable;
+    // executable edges, `edge_base[b] + i` is the edge from the `i`th predecessor of `b`
+    bool *edge_live;
+    uint32_t *edge_base;
+    Edges flow_work;
+    Worklist ssa_work;
+    Arena *arena;
+} Sccp;
+
+static LatticeValue lattice_of(const Sccp *s, Value v) {
+    switch (v.type) {
+    case VT_CONST: return (LatticeValue){.kind = LATTICE_CONST, .value = ir_const_value(s->f, v)};
+    case VT_TEMP: return s->values[v.index];
+    default: return (LatticeValue){.kind = LATTICE_VARYING};
+    }
+}
+
+static LatticeValue lattice_meet(LatticeValue a, LatticeValue b) {
+    if (a.kind == LATTICE_UNKNOWN) return b;
+    if (b.kind == LATTICE_UNKNOWN) return a;
+    if (a.kind == LATTICE_CONST && b.kind == LATTICE_CONST && a.value == b.value) return a;
+    return (LatticeValue){.kind = LATTICE_VARYING};
+}
+
+static uint32_t pred_index(const BasicBlock *block, BlockId pred) {
+    for (uint32_t i = 0; i < block->preds.count; i++) {
+        if (block->preds.items[i] == pred) return i;
+    }
+    UNREACHABLE("Not a predecessor");
+    return 0;
+}
+
+static void sccp_lower(Sccp *s, uint32_t temp, LatticeValue v) {
+    LatticeValue old = s->values[temp];
+    if (old.kind == v.kind && (v.kind != LATTICE_CONST || old.value == v.value)) return;
+    s->values[temp] = v;
+    da_push(&s->ssa_work, temp, s->arena);
+}
+
+static void sccp_mark_edge(Sccp *s, BlockId from, BlockId to) {
+    Edge edge = {.from = from, .to = to};
+    da_push(&s->flow_work, edge, s->arena);
+}
+
+static void sccp_visit(Sccp *s, uint32_t i) {
+    Function *f = s->f;
+    const Statement *st = &f->body.items[i];
+    BlockId b = s->block_of[i];
+    const BasicBlock *block = &f->cfg.blocks.items[b];
+    switch (st->type) {
+    case ST_ASSIGN: sccp_lower(s, st->assign.place.index, lattice_of(s, st->assign.value)); break;
+    case ST_ADD:
+    case ST_SUB:
+    case ST_MUL:
+    case ST_DIV:
+    case ST_EQ:
+    case ST_NE:
+    case ST_LT:
+    case ST_LE:
+    case ST_GT:
+    case ST_GE: {
+        LatticeValue l = lattice_of(s, st->binop.l), r = lattice_of(s, st->binop.r);
+        LatticeValue v = {.kind = LATTICE_VARYING};
+        if (l.kind == LATTICE_UNKNOWN || r.kind == LATTICE_UNKNOWN) {
+            v.kind = LATTICE_UNKNOWN;
+        } else if (l.kind == LATTICE_CONST && r.kind == LATTICE_CONST) {
+            // a division by zero stays varying, it traps at runtime
+            if (fold_binop(st->type, l.value, r.value, &v.value)) v.kind = LATTICE_CONST;
+        }
+        sccp_lower(s, st->binop.result.index, v);
+        break;
+    }
+    case ST_PHI: {
+        LatticeValue v = {.kind = LATTICE_UNKNOWN};
+        for (uint32_t a = 0; a < st->phi.args_count; a++) {
+            const IrPhiArg *arg = &f->phi_args.items[st->phi.args_begin + a];
+            BlockId pred = f->cfg.label_blocks.items[arg->pred];
+            if (!s->edge_live[s->edge_base[b] + pred_index(block, pred)]) continue;
+            v = lattice_meet(v, lattice_of(s, arg->value));
+        }
+        sccp_lower(s, st->phi.result.index, v);
+        break;
+    }
+    case ST_SELECT: {
+        LatticeValue cond = lattice_of(s, st->select.cond);
+        LatticeValue if_true = lattice_of(s, ir_select_value(f, st, true));
+        LatticeValue if_false = lattice_of(s, ir_select_value(f, st, false));
+        LatticeValue v = cond;
+        if (cond.kind == LATTICE_CONST) v = cond.value != 0 ? if_true : if_false;
+        else if (cond.kind == LATTICE_VARYING) v = lattice_meet(if_true, if_false);
+        sccp_lower(s, st->select.result.index, v);
+        break;
+    }
+    case ST_CALL:
+        if (st->call.return_v.type == VT_TEMP) {
+            sccp_lower(s, st->call.return_v.index, (LatticeValue){.kind = LATTICE_VARYING});
+        }
+        break;
+    case ST_JZ: {
+        // a conditional jump has the fall through edge first and the taken one second
+        LatticeValue cond = lattice_of(s, st->jz.cond);
+        if (cond.kind == LATTICE_UNKNOWN) break;
+        if (block->succs.count == 1 || cond.kind == LATTICE_VARYING) {
+            for (size_t k = 0; k < block->succs.count; k++) sccp_mark_edge(s, b, block->succs.items[k]);
+        } else {
+            sccp_mark_edge(s, b, block->succs.items[cond.value == 0 ? 1 : 0]);
+        }
+        break;
+    }
+    default: break;
+    }
+    // every other way out of a block is unconditional
+    if (i + 1 == block->end && st->type != ST_JZ) {
+        for (size_t k = 0; k < block->succs.count; k++) sccp_mark_edge(s, b, block->succs.items[k]);
+    }
+}
+
+bool propagate_conditional_constants(Function *f, Arena *arena) {
+    const Cfg *cfg = &f->cfg;
+    Sccp s = {.f = f, .arena = arena};
+    s.values = arena_alloc(arena, sizeof(*s.values) * (f->max_temps + 1));
+    memset(s.values, 0, sizeof(*s.values) * f->max_temps);
+    s.user_begin = arena_alloc_zeroed(arena, sizeof(*s.user_begin) * (f->max_temps + 1));
+    s.block_of = arena_alloc(arena, sizeof(*s.block_of) * (f->body.count + 1));
+    s.reachable = arena_alloc(arena, sizeof(*s.reachable) * cfg->blocks.count);
+    memset(s.reachable, 0, sizeof(*s.reachable) * cfg->blocks.count);
+    s.edge_base = arena_alloc(arena, sizeof(*s.edge_base) * cfg->blocks.count);
+    bool *defined = arena_alloc(arena, sizeof(*defined) * (f->max_temps + 1));
+    memset(defined, 0, sizeof(*defined) * f->max_temps);
+    uint32_t edges = 0;
+    ValueRefs uses = {0};
+    for (BlockId b = 0; b < cfg->blocks.count; b++) {
+        const BasicBlock *block = &cfg->blocks.items[b];
+        s.edge_base[b] = edges;
+        edges += block->preds.count;
+        for (uint32_t i = block->begin; i < block->end; i++) {
+            s.block_of[i] = b;
+            Value *d = statement_def(&f->body.items[i]);
+            if (d != NULL) defined[d->index] = true;
+            statement_uses(f, &f->body.items[i], &uses, arena);
+            for (size_t k = 0; k < uses.count; k++) {
+                if (uses.items[k]->type == VT_TEMP) s.user_begin[uses.items[k]->index]++;
+            }
+        }
+    }
+    // the counts add up to where the users of every temp end, filling them in backwards moves that to their start
+    for (size_t t = 1; t <= f->max_temps; t++) s.user_begin[t] += s.user_begin[t - 1];
+    s.users = arena_alloc(arena, sizeof(*s.users) * (s.user_begin[f->max_temps] + 1));
+    for (BlockId b = cfg->blocks.count; b-- > 0;) {
+        const BasicBlock *block = &cfg->blocks.items[b];
+        for (uint32_t i = block->end; i-- > block->begin;) {
+            statement_uses(f, &f->body.items[i], &uses, arena);
+            for (size_t k = uses.count; k-- > 0;) {
+                if (uses.items[k]->type == VT_TEMP) s.users[--s.user_begin[uses.items[k]->index]] = i;
+            }
+        }
+    }
+    s.edge_live = arena_alloc(arena, sizeof(*s.edge_live) * (edges + 1));
+    memset(s.edge_live, 0, sizeof(*s.edge_live) * edges);
+    // a temp nothing writes holds garbage, assuming anything about it could pick the wrong way at a branch
+    for (size_t t = 0; t < f->max_temps; t++) {
+        if (!defined[t]) s.values[t].kind = LATTICE_VARYING;
+    }
+
+    // Wegman and Zadeck: a block is only evaluated once an executable edge reaches it, and a temp's users
+    // only again when its value moved down the lattice
+    s.reachable[0] = true;
+    for (uint32_t i = cfg->blocks.items[0].begin; i < cfg->blocks.items[0].end; i++) sccp_visit(&s, i);
+    while (s.flow_work.count > 0 || s.ssa_work.count > 0) {
+        if (s.flow_work.count > 0) {
+            Edge edge = s.flow_work.items[--s.flow_work.count];
+            const BasicBlock *to = &cfg->blocks.items[edge.to];
+            bool *live = &s.edge_live[s.edge_base[edge.to] + pred_index(to, edge.from)];
+            if (*live) continue;
+            *live = true;
+            if (!s.reachable[edge.to]) {
+                s.reachable[edge.to] = true;
+                for (uint32_t i = to->begin; i < to->end; i++) sccp_visit(&s, i);
+            } else {
+                // only the phis can see the new edge
+                for (uint32_t i = to->begin; i < to->end; i++) {
+                    if (f->body.items[i].type == ST_PHI) sccp_visit(&s, i);
+                }
+            }
+            continue;
+        }
+        uint32_t temp = s.ssa_work.items[--s.ssa_work.count];
+        for (uint32_t k = s.user_begin[temp]; k < s.user_begin[temp + 1]; k++) {
+            uint32_t i = s.users[k];
+            if (s.reachable[s.block_of[i]]) sccp_visit(&s, i);
+        }
+    }
+
+    bool changed = false;
+    Value *constant = arena_alloc(arena, sizeof(*constant) * (f->max_temps + 1));
+    memset(constant, 0, sizeof(*constant) * f->max_temps);
+    for (size_t t = 0; t < f->max_temps; t++) {
+        if (s.values[t].kind == LATTICE_CONST) constant[t] = ir_const(f, s.values[t].value, arena);
+    }
+    FunctionBody body = ir_begin_body(f, f->body.count, arena);
+    for (BlockId b = 0; b < cfg->blocks.count; b++) {
+        const BasicBlock *block = &cfg->blocks.items[b];
+        for (uint32_t i = block->begin; i < block->end; i++) {
+            Statement st = f->body.items[i];
+            statement_uses(f, &st, &uses, arena);
+            for (size_t k = 0; k < uses.count; k++) {
+                Value *v = uses.items[k];
+                if (v->type != VT_TEMP || constant[v->index].type == VT_NONE) continue;
+                *v = constant[v->index];
+                changed = true;
+            }
+            // a branch that always goes the same way turns into a jump, or disappears when it never jumps
+            if (st.type == ST_JZ && st.jz.cond.type == VT_CONST && s.reachable[b]) {
+                changed = true;
+                if (ir_const_value(f, st.jz.cond) != 0) continue;
+                st = (Statement){.type = ST_JMP, .jmp = st.jz.to};
+            }
+            da_push(&body, st, arena);
+        }
+    }
+    if (!changed) return false;
+    ir_replace_body(f, body);
+    cfg_build(f, arena);
+
+    // edges that went away with their branch take their phi arguments with them
+    for (BlockId b = 0; b < cfg->blocks.count; b++) {
+        const BasicBlock *block = &cfg->blocks.items[b];
+        for (uint32_t i = block->begin; i < block->end; i++) {
+            Statement *st = &f->body.items[i];
+            if (st->type != ST_PHI) continue;
+            uint32_t kept = 0;
+            for (uint32_t a = 0; a < st->phi.args_count; a++) {
+                IrPhiArg arg = f->phi_args.items[st->phi.args_begin + a];
+                BlockId pred = cfg->label_blocks.items[arg.pred];
+                bool still_pred = false;
+                for (size_t k = 0; k < block->preds.count && !still_pred; k++) {
+                    still_pred = block->preds.items[k] == pred;
+                }
+                if (still_pred) f->phi_args.items[st->phi.args_begin + kept++] = arg;
+            }
+            st->phi.args_count = kept;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,158 @@
+#include "../../util.h"
+#include "cfg.h"
+#include "passes.h"
+
+#define NO_STATEMENT UINT32_MAX
+
+typedef struct {
+    uint32_t *items;
+    size_t count;
+    size_t capacity;
+} Worklist;
+
+static bool has_side_effects(const Function *f, const Statement *st) {
+    switch (st->type) {
+    case ST_RETURN:
+    case ST_RETURN_EMPTY:
+    case ST_CALL:
+    case ST_LABEL:
+    case ST_JZ:
+    case ST_JMP:
+    case ST_ASM: return true;
+    case ST_DIV: return st->binop.r.type != VT_CONST || ir_const_value(f, st->binop.r) == 0;
+    case ST_ADD:
+    case ST_SUB:
+    case ST_MUL:
+    case ST_EQ:
+    case ST_NE:
+    case ST_LT:
+    case ST_LE:
+    case ST_GT:
+    case ST_GE:
+    case ST_ASSIGN:
+    case ST_PHI:
+    case ST_SELECT: return false;
+    }
+    UNREACHABLE("Unknown statement type");
+    return true;
+}
+
+static bool remove_unreachable_blocks(Function *f, Arena *arena) {
+    if (f->cfg.rpo.count == f->cfg.blocks.count) return false;
+
+    bool *dead_label = arena_alloc(arena, sizeof(*dead_label) * (f->label_count + 1));
+    memset(dead_label, 0, sizeof(*dead_label) * f->label_count);
+    for (BlockId b = 0; b < f->cfg.blocks.count; b++) {
+        const BasicBlock *block = &f->cfg.blocks.items[b];
+        if (block->rpo_index != BLOCK_UNREACHABLE) continue;
+        for (size_t i = block->begin; i < block->end; i++) {
+            if (f->body.items[i].type == ST_LABEL) dead_label[f->body.items[i].label] = true;
+        }
+    }
+
+    FunctionBody body = ir_begin_body(f, f->body.count, arena);
+    for (BlockId b = 0; b < f->cfg.blocks.count; b++) {
+        const BasicBlock *block = &f->cfg.blocks.items[b];
+        if (block->rpo_index == BLOCK_UNREACHABLE) continue;
+        for (size_t i = block->begin; i < block->end; i++) {
+            Statement st = f->body.items[i];
+            if (st.type == ST_PHI) {
+                // keep the arguments of the predecessors that are still around, in order
+                uint32_t kept = 0;
+                for (uint32_t k = 0; k < st.phi.args_count; k++) {
+                    IrPhiArg arg = f->phi_args.items[st.phi.args_begin + k];
+                    if (!dead_label[arg.pred]) f->phi_args.items[st.phi.args_begin + kept++] = arg;
+                }
+                st.phi.args_count = kept;
+            }
+            da_push(&body, st, arena);
+        }
+    }
+    ir_replace_body(f, body);
+    cfg_build(f, arena);
+    return true;
+}
+
+bool eliminate_dead_code(Function *f, Arena *arena) {
+    bool changed = remove_unreachable_blocks(f, arena);
+
+    uint32_t *def_of = arena_alloc(arena, sizeof(*def_of) * (f->max_temps + 1));
+    for (size_t i = 0; i < f->max_temps; i++) def_of[i] = NO_STATEMENT;
+    for (size_t i = 0; i < f->body.count; i++) {
+        Value *def = statement_def(&f->body.items[i]);
+        if (def != NULL) def_of[def->index] = i;
+    }
+
+    // mark everything the side effects depend on, starting from the side effects themselves
+    bool *live = arena_alloc(arena, sizeof(*live) * (f->body.count + 1));
+    bool *used = arena_alloc(arena, sizeof(*used) * (f->max_temps + 1));
+    memset(live, 0, sizeof(*live) * f->body.count);
+    memset(used, 0, sizeof(*used) * f->max_temps);
+    Worklist work = {0};
+    for (size_t i = 0; i < f->body.count; i++) {
+        if (!has_side_effects(f, &f->body.items[i])) continue;
+        live[i] = true;
+        da_push(&work, i, arena);
+    }
+    ValueRefs uses = {0};
+    while (work.count > 0) {
+        uint32_t i = work.items[--work.count];
+        statement_uses(f, &f->body.items[i], &uses, arena);
+        for (size_t j = 0; j < uses.count; j++) {
+            if (uses.items[j]->type != VT_TEMP) continue;
+            uint32_t temp = uses.items[j]->index;
+            used[temp] = true;
+            uint32_t def = def_of[temp];
+            if (def == NO_STATEMENT || live[def]) continue;
+            live[def] = true;
+            da_push(&work, def, arena);
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < f->body.count; i++) {
+        if (!live[i]) continue;
+        Statement *st = &f->body.items[i];
+        if (st->type == ST_CALL && st->call.return_v.type == VT_TEMP && !used[st->call.return_v.index]) {
+            st->call.return_v = (Value){0};
+            changed = true;
+        }
+        f->body.items[kept++] = *st;
+    }
+    if (kept == f->body.count) return changed;
+
+    f->body.count = kept;
+    cfg_build(f, arena);
+    return true;
+}
+
+bool remove_unused_labels(Function *f, Arena *arena) {
+    bool changed_any = false;
+    bool *referenced = arena_alloc(arena, sizeof(*referenced) * (f->label_count + 1));
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        memset(referenced, 0, sizeof(*referenced) * f->label_count);
+        for (size_t i = 0; i < f->body.count; i++) {
+            const Statement *st = &f->body.items[i];
+            if (st->type == ST_JMP) referenced[st->jmp] = true;
+            if (st->type == ST_JZ) referenced[st->jz.to] = true;
+        }
+
+        size_t kept = 0;
+        bool reachable = true;
+        for (size_t i = 0; i < f->body.count; i++) {
+            const Statement *st = &f->body.items[i];
+            if (st->type == ST_LABEL && !referenced[st->label]) continue;
+            if (st->type == ST_LABEL) reachable = true;
+            if (!reachable) continue;
+            f->body.items[kept++] = *st;
+            if (!statement_falls_through(st->type)) reachable = false;
+        }
+        changed = kept != f->body.count;
+        f->body.count = kept;
+        changed_any |= changed;
+    }
+    if (changed_any) cfg_clear(&f->cfg);
+    return changed_any;
+}
@@ -0,0 +1,188 @@
+#include "../../util.h"
+#include "cfg.h"
+#include "passes.h"
+
+#define NO_TEMP UINT32_MAX
+#define NO_ENTRY UINT32_MAX
+#define MIN_BUCKETS 16
+
+// An operand as the table sees it, constants by their value since equal constants can sit in different slots
+typedef struct {
+    ValueType type;
+    uint64_t bits;
+} OperandKey;
+
+typedef struct {
+    StatementType op;
+    OperandKey l;
+    OperandKey r;
+    // temp that holds the value
+    uint32_t temp;
+    // entry that was at the head of the bucket before this one
+    uint32_t next;
+} Entry;
+
+typedef struct {
+    Entry *items;
+    size_t count;
+    size_t capacity;
+} Entries;
+
+// Entries live on a stack and every block only pushes, so leaving a block pops its entries off again
+typedef struct {
+    Entries entries;
+    // a power of two with room for every statement of the function, so small functions stay small
+    uint32_t *buckets;
+    uint32_t bucket_mask;
+} ScopedTable;
+
+typedef struct {
+    BlockId block;
+    size_t next_child;
+    size_t mark;
+} Frame;
+
+typedef struct {
+    Frame *items;
+    size_t count;
+    size_t capacity;
+} Frames;
+
+static OperandKey operand_key(const Function *f, Value v) {
+    if (v.type == VT_CONST) return (OperandKey){.type = VT_CONST, .bits = ir_const_value(f, v)};
+    return (OperandKey){.type = v.type, .bits = v.index};
+}
+
+static bool keys_equal(OperandKey a, OperandKey b) { return a.type == b.type && a.bits == b.bits; }
+
+static bool key_less(OperandKey a, OperandKey b) { return a.type != b.type ? a.type < b.type : a.bits < b.bits; }
+
+static bool is_commutative(StatementType op) { return op == ST_ADD || op == ST_MUL || op == ST_EQ || op == ST_NE; }
+
+// Puts the operands in the order every equivalent expression gets, `a > b` is `b < a` and so on
+static void canonicalize(Entry *e) {
+    if (e->op == ST_GT || e->op == ST_GE) {
+        e->op = e->op == ST_GT ? ST_LT : ST_LE;
+        OperandKey t = e->l;
+        e->l = e->r;
+        e->r = t;
+    } else if (is_commutative(e->op) && key_less(e->r, e->l)) {
+        OperandKey t = e->l;
+        e->l = e->r;
+        e->r = t;
+    }
+}
+
+static uint32_t hash_entry(const ScopedTable *table, const Entry *e) {
+    uint64_t h = e->op * 0x9e3779b97f4a7c15ull;
+    h ^= (e->l.bits + e->l.type) * 0xbf58476d1ce4e5b9ull;
+    h = (h << 31) | (h >> 33);
+    h ^= (e->r.bits + e->r.type) * 0x94d049bb133111ebull;
+    return (uint32_t)(h ^ (h >> 29)) & table->bucket_mask;
+}
+
+static uint32_t table_find(const ScopedTable *table, const Entry *key) {
+    for (uint32_t i = table->buckets[hash_entry(table, key)]; i != NO_ENTRY; i = table->entries.items[i].next) {
+        const Entry *e = &table->entries.items[i];
+        if (e->op == key->op && keys_equal(e->l, key->l) && keys_equal(e->r, key->r)) return e->temp;
+    }
+    return NO_TEMP;
+}
+
+static void table_push(ScopedTable *table, Entry e, Arena *arena) {
+    uint32_t bucket = hash_entry(table, &e);
+    e.next = table->buckets[bucket];
+    table->buckets[bucket] = table->entries.count;
+    da_push(&table->entries, e, arena);
+}
+
+static void table_pop_to(ScopedTable *table, size_t mark) {
+    while (table->entries.count > mark) {
+        const Entry *e = &table->entries.items[--table->entries.count];
+        table->buckets[hash_entry(table, e)] = e->next;
+    }
+}
+
+// A division that repeats one further up the dominator tree can't trap any more, the first one already did
+static bool is_numbered(const Statement *st) {
+    switch (st->type) {
+    case ST_ADD:
+    case ST_SUB:
+    case ST_MUL:
+    case ST_DIV:
+    case ST_EQ:
+    case ST_NE:
+    case ST_LT:
+    case ST_LE:
+    case ST_GT:
+    case ST_GE: return true;
+    default: return false;
+    }
+}
+
+static void resolve(const uint32_t *replacement, Value *v) {
+    if (v->type == VT_TEMP && replacement[v->index] != NO_TEMP) v->index = replacement[v->index];
+}
+
+bool eliminate_common_subexpressions(Function *f, Arena *arena) {
+    cfg_compute_dominators(f, arena);
+    const Cfg *cfg = &f->cfg;
+    uint32_t *replacement = arena_alloc(arena, sizeof(*replacement) * (f->max_temps + 1));
+    for (size_t t = 0; t < f->max_temps; t++) replacement[t] = NO_TEMP;
+
+    size_t bucket_count = MIN_BUCKETS;
+    while (bucket_count < f->body.count) bucket_count *= 2;
+    ScopedTable table = {.buckets = arena_alloc(arena, sizeof(*table.buckets) * bucket_count),
+                         .bucket_mask = bucket_count - 1};
+    for (size_t i = 0; i < bucket_count; i++) table.buckets[i] = NO_ENTRY;
+
+    // preorder walk of the dominator tree, the entries of a block are visible in exactly the blocks it dominates
+    bool changed = false;
+    ValueRefs uses = {0};
+    Frames stack = {0};
+    da_push(&stack, ((Frame){.block = 0}), arena);
+    while (stack.count > 0) {
+        Frame *top = &stack.items[stack.count - 1];
+        const BasicBlock *block = &cfg->blocks.items[top->block];
+        if (top->next_child == 0) {
+            top->mark = table.entries.count;
+            for (uint32_t j = block->begin; j < block->end; j++) {
+                Statement *st = &f->body.items[j];
+                // dominating definitions come first, so everything but phi arguments from back edges resolves here
+                statement_uses(f, st, &uses, arena);
+                for (size_t k = 0; k < uses.count; k++) resolve(replacement, uses.items[k]);
+                if (!is_numbered(st)) continue;
+
+                Entry key = {.op = st->type, .l = operand_key(f, st->binop.l), .r = operand_key(f, st->binop.r)};
+                canonicalize(&key);
+                uint32_t earlier = table_find(&table, &key);
+                if (earlier == NO_TEMP) {
+                    key.temp = st->binop.result.index;
+                    table_push(&table, key, arena);
+                    continue;
+                }
+                replacement[st->binop.result.index] = earlier;
+                *st = (Statement){.type = ST_ASSIGN,
+                                  .assign = {.place = st->binop.result, .value = {.type = VT_TEMP, .index = earlier}}};
+                changed = true;
+            }
+        }
+        if (top->next_child < block->dom_children.count) {
+            BlockId child = block->dom_children.items[top->next_child++];
+            da_push(&stack, ((Frame){.block = child}), arena);
+            continue;
+        }
+        table_pop_to(&table, top->mark);
+        stack.count--;
+    }
+    if (!changed) return false;
+
+    for (size_t i = 0; i < f->body.count; i++) {
+        Statement *st = &f->body.items[i];
+        if (st->type != ST_PHI) continue;
+        for (uint32_t a = 0; a < st->phi.args_count; a++) {
+            resolve(replacement, &f->phi_args.items[st->phi.args_begin + a].value);
+        }
+    }
+    return true;
+}
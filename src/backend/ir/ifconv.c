@@ -0,0 +1,279 @@
+#include "../../util.h"
+#include "cfg.h"
+#include "passes.h"
+
+// Rough cycles: a branch on data without a pattern mispredicts about half the time at 15 to 20 cycles each, so
+// running a few statements on both paths and picking the result with a cmov is cheaper, a lot more than that isn't
+// once the branch turns out to be predictable after all
+#define IFCONV_BUDGET 6
+#define SELECT_COST 1
+#define MUL_COST 3
+// a division by a constant is a multiplication by its magic number and a couple of shifts
+#define DIV_COST 4
+
+#define NO_STATEMENT UINT32_MAX
+#define NO_DIAMOND UINT32_MAX
+
+// A block ending in a conditional jump whose two paths meet again right away
+// `arms` holds the block run when the condition is nonzero and the one run when it's zero, BLOCK_UNREACHABLE for
+// the side that goes straight from `head` to `join`
+typedef struct {
+    BlockId head;
+    BlockId arms[2];
+    BlockId join;
+    // the comparison right before the jump that computes its condition, moved after the speculated statements so
+    // it stays next to the selects and the code generator can fuse them into cmp and cmov, NO_STATEMENT for none
+    uint32_t compare;
+} Diamond;
+
+typedef struct {
+    Diamond *items;
+    size_t count;
+    size_t capacity;
+} Diamonds;
+
+// What running `st` costs on the path that didn't need it, -1 if it has an effect or might trap
+static int speculation_cost(const Function *f, const Statement *st) {
+    switch (st->type) {
+    case ST_ADD:
+    case ST_SUB:
+    case ST_EQ:
+    case ST_NE:
+    case ST_LT:
+    case ST_LE:
+    case ST_GT:
+    case ST_GE:
+    case ST_SELECT: return 1;
+    case ST_MUL: return MUL_COST;
+    case ST_DIV: return st->binop.r.type == VT_CONST && ir_const_value(f, st->binop.r) != 0 ? DIV_COST : -1;
+    case ST_ASSIGN: return st->assign.place.type == VT_TEMP ? 1 : -1;
+    default: return -1;
+    }
+}
+
+// The statements of an arm that get speculated, everything but its label and the jump to the join
+static void arm_statements(const Function *f, BlockId arm, uint32_t *begin, uint32_t *end) {
+    const BasicBlock *block = &f->cfg.blocks.items[arm];
+    *begin = block->begin + 1;
+    *end = block->end;
+    if (*end > *begin && f->body.items[*end - 1].type == ST_JMP) (*end)--;
+}
+
+// -1 if `arm` can't run unconditionally
+static int arm_cost(const Function *f, BlockId arm) {
+    if (arm == BLOCK_UNREACHABLE) return 0;
+    uint32_t begin = 0, end = 0;
+    arm_statements(f, arm, &begin, &end);
+    int cost = 0;
+    for (uint32_t i = begin; i < end; i++) {
+        int c = speculation_cost(f, &f->body.items[i]);
+        if (c < 0) return -1;
+        cost += c;
+    }
+    return cost;
+}
+
+// A block only `head` enters and that goes on to a single block
+static bool is_arm(const Function *f, BlockId head, BlockId b) {
+    const BasicBlock *block = &f->cfg.blocks.items[b];
+    return b != 0 && b != head && block->preds.count == 1 && block->succs.count == 1;
+}
+
+static bool reads_temp(Function *f, BlockId arm, TempValueIndex temp, ValueRefs *refs, Arena *arena) {
+    if (arm == BLOCK_UNREACHABLE) return false;
+    uint32_t begin = 0, end = 0;
+    arm_statements(f, arm, &begin, &end);
+    for (uint32_t i = begin; i < end; i++) {
+        statement_uses(f, &f->body.items[i], refs, arena);
+        for (size_t k = 0; k < refs->count; k++) {
+            if (refs->items[k]->type == VT_TEMP && refs->items[k]->index == temp) return true;
+        }
+    }
+    return false;
+}
+
+// The value the phi at `i` takes when control comes from `pred`
+static Value phi_value(const Function *f, uint32_t i, IrLabel pred) {
+    const Statement *phi = &f->body.items[i];
+    for (uint32_t a = 0; a < phi->phi.args_count; a++) {
+        const IrPhiArg *arg = &f->phi_args.items[phi->phi.args_begin + a];
+        if (arg->pred == pred) return arg->value;
+    }
+    UNREACHABLE("Every predecessor has an argument in the phis of its successors");
+    return (Value){0};
+}
+
+// The label control comes from into the join on the `when` side of `d`
+static IrLabel side_label(const Function *f, const Diamond *d, bool when) {
+    BlockId arm = d->arms[when ? 0 : 1];
+    return cfg_block_label(f, arm == BLOCK_UNREACHABLE ? d->head : arm);
+}
+
+// Recognizes the triangle or diamond `head` starts and decides whether converting it pays off
+static bool find_diamond(Function *f, BlockId head, Diamond *out, ValueRefs *refs, Arena *arena) {
+    const Cfg *cfg = &f->cfg;
+    const BasicBlock *h = &cfg->blocks.items[head];
+    if (h->begin == h->end || f->body.items[h->end - 1].type != ST_JZ || h->succs.count != 2) return false;
+    // a conditional jump has the fall through edge (the condition is nonzero) first and the taken one second
+    BlockId taken = h->succs.items[0], skipped = h->succs.items[1];
+    bool arm_t = is_arm(f, head, taken), arm_s = is_arm(f, head, skipped);
+    Diamond d = {.head = head, .arms = {BLOCK_UNREACHABLE, BLOCK_UNREACHABLE}, .compare = NO_STATEMENT};
+    if (arm_t && arm_s && cfg->blocks.items[taken].succs.items[0] == cfg->blocks.items[skipped].succs.items[0]) {
+        d.arms[0] = taken;
+        d.arms[1] = skipped;
+        d.join = cfg->blocks.items[taken].succs.items[0];
+    } else if (arm_t && cfg->blocks.items[taken].succs.items[0] == skipped) {
+        d.arms[0] = taken;
+        d.join = skipped;
+    } else if (arm_s && cfg->blocks.items[skipped].succs.items[0] == taken) {
+        d.arms[1] = skipped;
+        d.join = taken;
+    } else {
+        return false;
+    }
+    const BasicBlock *join = &cfg->blocks.items[d.join];
+    if (d.join == head || join->preds.count != 2) return false;
+
+    int cost = arm_cost(f, d.arms[0]);
+    int other = arm_cost(f, d.arms[1]);
+    if (cost < 0 || other < 0) return false;
+    cost += other;
+    size_t phis = 0;
+    for (uint32_t i = join->begin + 1; i < join->end && f->body.items[i].type == ST_PHI; i++, phis++) {
+        Value a = phi_value(f, i, side_label(f, &d, true)), b = phi_value(f, i, side_label(f, &d, false));
+        if (!ir_values_equal(f, a, b)) cost += SELECT_COST;
+    }
+    // without a phi both paths only compute values nobody reads, dead code elimination takes care of those
+    if (phis == 0 || cost > IFCONV_BUDGET) return false;
+
+    Value cond = f->body.items[h->end - 1].jz.cond;
+    if (h->end - h->begin >= 2 && cond.type == VT_TEMP) {
+        const Statement *prev = &f->body.items[h->end - 2];
+        if (statement_is_comparison(prev->type) && prev->binop.result.index == cond.index &&
+            !reads_temp(f, d.arms[0], cond.index, refs, arena) && !reads_temp(f, d.arms[1], cond.index, refs, arena)) {
+            d.compare = h->end - 2;
+        }
+    }
+    *out = d;
+    return true;
+}
+
+// true if only arms of `d` sit between its head and its join, which then can take the place of the jump
+static bool join_follows_head(const Diamond *d) {
+    for (BlockId b = d->head + 1; b < d->join; b++) {
+        if (b != d->arms[0] && b != d->arms[1]) return false;
+    }
+    return d->join > d->head;
+}
+
+// Rewrites the diamonds of one round, none of them shares a block with another
+static void convert(Function *f, const Diamonds *diamonds, Arena *arena) {
+    const Cfg *cfg = &f->cfg;
+    uint32_t *head_of = arena_alloc(arena, sizeof(*head_of) * (cfg->blocks.count + 1));
+    bool *skip = arena_alloc_zeroed(arena, sizeof(*skip) * cfg->blocks.count);
+    // the selects in the head replace every phi of the join, whose only predecessors were the paths of the diamond
+    bool *is_join = arena_alloc_zeroed(arena, sizeof(*is_join) * cfg->blocks.count);
+    for (BlockId b = 0; b < cfg->blocks.count; b++) head_of[b] = NO_DIAMOND;
+    // relabels the phi arguments of the merged joins' successors
+    IrLabel *merged_into = arena_alloc(arena, sizeof(*merged_into) * (f->label_count + 1));
+    for (IrLabel l = 0; l < f->label_count; l++) merged_into[l] = l;
+    for (size_t i = 0; i < diamonds->count; i++) {
+        const Diamond *d = &diamonds->items[i];
+        head_of[d->head] = i;
+        is_join[d->join] = true;
+        for (size_t k = 0; k < 2; k++) {
+            if (d->arms[k] != BLOCK_UNREACHABLE) skip[d->arms[k]] = true;
+        }
+        if (join_follows_head(d)) {
+            skip[d->join] = true;
+            merged_into[cfg_block_label(f, d->join)] = cfg_block_label(f, d->head);
+        }
+    }
+
+    FunctionBody body = ir_begin_body(f, f->body.count, arena);
+    for (BlockId b = 0; b < cfg->blocks.count; b++) {
+        if (skip[b]) continue;
+        const BasicBlock *block = &cfg->blocks.items[b];
+        if (head_of[b] == NO_DIAMOND) {
+            for (uint32_t i = block->begin; i < block->end; i++) {
+                if (is_join[b] && f->body.items[i].type == ST_PHI) continue;
+                da_push(&body, f->body.items[i], arena);
+            }
+            continue;
+        }
+
+        const Diamond *d = &diamonds->items[head_of[b]];
+        for (uint32_t i = block->begin; i + 1 < block->end; i++) {
+            if (i != d->compare) {
+                da_push(&body, f->body.items[i], arena);
+            }
+        }
+        for (size_t k = 0; k < 2; k++) {
+            if (d->arms[k] == BLOCK_UNREACHABLE) continue;
+            uint32_t begin = 0, end = 0;
+            arm_statements(f, d->arms[k], &begin, &end);
+            for (uint32_t i = begin; i < end; i++) {
+                da_push(&body, f->body.items[i], arena);
+            }
+        }
+        if (d->compare != NO_STATEMENT) {
+            da_push(&body, f->body.items[d->compare], arena);
+        }
+
+        Value cond = f->body.items[block->end - 1].jz.cond;
+        const BasicBlock *join = &cfg->blocks.items[d->join];
+        uint32_t i = join->begin + 1;
+        for (; i < join->end && f->body.items[i].type == ST_PHI; i++) {
+            Value result = f->body.items[i].phi.result;
+            Value a = phi_value(f, i, side_label(f, d, true)), b = phi_value(f, i, side_label(f, d, false));
+            Statement st = {.type = ST_ASSIGN, .assign = {.place = result, .value = a}};
+            if (!ir_values_equal(f, a, b)) st = ir_select(f, result, cond, a, b, arena);
+            da_push(&body, st, arena);
+        }
+        if (!skip[d->join]) {
+            da_push(&body, ((Statement){.type = ST_JMP, .jmp = cfg_block_label(f, d->join)}), arena);
+            continue;
+        }
+        // the join is right below, so the rest of it continues the head
+        for (; i < join->end; i++) {
+            da_push(&body, f->body.items[i], arena);
+        }
+    }
+
+    for (size_t i = 0; i < body.count; i++) {
+        const Statement *st = &body.items[i];
+        if (st->type != ST_PHI) continue;
+        for (uint32_t a = 0; a < st->phi.args_count; a++) {
+            IrPhiArg *arg = &f->phi_args.items[st->phi.args_begin + a];
+            arg->pred = merged_into[arg->pred];
+        }
+    }
+    ir_replace_body(f, body);
+}
+
+bool convert_ifs_to_selects(Function *f, Arena *arena) {
+    bool changed = false;
+    ValueRefs refs = {0};
+    // a converted diamond can be an arm of the one around it, which the next round picks up
+    while (true) {
+        const Cfg *cfg = &f->cfg;
+        bool *claimed = arena_alloc_zeroed(arena, sizeof(*claimed) * cfg->blocks.count);
+        Diamonds diamonds = {0};
+        for (size_t r = 0; r < cfg->rpo.count; r++) {
+            Diamond d = {0};
+            if (!find_diamond(f, cfg->rpo.items[r], &d, &refs, arena)) continue;
+            BlockId blocks[] = {d.head, d.arms[0], d.arms[1], d.join};
+            bool disjoint = true;
+            for (size_t k = 0; k < 4; k++) disjoint &= blocks[k] == BLOCK_UNREACHABLE || !claimed[blocks[k]];
+            if (!disjoint) continue;
+            for (size_t k = 0; k < 4; k++) {
+                if (blocks[k] != BLOCK_UNREACHABLE) claimed[blocks[k]] = true;
+            }
+            da_push(&diamonds, d, arena);
+        }
+        if (diamonds.count == 0) return changed;
+        convert(f, &diamonds, arena);
+        cfg_build(f, arena);
+        changed = true;
+    }
+}
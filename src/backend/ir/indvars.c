@@ -0,0 +1,437 @@
+#include "../../util.h"
+#include "cfg.h"
+#include "passes.h"
+#include <stdlib.h>
+
+#define NO_IV UINT32_MAX
+
+// A phi of the loop header that starts at `init` and gets `step` added on every trip around the loop
+typedef struct {
+    Value value;
+    Value init;
+    Value step;
+    // the value from the latch, and the statement that computes it as `value + step`
+    Value next;
+    uint32_t next_def;
+    // multiplications of `value` that get replaced
+    uint32_t scaled;
+} BasicIv;
+
+typedef struct {
+    BasicIv *items;
+    size_t count;
+    size_t capacity;
+} BasicIvs;
+
+// `value * scale + offset` of a basic induction variable, computed by the statement at `statement`
+// It becomes a phi of its own that starts at `init * scale + offset` and goes up by `step * scale`
+typedef struct {
+    uint32_t statement;
+    uint32_t iv;
+    Value scale;
+    // VT_NONE for just the product
+    Value offset;
+    Value phi;
+    Value next;
+} DerivedIv;
+
+typedef struct {
+    DerivedIv *items;
+    size_t count;
+    size_t capacity;
+} DerivedIvs;
+
+// A statement that goes in right after the one at `after`
+typedef struct {
+    uint32_t after;
+    Statement st;
+} Insertion;
+
+typedef struct {
+    Insertion *items;
+    size_t count;
+    size_t capacity;
+} Insertions;
+
+// What `reduce_loop` needs for every loop, kept from one loop to the next since the arena never frees
+typedef struct {
+    BlockIds loop;
+    ValueRefs uses;
+    // how many blocks and temps the arrays below have room for
+    size_t blocks;
+    size_t temps;
+    bool *in_loop;
+    BlockId *def_block;
+    uint32_t *def_statement;
+    uint32_t *use_count;
+} LoopScratch;
+
+typedef struct {
+    Function *f;
+    const BlockIds *loop;
+    bool *in_loop;
+    // indexed by temp, the block of the statement that writes it (BLOCK_UNREACHABLE for none)
+    BlockId *def_block;
+    uint32_t *def_statement;
+    // indexed by temp, how many statements and phi arguments read it
+    uint32_t *use_count;
+    BasicIvs ivs;
+    DerivedIvs derived;
+    FunctionBody preheader;
+    Insertions insertions;
+    Arena *arena;
+} LoopInfo;
+
+static bool is_invariant(const LoopInfo *info, Value v) {
+    if (v.type == VT_CONST || v.type == VT_ARG) return true;
+    if (v.type != VT_TEMP) return false;
+    BlockId b = info->def_block[v.index];
+    return b == BLOCK_UNREACHABLE || !info->in_loop[b];
+}
+
+static uint32_t find_iv(const LoopInfo *info, Value v) {
+    for (uint32_t i = 0; i < info->ivs.count; i++) {
+        if (ir_values_equal(info->f, info->ivs.items[i].value, v)) return i;
+    }
+    return NO_IV;
+}
+
+static Value push_preheader_binop(LoopInfo *info, StatementType type, Value l, Value r) {
+    return ir_push_binop(&info->preheader, type, l, r, ir_new_temp(info->f), info->arena);
+}
+
+// `v * d->scale + d->offset`, computed in the preheader
+static Value push_scaled(LoopInfo *info, const DerivedIv *d, Value v) {
+    Value scaled = push_preheader_binop(info, ST_MUL, v, d->scale);
+    if (d->offset.type == VT_NONE) return scaled;
+    return push_preheader_binop(info, ST_ADD, scaled, d->offset);
+}
+
+// `next <- value + step` (or `value - c`) with an invariant step
+static bool match_step(LoopInfo *info, const Statement *st, Value value, Value *step) {
+    if (st->type == ST_ADD && ir_values_equal(info->f, st->binop.l, value) && is_invariant(info, st->binop.r)) {
+        *step = st->binop.r;
+        return true;
+    }
+    if (st->type == ST_ADD && ir_values_equal(info->f, st->binop.r, value) && is_invariant(info, st->binop.l)) {
+        *step = st->binop.l;
+        return true;
+    }
+    if (st->type == ST_SUB && ir_values_equal(info->f, st->binop.l, value) && st->binop.r.type == VT_CONST) {
+        *step = ir_const(info->f, -ir_const_value(info->f, st->binop.r), info->arena);
+        return true;
+    }
+    return false;
+}
+
+static void find_basic_ivs(LoopInfo *info, BlockId header, BlockId entering, BlockId latch) {
+    Function *f = info->f;
+    const BasicBlock *h = &f->cfg.blocks.items[header];
+    IrLabel entering_label = cfg_block_label(f, entering);
+    for (uint32_t j = h->begin + 1; j < h->end && f->body.items[j].type == ST_PHI; j++) {
+        const Statement *phi = &f->body.items[j];
+        if (phi->phi.args_count != 2) continue;
+        const IrPhiArg *args = &f->phi_args.items[phi->phi.args_begin];
+        Value init = args[0].pred == entering_label ? args[0].value : args[1].value;
+        Value next = args[0].pred == entering_label ? args[1].value : args[0].value;
+        if (next.type != VT_TEMP || is_invariant(info, next)) continue;
+        uint32_t def = info->def_statement[next.index];
+        BasicIv iv = {.value = phi->phi.result, .init = init, .next = next, .next_def = def};
+        if (!match_step(info, &f->body.items[def], iv.value, &iv.step)) continue;
+        // the increment runs on every trip, so its block dominates the latch
+        if (!cfg_dominates(&f->cfg, info->def_block[next.index], latch)) continue;
+        da_push(&info->ivs, iv, info->arena);
+    }
+}
+
+// Multiplications of a basic induction variable by an invariant, and invariants added to those
+static void find_derived_ivs(LoopInfo *info) {
+    Function *f = info->f;
+    uint32_t *product_of = arena_alloc(info->arena, sizeof(*product_of) * (f->max_temps + 1));
+    for (size_t t = 0; t < f->max_temps; t++) product_of[t] = UINT32_MAX;
+    for (size_t i = 0; i < info->loop->count; i++) {
+        const BasicBlock *block = &f->cfg.blocks.items[info->loop->items[i]];
+        for (uint32_t j = block->begin; j < block->end; j++) {
+            const Statement *st = &f->body.items[j];
+            if (st->type != ST_MUL && st->type != ST_ADD) continue;
+            Value l = st->binop.l, r = st->binop.r;
+            DerivedIv d = {.statement = j};
+            if (st->type == ST_MUL) {
+                if (find_iv(info, r) != NO_IV && is_invariant(info, l)) {
+                    Value t = l;
+                    l = r;
+                    r = t;
+                }
+                d.iv = find_iv(info, l);
+                if (d.iv == NO_IV || !is_invariant(info, r)) continue;
+                d.scale = r;
+                info->ivs.items[d.iv].scaled++;
+                product_of[st->binop.result.index] = info->derived.count;
+            } else {
+                if (r.type == VT_TEMP && product_of[r.index] != UINT32_MAX && is_invariant(info, l)) {
+                    Value t = l;
+                    l = r;
+                    r = t;
+                }
+                if (l.type != VT_TEMP || product_of[l.index] == UINT32_MAX || !is_invariant(info, r)) continue;
+                const DerivedIv *product = &info->derived.items[product_of[l.index]];
+                d.iv = product->iv;
+                d.scale = product->scale;
+                d.offset = r;
+            }
+            da_push(&info->derived, d, info->arena);
+        }
+    }
+}
+
+static bool fits(unsigned __int128 v) { return v <= UINT64_MAX; }
+
+// Whether comparing `d` instead of `iv` in `cmp` (which has the next value of `iv` on the left and `limit` on
+// the right, continuing the loop while it's false) gives the same answer on every trip
+// Equality only needs the scaling to lose nothing: multiplying by an odd number is a bijection modulo 2^64
+// An ordering needs everything to be constant, the scaled values must not wrap around
+static bool preserves_test(const LoopInfo *info, const BasicIv *iv, const DerivedIv *d, StatementType op, Value limit) {
+    const Function *f = info->f;
+    if (d->scale.type != VT_CONST) return false;
+    ConstValue scale = ir_const_value(f, d->scale);
+    if (op == ST_EQ || op == ST_NE) return scale % 2 == 1;
+    if (op != ST_GE && op != ST_GT) return false;
+    if (iv->init.type != VT_CONST || iv->step.type != VT_CONST || limit.type != VT_CONST) return false;
+    if (d->offset.type != VT_NONE && d->offset.type != VT_CONST) return false;
+    ConstValue step = ir_const_value(f, iv->step);
+    if (step == 0 || step > UINT32_MAX) return false;
+    // the loop goes on while the next value stays below the limit (or reaches it), so it never gets past
+    // max(init, limit) + step
+    ConstValue init = ir_const_value(f, iv->init), l = ir_const_value(f, limit);
+    unsigned __int128 top = (unsigned __int128)(init > l ? init : l) + step;
+    ConstValue offset = d->offset.type == VT_CONST ? ir_const_value(f, d->offset) : 0;
+    return fits(top * scale + offset);
+}
+
+// Linear function test replacement: once the only things reading `iv` are its own increment and the exit test,
+// the test can read a derived induction variable instead and `iv` is left for `eliminate_dead_code`
+// Return: the comparison to rewrite and the derived variable it should read, or false
+static bool find_test_replacement(const LoopInfo *info, const BasicIv *iv, BlockId header, uint32_t *cmp,
+                                  uint32_t *derived) {
+    Function *f = info->f;
+    if (info->use_count[iv->value.index] != 1 + iv->scaled || info->use_count[iv->next.index] != 2) return false;
+    uint32_t test = UINT32_MAX;
+    for (size_t i = 0; i < info->loop->count && test == UINT32_MAX; i++) {
+        const BasicBlock *block = &f->cfg.blocks.items[info->loop->items[i]];
+        for (uint32_t j = block->begin; j < block->end; j++) {
+            const Statement *st = &f->body.items[j];
+            if (!statement_is_comparison(st->type)) continue;
+            if (ir_values_equal(f, st->binop.l, iv->next) || ir_values_equal(f, st->binop.r, iv->next)) test = j;
+        }
+    }
+    if (test == UINT32_MAX) return false;
+    const Statement *st = &f->body.items[test];
+    bool left = ir_values_equal(f, st->binop.l, iv->next);
+    Value limit = left ? st->binop.r : st->binop.l;
+    if (!is_invariant(info, limit)) return false;
+    StatementType op = st->type;
+    if (!left) {
+        switch (op) {
+        case ST_LT: op = ST_GT; break;
+        case ST_LE: op = ST_GE; break;
+        case ST_GT: op = ST_LT; break;
+        case ST_GE: op = ST_LE; break;
+        default: break;
+        }
+    }
+    // an ordering has to be the bottom test of a rotated loop, which jumps back to the header while it's false
+    if (op != ST_EQ && op != ST_NE) {
+        if (info->use_count[st->binop.result.index] != 1) return false;
+        const BasicBlock *block = &f->cfg.blocks.items[info->def_block[st->binop.result.index]];
+        const Statement *jz = &f->body.items[block->end - 1];
+        if (jz->type != ST_JZ || !ir_values_equal(f, jz->jz.cond, st->binop.result) ||
+            jz->jz.to != cfg_block_label(f, header)) {
+            return false;
+        }
+    }
+
+    for (uint32_t k = 0; k < info->derived.count; k++) {
+        const DerivedIv *d = &info->derived.items[k];
+        if (&info->ivs.items[d->iv] != iv || !preserves_test(info, iv, d, op, limit)) continue;
+        *cmp = test;
+        *derived = k;
+        return true;
+    }
+    return false;
+}
+
+static int compare_insertions(const void *a, const void *b) {
+    const Insertion *x = a, *y = b;
+    return (x->after > y->after) - (x->after < y->after);
+}
+
+// Makes room for the blocks and temps `f` has now, with some to spare for the ones the next loops add
+static void grow_scratch(LoopScratch *s, const Function *f, Arena *arena) {
+    if (s->blocks < f->cfg.blocks.count) {
+        s->blocks = f->cfg.blocks.count * 3 / 2;
+        s->in_loop = arena_alloc(arena, sizeof(*s->in_loop) * s->blocks);
+    }
+    if (s->temps < f->max_temps) {
+        s->temps = f->max_temps * 3 / 2;
+        s->def_block = arena_alloc(arena, sizeof(*s->def_block) * s->temps);
+        s->def_statement = arena_alloc(arena, sizeof(*s->def_statement) * s->temps);
+        s->use_count = arena_alloc(arena, sizeof(*s->use_count) * s->temps);
+    }
+}
+
+// Return: true if it changed anything, the CFG is stale then
+static bool reduce_loop(Function *f, BlockId header, LoopScratch *scratch, Arena *arena) {
+    const Cfg *cfg = &f->cfg;
+    BlockIds *loop = &scratch->loop;
+    cfg_natural_loop(f, header, loop, arena);
+    if (loop->count == 0) return false;
+    grow_scratch(scratch, f, arena);
+    LoopInfo info = {.f = f, .loop = loop, .in_loop = scratch->in_loop, .arena = arena};
+    memset(info.in_loop, 0, sizeof(*info.in_loop) * cfg->blocks.count);
+    for (size_t i = 0; i < loop->count; i++) info.in_loop[loop->items[i]] = true;
+
+    // the new phis get one value from outside and one from the latch
+    const BasicBlock *h = &cfg->blocks.items[header];
+    if (h->preds.count != 2) return false;
+    BlockId entering = h->preds.items[0], latch = h->preds.items[1];
+    if (info.in_loop[entering]) {
+        entering = h->preds.items[1];
+        latch = h->preds.items[0];
+    }
+    if (info.in_loop[entering] || !info.in_loop[latch]) return false;
+    // a loop block that falls into the header would fall into the preheader instead
+    if (header > 0 && info.in_loop[header - 1] && cfg_fallthrough(f, header - 1) == header) return false;
+
+    info.def_block = scratch->def_block;
+    info.def_statement = scratch->def_statement;
+    info.use_count = scratch->use_count;
+    for (size_t t = 0; t < f->max_temps; t++) info.def_block[t] = BLOCK_UNREACHABLE;
+    memset(info.use_count, 0, sizeof(*info.use_count) * f->max_temps);
+    ValueRefs *uses = &scratch->uses;
+    for (BlockId b = 0; b < cfg->blocks.count; b++) {
+        const BasicBlock *block = &cfg->blocks.items[b];
+        for (uint32_t j = block->begin; j < block->end; j++) {
+            Statement *st = &f->body.items[j];
+            Value *d = statement_def(st);
+            if (d != NULL) {
+                info.def_block[d->index] = b;
+                info.def_statement[d->index] = j;
+            }
+            statement_uses(f, st, uses, arena);
+            for (size_t k = 0; k < uses->count; k++) {
+                if (uses->items[k]->type == VT_TEMP) info.use_count[uses->items[k]->index]++;
+            }
+        }
+    }
+
+    find_basic_ivs(&info, header, entering, latch);
+    if (info.ivs.count == 0) return false;
+    find_derived_ivs(&info);
+    if (info.derived.count == 0) return false;
+
+    IrLabel preheader = f->label_count++;
+    IrLabel header_label = cfg_block_label(f, header);
+    IrLabel entering_label = cfg_block_label(f, entering);
+    IrLabel latch_label = cfg_block_label(f, latch);
+    FunctionBody phis = {0};
+    for (size_t k = 0; k < info.derived.count; k++) {
+        DerivedIv *d = &info.derived.items[k];
+        const BasicIv *iv = &info.ivs.items[d->iv];
+        Value start = push_scaled(&info, d, iv->init);
+        Value stride = push_preheader_binop(&info, ST_MUL, iv->step, d->scale);
+        d->phi = ir_new_temp(f);
+        d->next = ir_new_temp(f);
+        Statement phi = {.type = ST_PHI,
+                         .phi = {.result = d->phi, .args_begin = f->phi_args.count, .args_count = 2}};
+        da_push(&f->phi_args, ((IrPhiArg){.pred = preheader, .value = start}), arena);
+        da_push(&f->phi_args, ((IrPhiArg){.pred = latch_label, .value = d->next}), arena);
+        da_push(&phis, phi, arena);
+        Insertion step = {.after = iv->next_def,
+                          .st = {.type = ST_ADD, .binop = {.l = d->phi, .r = stride, .result = d->next}}};
+        da_push(&info.insertions, step, arena);
+    }
+
+    // the tests move over to derived variables before the statements those were computed by become copies
+    for (size_t i = 0; i < info.ivs.count; i++) {
+        uint32_t cmp = 0, k = 0;
+        if (!find_test_replacement(&info, &info.ivs.items[i], header, &cmp, &k)) continue;
+        const DerivedIv *d = &info.derived.items[k];
+        Statement *st = &f->body.items[cmp];
+        bool left = ir_values_equal(f, st->binop.l, info.ivs.items[i].next);
+        Value *limit = left ? &st->binop.r : &st->binop.l;
+        *limit = push_scaled(&info, d, *limit);
+        *(left ? &st->binop.l : &st->binop.r) = d->next;
+    }
+    for (size_t k = 0; k < info.derived.count; k++) {
+        const DerivedIv *d = &info.derived.items[k];
+        Statement *st = &f->body.items[d->statement];
+        *st = (Statement){.type = ST_ASSIGN, .assign = {.place = st->binop.result, .value = d->phi}};
+    }
+
+    // the phis of the header get their entry values from the preheader now
+    for (uint32_t j = h->begin; j < h->end; j++) {
+        const Statement *st = &f->body.items[j];
+        if (st->type != ST_PHI) continue;
+        for (uint32_t a = 0; a < st->phi.args_count; a++) {
+            IrPhiArg *arg = &f->phi_args.items[st->phi.args_begin + a];
+            if (arg->pred == entering_label) arg->pred = preheader;
+        }
+    }
+
+    qsort(info.insertions.items, info.insertions.count, sizeof(*info.insertions.items), compare_insertions);
+    size_t next_insertion = 0;
+    size_t size = f->body.count + 1 + info.preheader.count + phis.count + info.insertions.count;
+    FunctionBody body = ir_begin_body(f, size, arena);
+    for (uint32_t i = 0; i < f->body.count; i++) {
+        Statement st = f->body.items[i];
+        if (i == h->begin) {
+            Statement label = {.type = ST_LABEL, .label = preheader};
+            da_push(&body, label, arena);
+            for (size_t k = 0; k < info.preheader.count; k++) {
+                da_push(&body, info.preheader.items[k], arena);
+            }
+        }
+        if (i == cfg->blocks.items[entering].end - 1) {
+            if (st.type == ST_JMP && st.jmp == header_label) st.jmp = preheader;
+            if (st.type == ST_JZ && st.jz.to == header_label) st.jz.to = preheader;
+        }
+        da_push(&body, st, arena);
+        if (i == h->begin) {
+            for (size_t k = 0; k < phis.count; k++) {
+                da_push(&body, phis.items[k], arena);
+            }
+        }
+        while (next_insertion < info.insertions.count && info.insertions.items[next_insertion].after == i) {
+            da_push(&body, info.insertions.items[next_insertion++].st, arena);
+        }
+    }
+    ir_replace_body(f, body);
+    return true;
+}
+
+bool reduce_induction_variables(Function *f, Arena *arena) {
+    // innermost loops first, like `hoist_loop_invariants`, an outer loop then sees what the inner one hoisted
+    cfg_compute_dominators(f, arena);
+    BlockIds headers = {0};
+    const Cfg *cfg = &f->cfg;
+    for (size_t i = 0; i < cfg->rpo.count; i++) {
+        BlockId b = cfg->rpo.items[i];
+        const BasicBlock *block = &cfg->blocks.items[b];
+        for (size_t j = 0; j < block->preds.count; j++) {
+            if (cfg_dominates(cfg, b, block->preds.items[j])) {
+                da_push(&headers, cfg_block_label(f, b), arena);
+                break;
+            }
+        }
+    }
+
+    bool changed = false;
+    LoopScratch scratch = {0};
+    for (size_t i = headers.count; i-- > 0;) {
+        if (!reduce_loop(f, f->cfg.label_blocks.items[headers.items[i]], &scratch, arena)) continue;
+        changed = true;
+        cfg_build(f, arena);
+        cfg_compute_dominators(f, arena);
+    }
+    return changed;
+}
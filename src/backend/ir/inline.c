@@ -0,0 +1,208 @@
+#include "../../util.h"
+#include "cfg.h"
+#include "passes.h"
+#include <stdlib.h>
+
+// A callee this small is always inlined, the call sequence alone is about as big
+#define INLINE_SMALL_STATEMENTS 24
+// A callee called from a single place is inlined up to this size, the copy is the only one
+#define INLINE_SINGLE_CALL_STATEMENTS 200
+// Callers stop growing past this many statements
+#define INLINE_CALLER_STATEMENTS 2000
+
+typedef struct {
+    StringView name;
+    uint32_t function;
+    // call sites in the whole module
+    uint32_t calls;
+} Callee;
+
+static int compare_names(StringView a, StringView b) {
+    size_t n = a.count < b.count ? a.count : b.count;
+    int c = strncmp(a.items, b.items, n);
+    if (c != 0) return c;
+    return (a.count > b.count) - (a.count < b.count);
+}
+
+static int compare_callees(const void *a, const void *b) {
+    const Callee *x = a, *y = b;
+    return compare_names(x->name, y->name);
+}
+
+static Callee *find_callee(Callee *callees, size_t count, StringView name) {
+    Callee key = {.name = name};
+    return bsearch(&key, callees, count, sizeof(*callees), compare_callees);
+}
+
+typedef struct {
+    Function *caller;
+    const Function *callee;
+    // where the callee's temps, arguments and labels start in the caller
+    uint32_t temp_base;
+    uint32_t arg_base;
+    IrLabel label_base;
+    IrLabel cont;
+    Value result;
+    // the call was a tail call, so the callee's returns can stay returns (and its tail calls stay tail calls)
+    bool tail;
+} InlineSite;
+
+static Value remap_value(const InlineSite *site, Value v, Arena *arena) {
+    switch (v.type) {
+    case VT_NONE:
+    case VT_STRING: return v;
+    case VT_CONST: return ir_const(site->caller, ir_const_value(site->callee, v), arena);
+    case VT_TEMP: return (Value){.type = VT_TEMP, .index = site->temp_base + v.index};
+    case VT_ARG: return (Value){.type = VT_TEMP, .index = site->arg_base + v.index};
+    }
+    UNREACHABLE("Unknown value type");
+    return v;
+}
+
+// Appends the body of `site->callee` renamed into the caller, its returns jump to the continuation label unless
+// the call was a tail call
+static void copy_body(const InlineSite *site, FunctionBody *out, Arena *arena) {
+    const Function *callee = site->callee;
+    for (size_t i = 0; i < callee->body.count; i++) {
+        Statement st = callee->body.items[i];
+        switch (st.type) {
+        case ST_RETURN:
+            if (site->tail) {
+                st.ret.value = remap_value(site, st.ret.value, arena);
+                break;
+            }
+            if (site->result.type != VT_NONE) {
+                Statement assign = {.type = ST_ASSIGN,
+                                    .assign = {.place = site->result, .value = remap_value(site, st.ret.value, arena)}};
+                da_push(out, assign, arena);
+            }
+            st = (Statement){.type = ST_JMP, .jmp = site->cont};
+            break;
+        case ST_RETURN_EMPTY:
+            if (!site->tail) st = (Statement){.type = ST_JMP, .jmp = site->cont};
+            break;
+        case ST_ADD:
+        case ST_SUB:
+        case ST_MUL:
+        case ST_DIV:
+        case ST_EQ:
+        case ST_NE:
+        case ST_LT:
+        case ST_LE:
+        case ST_GT:
+        case ST_GE:
+            st.binop.l = remap_value(site, st.binop.l, arena);
+            st.binop.r = remap_value(site, st.binop.r, arena);
+            st.binop.result = remap_value(site, st.binop.result, arena);
+            break;
+        case ST_ASSIGN:
+            st.assign.place = remap_value(site, st.assign.place, arena);
+            st.assign.value = remap_value(site, st.assign.value, arena);
+            break;
+        case ST_CALL: {
+            const IrCall *call = ir_call(callee, st.call.id);
+            Value *args = arena_alloc(arena, sizeof(*args) * (call->args_count + 1));
+            for (size_t a = 0; a < call->args_count; a++) {
+                args[a] = remap_value(site, ir_call_arg(callee, call, a), arena);
+            }
+            st.call.id = ir_push_call(site->caller, ir_name(callee, call->name), args, call->args_count, arena);
+            st.call.return_v = remap_value(site, st.call.return_v, arena);
+            break;
+        }
+        case ST_LABEL: st.label += site->label_base; break;
+        case ST_JZ:
+            st.jz.cond = remap_value(site, st.jz.cond, arena);
+            st.jz.to += site->label_base;
+            break;
+        case ST_JMP: st.jmp += site->label_base; break;
+        case ST_ASM:
+        case ST_PHI:
+        case ST_SELECT: UNREACHABLE("Functions with inline asm aren't inlined, and phis and selects don't exist yet");
+        }
+        da_push(out, st, arena);
+    }
+}
+
+static void inline_call(Function *caller, size_t index, const Function *callee, FunctionBody *out, Arena *arena) {
+    const Statement *st = &caller->body.items[index];
+    InlineSite site = {
+        .caller = caller,
+        .callee = callee,
+        .temp_base = caller->max_temps,
+        .arg_base = caller->max_temps + callee->max_temps,
+        .label_base = caller->label_count,
+        .cont = caller->label_count + callee->label_count,
+        .result = st->call.return_v,
+        .tail = statement_is_tail_call(caller, index),
+    };
+    caller->max_temps += callee->max_temps + callee->arg_count;
+    caller->label_count += callee->label_count + 1;
+
+    // the arguments are evaluated into the callee's argument temps first, its body may assign to them
+    const IrCall *call = ir_call(caller, st->call.id);
+    for (size_t a = 0; a < call->args_count; a++) {
+        Statement assign = {
+            .type = ST_ASSIGN,
+            .assign = {.place = {.type = VT_TEMP, .index = site.arg_base + a}, .value = ir_call_arg(caller, call, a)},
+        };
+        da_push(out, assign, arena);
+    }
+    copy_body(&site, out, arena);
+    Statement cont = {.type = ST_LABEL, .label = site.cont};
+    da_push(out, cont, arena);
+}
+
+static bool should_inline(const Function *caller, const Function *callee, const Callee *info, size_t caller_size,
+                          const IrCall *call) {
+    if (callee == caller || function_has_asm(callee)) return false;
+    if (call->args_count != callee->arg_count) return false;
+    size_t size = callee->body.count;
+    if (caller_size + size > INLINE_CALLER_STATEMENTS) return false;
+    return size <= INLINE_SMALL_STATEMENTS || (info->calls == 1 && size <= INLINE_SINGLE_CALL_STATEMENTS);
+}
+
+bool inline_calls(Module *mod, Arena *arena) {
+    size_t count = mod->functions.count;
+    Callee *callees = arena_alloc(arena, sizeof(*callees) * (count + 1));
+    for (size_t i = 0; i < count; i++) {
+        callees[i] = (Callee){.name = mod->functions.items[i].name, .function = i};
+    }
+    qsort(callees, count, sizeof(*callees), compare_callees);
+    for (size_t i = 0; i < count; i++) {
+        const Function *f = &mod->functions.items[i];
+        for (size_t j = 0; j < f->body.count; j++) {
+            if (f->body.items[j].type != ST_CALL) continue;
+            Callee *c = find_callee(callees, count, ir_name(f, ir_call(f, f->body.items[j].call.id)->name));
+            if (c != NULL) c->calls++;
+        }
+    }
+
+    bool changed = false;
+    for (size_t i = 0; i < count; i++) {
+        Function *f = &mod->functions.items[i];
+        if (function_has_asm(f)) continue;
+        // every call site of the original body is looked at once, calls that come in with an inlined body stay
+        // calls, which keeps recursion from unrolling
+        FunctionBody out = ir_begin_body(f, f->body.count, arena);
+        bool inlined = false;
+        for (size_t j = 0; j < f->body.count; j++) {
+            const Statement *st = &f->body.items[j];
+            if (st->type == ST_CALL) {
+                const IrCall *call = ir_call(f, st->call.id);
+                Callee *c = find_callee(callees, count, ir_name(f, call->name));
+                if (c != NULL) {
+                    const Function *callee = &mod->functions.items[c->function];
+                    if (should_inline(f, callee, c, out.count + f->body.count - j, call)) {
+                        inline_call(f, j, callee, &out, arena);
+                        inlined = true;
+                        continue;
+                    }
+                }
+            }
+            da_push(&out, *st, arena);
+        }
+        if (inlined) ir_replace_body(f, out);
+        changed |= inlined;
+    }
+    return changed;
+}
@@ -0,0 +1,145 @@
+#include "../../util.h"
+#include "cfg.h"
+#include "passes.h"
+
+// statement indices or labels
+typedef struct {
+    uint32_t *items;
+    size_t count;
+    size_t capacity;
+} Indices;
+
+// Statements that compute a value and do nothing else, running them on iterations that never happen (or when the
+// loop doesn't run at all) is harmless
+static bool is_hoistable(const Function *f, const Statement *st) {
+    switch (st->type) {
+    case ST_ADD:
+    case ST_SUB:
+    case ST_MUL:
+    case ST_EQ:
+    case ST_NE:
+    case ST_LT:
+    case ST_LE:
+    case ST_GT:
+    case ST_GE: return true;
+    // a division that might trap has to stay where it was
+    case ST_DIV: return st->binop.r.type == VT_CONST && ir_const_value(f, st->binop.r) != 0;
+    case ST_ASSIGN: return st->assign.place.type == VT_TEMP;
+    default: return false;
+    }
+}
+
+// Moves the invariant statements of the loop headed by `header` into a new preheader block right in front of it
+// Return: true if it changed anything, the CFG is stale then
+static bool hoist_loop(Function *f, BlockId header, Arena *arena) {
+    const Cfg *cfg = &f->cfg;
+    BlockIds loop = {0};
+    cfg_natural_loop(f, header, &loop, arena);
+    if (loop.count == 0) return false;
+    bool *in_loop = arena_alloc_zeroed(arena, sizeof(*in_loop) * cfg->blocks.count);
+    for (size_t i = 0; i < loop.count; i++) in_loop[loop.items[i]] = true;
+
+    // the preheader takes over the one edge that enters the loop, several of them would need phis of their own
+    const BasicBlock *h = &cfg->blocks.items[header];
+    BlockId entering = BLOCK_UNREACHABLE;
+    for (size_t i = 0; i < h->preds.count; i++) {
+        if (in_loop[h->preds.items[i]]) continue;
+        if (entering != BLOCK_UNREACHABLE) return false;
+        entering = h->preds.items[i];
+    }
+    if (entering == BLOCK_UNREACHABLE) return false;
+    // a loop block that falls into the header would fall into the preheader instead
+    if (header > 0 && in_loop[header - 1] && cfg_fallthrough(f, header - 1) == header) return false;
+
+    // temps written inside the loop, the hoisted ones drop out as they go
+    bool *variant = arena_alloc_zeroed(arena, sizeof(*variant) * f->max_temps);
+    for (size_t i = 0; i < loop.count; i++) {
+        const BasicBlock *block = &cfg->blocks.items[loop.items[i]];
+        for (uint32_t j = block->begin; j < block->end; j++) {
+            Value *d = statement_def(&f->body.items[j]);
+            if (d != NULL) variant[d->index] = true;
+        }
+    }
+
+    // in reverse postorder a definition is seen before its uses, so one pass catches chains of invariants
+    bool *hoisted = arena_alloc_zeroed(arena, sizeof(*hoisted) * f->body.count);
+    Indices order = {0};
+    ValueRefs uses = {0};
+    for (size_t i = 0; i < loop.count; i++) {
+        const BasicBlock *block = &cfg->blocks.items[loop.items[i]];
+        for (uint32_t j = block->begin; j < block->end; j++) {
+            Statement *st = &f->body.items[j];
+            if (!is_hoistable(f, st)) continue;
+            statement_uses(f, st, &uses, arena);
+            bool invariant = true;
+            for (size_t k = 0; k < uses.count && invariant; k++) {
+                invariant = uses.items[k]->type != VT_TEMP || !variant[uses.items[k]->index];
+            }
+            if (!invariant) continue;
+            hoisted[j] = true;
+            variant[statement_def(st)->index] = false;
+            da_push(&order, j, arena);
+        }
+    }
+    if (order.count == 0) return false;
+
+    IrLabel preheader = f->label_count++;
+    IrLabel header_label = cfg_block_label(f, header);
+    IrLabel entering_label = cfg_block_label(f, entering);
+    // the phis of the header get their entry values from the preheader now
+    for (uint32_t j = h->begin; j < h->end; j++) {
+        const Statement *st = &f->body.items[j];
+        if (st->type != ST_PHI) continue;
+        for (uint32_t a = 0; a < st->phi.args_count; a++) {
+            IrPhiArg *arg = &f->phi_args.items[st->phi.args_begin + a];
+            if (arg->pred == entering_label) arg->pred = preheader;
+        }
+    }
+
+    FunctionBody body = ir_begin_body(f, f->body.count + 1, arena);
+    for (uint32_t i = 0; i < f->body.count; i++) {
+        if (i == h->begin) {
+            Statement label = {.type = ST_LABEL, .label = preheader};
+            da_push(&body, label, arena);
+            for (size_t k = 0; k < order.count; k++) {
+                da_push(&body, f->body.items[order.items[k]], arena);
+            }
+        }
+        if (hoisted[i]) continue;
+        Statement st = f->body.items[i];
+        if (i == cfg->blocks.items[entering].end - 1) {
+            if (st.type == ST_JMP && st.jmp == header_label) st.jmp = preheader;
+            if (st.type == ST_JZ && st.jz.to == header_label) st.jz.to = preheader;
+        }
+        da_push(&body, st, arena);
+    }
+    ir_replace_body(f, body);
+    return true;
+}
+
+bool hoist_loop_invariants(Function *f, Arena *arena) {
+    // an inner loop's header comes after the header of the loop around it in reverse postorder, so walking the
+    // headers backwards hoists out of inner loops first, and the outer loop can then hoist the same statements again
+    cfg_compute_dominators(f, arena);
+    Indices headers = {0};
+    const Cfg *cfg = &f->cfg;
+    for (size_t i = 0; i < cfg->rpo.count; i++) {
+        BlockId b = cfg->rpo.items[i];
+        const BasicBlock *block = &cfg->blocks.items[b];
+        for (size_t j = 0; j < block->preds.count; j++) {
+            if (cfg_dominates(cfg, b, block->preds.items[j])) {
+                da_push(&headers, cfg_block_label(f, b), arena);
+                break;
+            }
+        }
+    }
+
+    bool changed = false;
+    for (size_t i = headers.count; i-- > 0;) {
+        if (!hoist_loop(f, f->cfg.label_blocks.items[headers.items[i]], arena)) continue;
+        changed = true;
+        cfg_build(f, arena);
+        cfg_compute_dominators(f, arena);
+    }
+    return changed;
+}
@@ -0,0 +1,40 @@
+#include "opt.h"
+#include "../../util.h"
+#include "cfg.h"
+#include "passes.h"
+#include "ssa_form.h"
+
+bool optimize_module(Module *mod, size_t level, size_t unroll_factor, Arena *arena) {
+    ASSERT(mod, "Sanity check");
+    ASSERT(level <= OPT_LEVEL_MAX, "The config parser only accepts levels up to OPT_LEVEL_MAX");
+    if (level == 0) return true;
+    if (level >= 2) inline_calls(mod, arena);
+
+    for (size_t i = 0; i < mod->functions.count; i++) {
+        Function *f = &mod->functions.items[i];
+        if (function_has_asm(f)) continue;
+        eliminate_tail_recursion(f, arena);
+        if (level >= 2) unroll_loops(f, unroll_factor, arena);
+        to_ssa(f, arena);
+        fold_constants(f, arena);
+        // the constants it finds give folding more to work with
+        if (propagate_conditional_constants(f, arena)) fold_constants(f, arena);
+        eliminate_common_subexpressions(f, arena);
+        eliminate_dead_code(f, arena);
+        hoist_loop_invariants(f, arena);
+        // the increments it adds are on values LICM already moved out of the loop
+        bool reduced = reduce_induction_variables(f, arena);
+        // last, so the selects it makes don't get in the way of the loop passes
+        bool converted = convert_ifs_to_selects(f, arena);
+        // one round cleans up after both, the copies and constant products of the former don't stop the latter
+        if (reduced || converted) {
+            fold_constants(f, arena);
+            eliminate_dead_code(f, arena);
+        }
+        from_ssa(f, arena);
+        remove_unused_labels(f, arena);
+        // the code generator lays the function out from its CFG, which drops unreachable blocks
+        cfg_build(f, arena);
+    }
+    return true;
+}
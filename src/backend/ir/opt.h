@@ -0,0 +1,19 @@
+#ifndef OPT_H_
+#define OPT_H_
+
+#include "ssa.h"
+
+#define OPT_LEVEL_DEFAULT 1
+#define OPT_LEVEL_MAX 2
+#define UNROLL_FACTOR_DEFAULT 4
+#define UNROLL_FACTOR_MAX 16
+
+/*
+ * Runs the IR passes enabled at `level` over every function in `mod`
+ * Level 0 leaves the IR exactly as `generate_module` produced it, level 2 also inlines calls and unrolls
+ * counted loops `unroll_factor` times (see `unroll_loops`)
+ * Return: false if a pass failed (it already reported why)
+ */
+bool optimize_module(Module *mod, size_t level, size_t unroll_factor, Arena *arena);
+
+#endif
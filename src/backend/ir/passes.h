@@ -0,0 +1,109 @@
+#ifndef PASSES_H_
+#define PASSES_H_
+
+#include "ssa.h"
+
+// The passes below work on a function in SSA form (see `to_ssa`) whose CFG is up to date
+// Return: true if the pass changed anything
+
+/*
+ * Constant folding, constant propagation and copy propagation
+ * Arithmetic wraps around at 64 bits like the generated code does, comparisons are unsigned
+ * A division by a constant zero is left alone, so the program still traps where it did before
+ * Copies of arguments aren't propagated, the argument registers don't survive calls
+ * The statements whose results got propagated stay behind for `eliminate_dead_code`
+ */
+bool fold_constants(Function *f, Arena *arena);
+
+/*
+ * Sparse conditional constant propagation (Wegman and Zadeck): only blocks an executable edge reaches count, so
+ * a value that is only different on a path that never runs is still constant
+ * Uses of constant temps read the constant, a conditional jump on a constant becomes a jump (or goes away), and
+ * phis lose the arguments of the edges that went with it
+ * The blocks nobody jumps to anymore and the statements that computed the constants stay behind for
+ * `eliminate_dead_code`
+ */
+bool propagate_conditional_constants(Function *f, Arena *arena);
+
+/*
+ * Drops the blocks the entry can't reach (trimming the phis they fed) and every statement whose result is
+ * never used and that has no other effect
+ * Calls, inline asm, jumps, returns and labels always stay, and so does a division unless its divisor is a
+ * nonzero constant, since dividing by zero traps
+ * A call whose result is unused keeps the call but loses the result
+ */
+bool eliminate_dead_code(Function *f, Arena *arena);
+
+/*
+ * Dominator based global value numbering: an arithmetic statement or comparison that computes what a statement
+ * in a dominating position already computed becomes a copy of that result, and its uses read the earlier temp
+ * Commutative operands and mirrored comparisons count as the same expression, constants compare by value
+ * The copies stay behind for `eliminate_dead_code`
+ */
+bool eliminate_common_subexpressions(Function *f, Arena *arena);
+
+/*
+ * Loop invariant code motion over the natural loops of `f`, innermost first
+ * Pure statements whose operands are all defined outside the loop move into a new preheader block, placed right
+ * in front of the loop header and entered instead of it
+ * Divisions only move when their divisor is a nonzero constant, the others might trap on an iteration that
+ * never happens
+ * Loops entered from more than one block are left alone
+ */
+bool hoist_loop_invariants(Function *f, Arena *arena);
+
+/*
+ * Strength reduction of induction variables, loop by loop, innermost first
+ * A basic induction variable is a phi of the loop header that gets an invariant added once per trip, a derived
+ * one is a basic one times an invariant, plus another invariant maybe
+ * Every derived one becomes a phi of its own, started in a new preheader and bumped right after the basic one,
+ * so the loop adds where it used to multiply
+ * When all that's left of a basic one is its increment and the exit test, the test compares a derived one
+ * instead (as long as that gives the same answer on every trip) and the basic one is dead
+ * The replaced statements turn into copies and stay behind for `fold_constants` and `eliminate_dead_code`
+ */
+bool reduce_induction_variables(Function *f, Arena *arena);
+
+/*
+ * If-conversion: a conditional jump whose two paths (or one path and the jump around it) meet again right away,
+ * with nothing on them but arithmetic that can't trap, becomes straight line code
+ * The statements of both paths run unconditionally and the phis of the join turn into ST_SELECTs on the condition
+ * Only done when the statements and the selects cost less than a mispredicted branch (see IFCONV_BUDGET), a
+ * converted diamond can be one path of a bigger one
+ */
+bool convert_ifs_to_selects(Function *f, Arena *arena);
+
+/*
+ * Cleanup for the linear IR once it is out of SSA form (labels are only needed for phis in SSA form)
+ * Removes labels no jump refers to, and then the statements after a jump or a return up to the next label
+ */
+bool remove_unused_labels(Function *f, Arena *arena);
+
+/*
+ * Works on the linear IR of the whole module, before `to_ssa`
+ * Copies the bodies of small callees (and of callees with a single call site) into their callers, with the
+ * callee's temps, arguments and labels renamed into fresh ones of the caller and its returns turned into jumps
+ * Functions with inline asm rely on their own frame layout, so they are never inlined nor inlined into
+ * Callees are kept around, inline asm may still call them by name
+ */
+bool inline_calls(Module *mod, Arena *arena);
+
+/*
+ * Works on the linear IR of `f`, before `to_ssa`
+ * Turns every call of `f` to itself whose result goes straight back to the caller into assignments to the
+ * arguments and a jump back to the top, so the recursion runs as a loop in a single frame
+ */
+bool eliminate_tail_recursion(Function *f, Arena *arena);
+
+/*
+ * Works on the linear IR of `f`, before `to_ssa`
+ * Unrolls loops that are a single block and count: a counter gets a constant added once per iteration and the
+ * test at the bottom compares it against a constant or a value the loop doesn't write
+ * A loop whose trip count is known and small is replaced by that many copies of its body
+ * A loop counting up to its limit gets an unrolled copy in front that runs `factor` iterations per test, while
+ * that many are left, and the loop itself runs the rest
+ * A `factor` below 2 turns it off
+ */
+bool unroll_loops(Function *f, size_t factor, Arena *arena);
+
+#endif
@@ -17,6 +17,200 @@ static bool generate_while_st(const AstRoot *tree, Function *out, const AstState
                               Arena *arena);
 static bool generate_asm_st(const AstRoot *tree, Function *out, const AstStatement *st, StringPool *strs, Arena *arena);
 
+bool statement_is_comparison(StatementType type) {
+    return type == ST_EQ || type == ST_NE || type == ST_LT || type == ST_LE || type == ST_GT || type == ST_GE;
+}
+
+StatementType negate_comparison(StatementType type) {
+    switch (type) {
+    case ST_EQ: return ST_NE;
+    case ST_NE: return ST_EQ;
+    case ST_LT: return ST_GE;
+    case ST_LE: return ST_GT;
+    case ST_GT: return ST_LE;
+    case ST_GE: return ST_LT;
+    default: UNREACHABLE("Only comparisons can be negated");
+    }
+    return type;
+}
+
+bool function_has_asm(const Function *f) {
+    for (size_t i = 0; i < f->body.count; i++) {
+        if (f->body.items[i].type == ST_ASM) return true;
+    }
+    return false;
+}
+
+void statement_uses(Function *f, Statement *st, ValueRefs *out, Arena *arena) {
+    out->count = 0;
+    switch (st->type) {
+    case ST_RETURN: da_push(out, &st->ret.value, arena); return;
+    case ST_ADD:
+    case ST_SUB:
+    case ST_MUL:
+    case ST_DIV:
+    case ST_EQ:
+    case ST_NE:
+    case ST_LT:
+    case ST_LE:
+    case ST_GT:
+    case ST_GE: {
+        da_push(out, &st->binop.l, arena);
+        da_push(out, &st->binop.r, arena);
+        return;
+    }
+    case ST_ASSIGN: da_push(out, &st->assign.value, arena); return;
+    case ST_CALL: {
+        IrCall *call = &f->calls.items[st->call.id];
+        for (size_t i = 0; i < call->args_count; i++) {
+            da_push(out, &f->call_args.items[call->args_begin + i], arena);
+        }
+        return;
+    }
+    case ST_JZ: da_push(out, &st->jz.cond, arena); return;
+    case ST_PHI: {
+        for (size_t i = 0; i < st->phi.args_count; i++) {
+            da_push(out, &f->phi_args.items[st->phi.args_begin + i].value, arena);
+        }
+        return;
+    }
+    case ST_SELECT: {
+        da_push(out, &st->select.cond, arena);
+        da_push(out, &f->call_args.items[st->select.args_begin], arena);
+        da_push(out, &f->call_args.items[st->select.args_begin + 1], arena);
+        return;
+    }
+    case ST_RETURN_EMPTY:
+    case ST_LABEL:
+    case ST_JMP:
+    case ST_ASM: return;
+    }
+    UNREACHABLE("Unknown statement type");
+}
+
+Value *statement_def(Statement *st) {
+    switch (st->type) {
+    case ST_ADD:
+    case ST_SUB:
+    case ST_MUL:
+    case ST_DIV:
+    case ST_EQ:
+    case ST_NE:
+    case ST_LT:
+    case ST_LE:
+    case ST_GT:
+    case ST_GE: return &st->binop.result;
+    case ST_ASSIGN: return st->assign.place.type == VT_TEMP ? &st->assign.place : NULL;
+    case ST_CALL: return st->call.return_v.type == VT_NONE ? NULL : &st->call.return_v;
+    case ST_PHI: return &st->phi.result;
+    case ST_SELECT: return &st->select.result;
+    case ST_RETURN:
+    case ST_RETURN_EMPTY:
+    case ST_LABEL:
+    case ST_JZ:
+    case ST_JMP:
+    case ST_ASM: return NULL;
+    }
+    UNREACHABLE("Unknown statement type");
+    return NULL;
+}
+
+Value ir_const(Function *f, ConstValue c, Arena *arena) {
+    da_push(&f->consts, c, arena);
+    return (Value){.type = VT_CONST, .index = f->consts.count - 1};
+}
+
+ConstValue ir_const_value(const Function *f, Value v) {
+    ASSERT(v.type == VT_CONST && v.index < f->consts.count, "Invalid constant");
+    return f->consts.items[v.index];
+}
+
+IrNameId ir_push_name(Function *f, StringView name, Arena *arena) {
+    da_push(&f->names, name, arena);
+    return f->names.count - 1;
+}
+
+StringView ir_name(const Function *f, IrNameId id) {
+    ASSERT(id < f->names.count, "Invalid name id %u", id);
+    return f->names.items[id];
+}
+
+const IrCall *ir_call(const Function *f, IrCallId id) {
+    ASSERT(id < f->calls.count, "Invalid call id %u", id);
+    return &f->calls.items[id];
+}
+
+Value ir_call_arg(const Function *f, const IrCall *call, size_t index) {
+    ASSERT(index < call->args_count, "Invalid argument index %zu", index);
+    return f->call_args.items[call->args_begin + index];
+}
+
+IrCallId ir_push_call(Function *out, StringView name, const Value *args, size_t count, Arena *arena) {
+    IrCall call = {.name = ir_push_name(out, name, arena), .args_begin = out->call_args.count, .args_count = count};
+    for (size_t i = 0; i < count; i++) {
+        da_push(&out->call_args, args[i], arena);
+    }
+    da_push(&out->calls, call, arena);
+    return out->calls.count - 1;
+}
+
+bool ir_values_equal(const Function *f, Value a, Value b) {
+    if (a.type != b.type) return false;
+    if (a.type == VT_CONST) return ir_const_value(f, a) == ir_const_value(f, b);
+    return a.index == b.index;
+}
+
+Value ir_new_temp(Function *f) { return (Value){.type = VT_TEMP, .index = f->max_temps++}; }
+
+FunctionBody ir_begin_body(Function *f, size_t size, Arena *arena) {
+    FunctionBody *spare = &f->spare_body;
+    if (spare->capacity < size) {
+        // some room for the statements passes add
+        spare->capacity = size * 3 / 2;
+        spare->items = arena_alloc(arena, sizeof(*spare->items) * spare->capacity);
+    }
+    spare->count = 0;
+    return *spare;
+}
+
+void ir_replace_body(Function *f, FunctionBody body) {
+    f->spare_body = f->body;
+    f->body = body;
+}
+
+Value ir_push_binop(FunctionBody *body, StatementType type, Value l, Value r, Value result, Arena *arena) {
+    Statement st = {.type = type, .binop = {.l = l, .r = r, .result = result}};
+    da_push(body, st, arena);
+    return result;
+}
+
+void ir_push_assign(FunctionBody *body, Value place, Value value, Arena *arena) {
+    Statement st = {.type = ST_ASSIGN, .assign = {.place = place, .value = value}};
+    da_push(body, st, arena);
+}
+
+void ir_push_label(FunctionBody *body, IrLabel label, Arena *arena) {
+    Statement st = {.type = ST_LABEL, .label = label};
+    da_push(body, st, arena);
+}
+
+void ir_push_jz(FunctionBody *body, Value cond, IrLabel to, Arena *arena) {
+    Statement st = {.type = ST_JZ, .jz = {.cond = cond, .to = to}};
+    da_push(body, st, arena);
+}
+
+Statement ir_select(Function *f, Value result, Value cond, Value if_true, Value if_false, Arena *arena) {
+    Statement st = {.type = ST_SELECT, .select = {.result = result, .cond = cond, .args_begin = f->call_args.count}};
+    da_push(&f->call_args, if_true, arena);
+    da_push(&f->call_args, if_false, arena);
+    return st;
+}
+
+Value ir_select_value(const Function *f, const Statement *select, bool when) {
+    ASSERT(select->type == ST_SELECT, "Only selects pick between two values");
+    return f->call_args.items[select->select.args_begin + (when ? 0 : 1)];
+}
+
 bool generate_module(const AstRoot *ast, Module *out, Arena *arena) {
     ASSERT(ast, "Sanity check");
     ASSERT(out, "Sanity check");
@@ -37,11 +231,11 @@ bool generate_function(Function *out, const AstFunction *ast_func, Arena *arena,
     out->arg_count = ast_func->args.count;
     push_scope(&out->scopes, arena);
     for (size_t i = 0; i < ast_func->args.count; i++) {
-        define_sym(&out->scopes, ast_func->args.items[i], (Value){.type = VT_ARG, .arg_index = i}, arena);
+        define_sym(&out->scopes, ast_func->args.items[i], (Value){.type = VT_ARG, .index = i}, arena);
     }
     out->name = ast_func->name;
     for (size_t i = 0; i < ast_func->body.count; i++) {
-        if (!generate_statement(tree, &ast_func->body.items[i], out, strs, arena)) return false;
+        if (!generate_statement(tree, ast_ref(&tree->ast, ast_func->body, i), out, strs, arena)) return false;
     }
     return true;
 }
@@ -76,8 +270,8 @@ bool lookup_sym(ScopeStack *stack, StringView name, Sym **out_value) {
     return false;
 }
 
-bool generate_statement(const AstRoot *tree, const AstStatement *st, Function *out, StringPool *strs, Arena *arena) {
-    ASSERT(st, "Sanity check");
+bool generate_statement(const AstRoot *tree, AstStmtId id, Function *out, StringPool *strs, Arena *arena) {
+    const AstStatement *st = ast_stmt(&tree->ast, id);
     switch (st->type) {
     case AST_RETURN: return generate_return_st(tree, out, st, strs, arena);
     case AST_LET: return generate_let_st(tree, out, st, strs, arena);
@@ -92,195 +286,420 @@ bool generate_statement(const AstRoot *tree, const AstStatement *st, Function *o
                 "statement");
     return false;
 }
-bool generate_expr(const AstRoot *tree, const AstExpression *expr, Value *out_value, Function *out, StringPool *strs,
+static StatementType binop_statement_type(OperatorType op) {
+    switch (op) {
+    case OT_PLUS: return ST_ADD;
+    case OT_MINUS: return ST_SUB;
+    case OT_MULT: return ST_MUL;
+    case OT_DIV: return ST_DIV;
+    case OT_EQ: return ST_EQ;
+    case OT_NE: return ST_NE;
+    case OT_LT: return ST_LT;
+    case OT_LE: return ST_LE;
+    case OT_GT: return ST_GT;
+    case OT_GE: return ST_GE;
+    case OT_AND:
+    case OT_OR:
+    case OT_NOT: UNREACHABLE("Logical operators lower to jumps");
+    }
+    UNREACHABLE("Unknown operator");
+    return ST_ADD;
+}
+
+static void push_work(Function *out, AstExprId expr, bool expanded, Arena *arena) {
+    ExprWork work = {.expr = expr, .expanded = expanded};
+    da_push(&out->expr_work, work, arena);
+}
+
+static Value pop_value(Function *out) {
+    ASSERT(out->expr_values.count > 0, "Every operand is lowered before its operator");
+    return out->expr_values.items[--out->expr_values.count];
+}
+
+// `a && b` is 0 without running `b` when `a` is 0 and `b != 0` otherwise, `a || b` is 1 without running `b` when
+// `a` isn't 0, the result is a variable the two paths assign
+// Return: true once the value is in `work->result`, false if it queued more work
+static bool lower_logical(Function *out, const ExprWork *work, const AstExpression *expr, Arena *arena) {
+    if (!work->expanded) {
+        push_work(out, work->expr, true, arena);
+        push_work(out, expr->bin.l, false, arena);
+        return false;
+    }
+    Value zero = ir_const(out, 0, arena);
+    if (!work->right) {
+        bool is_and = expr->bin.op == OT_AND;
+        Value l = pop_value(out);
+        ExprWork next = {
+            .expr = work->expr,
+            .expanded = true,
+            .right = true,
+            .result = ir_new_temp(out),
+            .skip = out->label_count++,
+        };
+        ir_push_assign(&out->body, next.result, ir_const(out, is_and ? 0 : 1, arena), arena);
+        Value cond = is_and ? l : ir_push_binop(&out->body, ST_EQ, l, zero, ir_new_temp(out), arena);
+        ir_push_jz(&out->body, cond, next.skip, arena);
+        da_push(&out->expr_work, next, arena);
+        push_work(out, expr->bin.r, false, arena);
+        return false;
+    }
+    Value r = pop_value(out);
+    Value nonzero = ir_push_binop(&out->body, ST_NE, r, zero, ir_new_temp(out), arena);
+    ir_push_assign(&out->body, work->result, nonzero, arena);
+    ir_push_label(&out->body, work->skip, arena);
+    return true;
+}
+
+// Post-order walk with an explicit stack: a node is popped once to queue its operands, and once more
+// (`expanded`) to emit itself after their values are on the value stack
+bool generate_expr(const AstRoot *tree, AstExprId root, Value *out_value, Function *out, StringPool *strs,
                    Arena *arena) {
-    ASSERT(expr, "Sanity check");
     ASSERT(out_value, "Sanity check");
+    ASSERT(out->expr_work.count == 0 && out->expr_values.count == 0, "generate_expr isn't reentrant");
 
-    switch (expr->type) {
-    case AET_PRIMARY: {
-        out_value->type = VT_CONST;
-        out_value->constant = expr->number;
-        return true;
-    }
-    case AET_BINARY: {
-        Value l = {0};
-        Value r = {0};
-        if (!generate_expr(tree, expr->bin.l, &l, out, strs, arena)) return false;
-        if (!generate_expr(tree, expr->bin.r, &r, out, strs, arena)) return false;
-        Value result = {.type = VT_TEMP, .temp = out->max_temps++};
-        Statement st = {.binop = {.l = l, .r = r, .result = result}};
-        switch (expr->bin.op) {
-        case OT_PLUS: st.type = ST_ADD; break;
-        case OT_MINUS: st.type = ST_SUB; break;
-        case OT_MULT: st.type = ST_MUL; break;
-        case OT_DIV: st.type = ST_DIV; break;
+    push_work(out, root, false, arena);
+    while (out->expr_work.count > 0) {
+        ExprWork work = out->expr_work.items[--out->expr_work.count];
+        const AstExpression *expr = ast_expr(&tree->ast, work.expr);
+        Value v = {0};
+
+        switch (expr->type) {
+        case AET_PRIMARY: {
+            v = ir_const(out, ast_number(&tree->ast, expr->number), arena);
+            break;
         }
-        da_push(&out->body, st, arena);
-        *out_value = result;
+        case AET_BINARY: {
+            if (expr->bin.op == OT_AND || expr->bin.op == OT_OR) {
+                if (!lower_logical(out, &work, expr, arena)) continue;
+                v = work.result;
+                break;
+            }
+            if (!work.expanded) {
+                push_work(out, work.expr, true, arena);
+                push_work(out, expr->bin.r, false, arena);
+                push_work(out, expr->bin.l, false, arena);
+                continue;
+            }
+            Value r = pop_value(out);
+            Value l = pop_value(out);
+            v = ir_new_temp(out);
+            Statement st = {.type = binop_statement_type(expr->bin.op), .binop = {.l = l, .r = r, .result = v}};
+            da_push(&out->body, st, arena);
+            break;
+        }
+        case AET_UNARY: {
+            if (!work.expanded) {
+                push_work(out, work.expr, true, arena);
+                push_work(out, expr->unary.operand, false, arena);
+                continue;
+            }
+            Value operand = pop_value(out);
+            if (expr->unary.op == OT_NOT) {
+                v = ir_push_binop(&out->body, ST_EQ, operand, ir_const(out, 0, arena), ir_new_temp(out), arena);
+                break;
+            }
+            ASSERT(expr->unary.op == OT_MINUS, "The parser only produces unary minus and not");
+            v = ir_push_binop(&out->body, ST_SUB, ir_const(out, 0, arena), operand, ir_new_temp(out), arena);
+            break;
+        }
+        case AET_IDENT: {
+            Sym *p = NULL;
+            if (!lookup_sym(&out->scopes, ast_name(&tree->ast, expr->ident), &p)) {
+                log_diagnostic(LL_ERROR, "Found an unknown identifier in place of a expression");
+                report_error(tree->source.src.items + expr->begin, tree->source.src.items, tree->source.name);
+                out->expr_work.count = 0;
+                out->expr_values.count = 0;
+                return false;
+            }
+            v = p->value;
+            break;
+        }
+        case AET_FUNCTION_CALL: {
+            // TODO: Check for undefined functions
+            // To avoid header files and such, we should go through each of the function definitions first
+            // and push them into the module before generating
+            // for now just yolo
+            // also all functions just return a 64bit number for now
+            const AstCall *call = ast_call(&tree->ast, expr->func_call);
+            if (!work.expanded) {
+                push_work(out, work.expr, true, arena);
+                for (size_t i = call->args.count; i-- > 0;) {
+                    push_work(out, ast_ref(&tree->ast, call->args, i), false, arena);
+                }
+                continue;
+            }
+            ASSERT(out->expr_values.count >= call->args.count, "Every argument is lowered before the call");
+            size_t first = out->expr_values.count - call->args.count;
+            IrCallId id = ir_push_call(out, ast_name(&tree->ast, call->name), out->expr_values.items + first,
+                                       call->args.count, arena);
+            out->expr_values.count = first;
 
-        return true;
+            v = ir_new_temp(out);
+            Statement st = {.type = ST_CALL, .call = {.return_v = v, .id = id}};
+            da_push(&out->body, st, arena);
+            break;
+        }
+        case AET_STRING: {
+            da_push(strs, ast_name(&tree->ast, expr->string), arena);
+            v = (Value){.type = VT_STRING, .index = strs->count - 1};
+            break;
+        }
+        }
+        da_push(&out->expr_values, v, arena);
     }
-    case AET_IDENT: {
-        Sym *p = NULL;
-        if (!lookup_sym(&out->scopes, expr->ident, &p)) {
-            log_diagnostic(LL_ERROR, "Found an unknown identifier in place of a expression");
-            report_error(expr->begin, tree->source.src.items, tree->source.name);
+
+    *out_value = pop_value(out);
+    ASSERT(out->expr_values.count == 0, "An expression lowers to exactly one value");
+    return true;
+}
+
+static void push_branch(Function *out, AstExprId expr, bool when, IrLabel target, Arena *arena) {
+    BranchWork work = {.expr = expr, .when = when, .target = target};
+    da_push(&out->branch_work, work, arena);
+}
+
+static void push_branch_label(Function *out, IrLabel label, Arena *arena) {
+    BranchWork work = {.is_label = true, .target = label};
+    da_push(&out->branch_work, work, arena);
+}
+
+bool generate_branch(const AstRoot *tree, AstExprId root, bool when, IrLabel target, Function *out, StringPool *strs,
+                     Arena *arena) {
+    ASSERT(out->branch_work.count == 0, "generate_branch isn't reentrant");
+    push_branch(out, root, when, target, arena);
+    while (out->branch_work.count > 0) {
+        BranchWork work = out->branch_work.items[--out->branch_work.count];
+        if (work.is_label) {
+            ir_push_label(&out->body, work.target, arena);
+            continue;
+        }
+        const AstExpression *expr = ast_expr(&tree->ast, work.expr);
+        if (expr->type == AET_UNARY && expr->unary.op == OT_NOT) {
+            push_branch(out, expr->unary.operand, !work.when, work.target, arena);
+            continue;
+        }
+        if (expr->type == AET_BINARY && (expr->bin.op == OT_AND || expr->bin.op == OT_OR)) {
+            // the value of the left side that decides the whole thing, false for `&&` and true for `||`
+            bool decides = expr->bin.op == OT_OR;
+            // queued in reverse, the left side runs first
+            if (work.when == decides) {
+                push_branch(out, expr->bin.r, work.when, work.target, arena);
+                push_branch(out, expr->bin.l, work.when, work.target, arena);
+            } else {
+                // a left side that decides the other way skips the right side
+                IrLabel skip = out->label_count++;
+                push_branch_label(out, skip, arena);
+                push_branch(out, expr->bin.r, work.when, work.target, arena);
+                push_branch(out, expr->bin.l, decides, skip, arena);
+            }
+            continue;
+        }
+
+        Value v = {0};
+        if (!generate_expr(tree, work.expr, &v, out, strs, arena)) {
+            out->branch_work.count = 0;
             return false;
         }
-        *out_value = p->value;
-        return true;
-    }
-    case AET_FUNCTION_CALL: {
-        // TODO: Check for undefined functions
-        // To avoid header files and such, we should go through each of the function definitions first
-        // and push them into the module before generating
-        // for now just yolo
-        // also all functions just return a 64bit number for now
-        Value result_value = {.type = VT_TEMP, .temp = out->max_temps++};
-
-        InputArgs args = {0};
-        for (size_t i = 0; i < expr->func_call.args.count; i++) {
-            Value v = {0};
-            if (!generate_expr(tree, &expr->func_call.args.items[i], &v, out, strs, arena)) return false;
-            da_push(&args, v, arena);
+        if (work.when) {
+            // jumping when it's true is jumping when the opposite is false, a comparison is turned around in place
+            Statement *last = out->body.count > 0 ? &out->body.items[out->body.count - 1] : NULL;
+            if (v.type == VT_TEMP && last != NULL && statement_is_comparison(last->type) &&
+                last->binop.result.index == v.index) {
+                last->type = negate_comparison(last->type);
+            } else {
+                v = ir_push_binop(&out->body, ST_EQ, v, ir_const(out, 0, arena), ir_new_temp(out), arena);
+            }
         }
-        Statement st = {.type = ST_CALL,
-                        .call = {
-                            .returns = true,
-                            .return_v = result_value,
-                            .name = expr->func_call.name,
-                            .args = args,
-                        }};
-        da_push(&out->body, st, arena);
-        *out_value = result_value;
-        return true;
-    }
-    case AET_STRING: {
-        da_push(strs, expr->string, arena);
-        out_value->type = VT_STRING;
-        out_value->string_index = strs->count - 1;
-        return true;
+        ir_push_jz(&out->body, v, work.target, arena);
     }
-    }
-    UNREACHABLE("Again this shouldn't ever be reached")
-
-    return false;
+    return true;
 }
 
-void ir_value_repr(const Value *v) {
+static void ir_value_repr(const Function *f, const Value *v) {
     switch (v->type) {
+    case VT_NONE: {
+        printf("_");
+        return;
+    }
     case VT_CONST: {
-        printf("%zu", v->constant);
+        printf("%zu", ir_const_value(f, *v));
         return;
     }
     case VT_TEMP: {
-        printf("$%zu", v->temp);
+        printf("$%u", v->index);
         return;
     }
     case VT_STRING: {
-        printf("^%zu", v->string_index);
+        printf("^%u", v->index);
         return;
     }
     case VT_ARG: {
-        printf("#%zu", v->arg_index);
+        printf("#%u", v->index);
         return;
     }
     }
 }
 
+static const char *comparison_symbol(StatementType type) {
+    switch (type) {
+    case ST_EQ: return "==";
+    case ST_NE: return "!=";
+    case ST_LT: return "<";
+    case ST_LE: return "<=";
+    case ST_GT: return ">";
+    case ST_GE: return ">=";
+    default: UNREACHABLE("Not a comparison");
+    }
+    return "";
+}
+
+static void dump_statement(const Function *f, const Statement *st) {
+    printf("  ");
+    switch (st->type) {
+    case ST_ADD: {
+        ir_value_repr(f, &st->binop.result);
+        printf(" <- ");
+        ir_value_repr(f, &st->binop.l);
+        printf(" + ");
+        ir_value_repr(f, &st->binop.r);
+        break;
+    }
+    case ST_SUB: {
+        ir_value_repr(f, &st->binop.result);
+        printf(" <- ");
+        ir_value_repr(f, &st->binop.l);
+        printf(" - ");
+        ir_value_repr(f, &st->binop.r);
+        break;
+    }
+    case ST_MUL: {
+        ir_value_repr(f, &st->binop.result);
+        printf(" <- ");
+        ir_value_repr(f, &st->binop.l);
+        printf(" * ");
+        ir_value_repr(f, &st->binop.r);
+        break;
+    }
+    case ST_DIV: {
+        ir_value_repr(f, &st->binop.result);
+        printf(" <- ");
+        ir_value_repr(f, &st->binop.l);
+        printf(" / ");
+        ir_value_repr(f, &st->binop.r);
+        break;
+    }
+    case ST_EQ:
+    case ST_NE:
+    case ST_LT:
+    case ST_LE:
+    case ST_GT:
+    case ST_GE: {
+        ir_value_repr(f, &st->binop.result);
+        printf(" <- ");
+        ir_value_repr(f, &st->binop.l);
+        printf(" %s ", comparison_symbol(st->type));
+        ir_value_repr(f, &st->binop.r);
+        break;
+    }
+    case ST_PHI: {
+        ir_value_repr(f, &st->phi.result);
+        printf(" <- phi [");
+        for (size_t k = 0; k < st->phi.args_count; k++) {
+            const IrPhiArg *arg = &f->phi_args.items[st->phi.args_begin + k];
+            printf("@%u: ", arg->pred);
+            ir_value_repr(f, &arg->value);
+            if (k + 1 < st->phi.args_count) printf(", ");
+        }
+        printf("]");
+        break;
+    }
+    case ST_SELECT: {
+        ir_value_repr(f, &st->select.result);
+        printf(" <- select ");
+        ir_value_repr(f, &st->select.cond);
+        printf(" ? ");
+        Value if_true = ir_select_value(f, st, true), if_false = ir_select_value(f, st, false);
+        ir_value_repr(f, &if_true);
+        printf(" : ");
+        ir_value_repr(f, &if_false);
+        break;
+    }
+    case ST_ASM: {
+        printf("asm(");
+        printf(STR_FMT, STR_ARG(ir_name(f, st->asm)));
+        printf("\n  )");
+        break;
+    }
+    case ST_ASSIGN: {
+        ir_value_repr(f, &st->assign.place);
+        printf(" <- ");
+        ir_value_repr(f, &st->assign.value);
+        break;
+    }
+    case ST_RETURN: {
+        printf("ret <- ");
+        ir_value_repr(f, &st->ret.value);
+        break;
+    }
+    case ST_RETURN_EMPTY: {
+        printf("ret");
+        break;
+    }
+    case ST_JMP: {
+        printf("jump @%u", st->jmp);
+        break;
+    }
+    case ST_JZ: {
+        printf("jz ");
+        ir_value_repr(f, &st->jz.cond);
+        printf(" @%u", st->jz.to);
+        break;
+    }
+    case ST_CALL: {
+        const IrCall *call = ir_call(f, st->call.id);
+        if (st->call.return_v.type != VT_NONE) {
+            ir_value_repr(f, &st->call.return_v);
+            printf(" <- ");
+        }
+        printf("call " STR_FMT "(", STR_ARG(ir_name(f, call->name)));
+        for (size_t k = 0; k < call->args_count; k++) {
+            Value arg = ir_call_arg(f, call, k);
+            ir_value_repr(f, &arg);
+            if (k + 1 < call->args_count) printf(", ");
+        }
+        printf(")");
+        break;
+    }
+    case ST_LABEL: {
+        printf("@%u:", st->label);
+        break;
+    }
+    }
+    printf("\n");
+}
+
+static void dump_block_list(const BlockIds *ids) {
+    if (ids->count == 0) printf(" -");
+    for (size_t i = 0; i < ids->count; i++) printf(" %u", ids->items[i]);
+}
+
 void dump_ir(const Module *mod) {
     for (size_t i = 0; i < mod->functions.count; i++) {
         const Function *f = &mod->functions.items[i];
         printf("function " STR_FMT "(", STR_ARG(f->name));
         for (size_t j = 0; j < f->arg_count; j++) { printf("#%zu ", j); }
         printf(") {\n");
-        for (size_t j = 0; j < f->body.count; j++) {
-            const Statement *st = &f->body.items[j];
-            printf("  ");
-            switch (st->type) {
-            case ST_ADD: {
-                ir_value_repr(&st->binop.result);
-                printf(" <- ");
-                ir_value_repr(&st->binop.l);
-                printf(" + ");
-                ir_value_repr(&st->binop.r);
-                break;
-            }
-            case ST_SUB: {
-                ir_value_repr(&st->binop.result);
-                printf(" <- ");
-                ir_value_repr(&st->binop.l);
-                printf(" - ");
-                ir_value_repr(&st->binop.r);
-                break;
-            }
-            case ST_MUL: {
-                ir_value_repr(&st->binop.result);
-                printf(" <- ");
-                ir_value_repr(&st->binop.l);
-                printf(" * ");
-                ir_value_repr(&st->binop.r);
-                break;
-            }
-            case ST_DIV: {
-                ir_value_repr(&st->binop.result);
-                printf(" <- ");
-                ir_value_repr(&st->binop.l);
-                printf(" / ");
-                ir_value_repr(&st->binop.r);
-                break;
-            }
-            case ST_ASM: {
-                printf("asm(");
-                printf(STR_FMT, STR_ARG(st->asm));
-                printf("\n  )");
-                break;
-            }
-            case ST_ASSIGN: {
-                ir_value_repr(&st->assign.place);
-                printf(" <- ");
-                ir_value_repr(&st->assign.value);
-                break;
-            }
-            case ST_RETURN: {
-                printf("ret <- ");
-                ir_value_repr(&st->ret.value);
-                break;
-            }
-            case ST_RETURN_EMPTY: {
-                printf("ret");
-                break;
-            }
-            case ST_JMP: {
-                printf("jump @%zu", st->jmp);
-                break;
-            }
-            case ST_JZ: {
-                printf("jz ");
-                ir_value_repr(&st->jz.cond);
-                printf(" @%zu", st->jz.to);
-                break;
-            }
-            case ST_CALL: {
-                if (st->call.returns) {
-                    ir_value_repr(&st->call.return_v);
-                    printf(" <- ");
-                }
-                printf("call " STR_FMT "(", STR_ARG(st->call.name));
-                for (size_t k = 0; k < st->call.args.count; k++) {
-                    ir_value_repr(&st->call.args.items[k]);
-                    if (k + 1 < st->call.args.count) printf(", ");
-                }
-                printf(")");
-                break;
-            }
-            case ST_LABEL: {
-                printf("@%zu:", st->label);
-                break;
-            }
-            }
-            printf("\n");
+        if (f->cfg.blocks.count == 0) {
+            for (size_t j = 0; j < f->body.count; j++) dump_statement(f, &f->body.items[j]);
+        }
+        for (size_t b = 0; b < f->cfg.blocks.count; b++) {
+            const BasicBlock *block = &f->cfg.blocks.items[b];
+            printf(" block %zu (preds:", b);
+            dump_block_list(&block->preds);
+            printf(", succs:");
+            dump_block_list(&block->succs);
+            printf(")%s\n", block->rpo_index == BLOCK_UNREACHABLE ? " unreachable" : "");
+            for (size_t j = block->begin; j < block->end; j++) dump_statement(f, &f->body.items[j]);
         }
 
         printf("}\n");
@@ -294,7 +713,7 @@ static bool generate_return_st(const AstRoot *tree, Function *out, const AstStat
         return true;
     } else {
         Value value = {0};
-        if (!generate_expr(tree, &st->ret.return_expr, &value, out, strs, arena)) return false;
+        if (!generate_expr(tree, st->ret.return_expr, &value, out, strs, arena)) return false;
         Statement st = (Statement){.type = ST_RETURN, .ret = {value}};
         da_push(&out->body, st, arena);
         return true;
@@ -303,12 +722,12 @@ static bool generate_return_st(const AstRoot *tree, Function *out, const AstStat
 static bool generate_let_st(const AstRoot *tree, Function *out, const AstStatement *st, StringPool *strs,
                             Arena *arena) {
     Value variable_value = {0};
-    if (!generate_expr(tree, &st->let.value, &variable_value, out, strs, arena)) return false;
-    TempValueIndex place = out->max_temps++;
-    define_sym(&out->scopes, st->let.name, (Value){.type = VT_TEMP, .temp = place}, arena);
+    if (!generate_expr(tree, st->let.value, &variable_value, out, strs, arena)) return false;
+    Value place = ir_new_temp(out);
+    define_sym(&out->scopes, ast_name(&tree->ast, st->let.name), place, arena);
     Statement ir_st = {
         .type = ST_ASSIGN,
-        .assign = {.place = (Value){.type = VT_TEMP, .temp = place}, .value = variable_value},
+        .assign = {.place = place, .value = variable_value},
     };
     da_push(&out->body, ir_st, arena);
     return true;
@@ -316,11 +735,11 @@ static bool generate_let_st(const AstRoot *tree, Function *out, const AstStateme
 static bool generate_assign_st(const AstRoot *tree, Function *out, const AstStatement *st, StringPool *strs,
                                Arena *arena) {
     Value variable_value_new = {0};
-    if (!generate_expr(tree, &st->assign.value, &variable_value_new, out, strs, arena)) return false;
+    if (!generate_expr(tree, st->assign.value, &variable_value_new, out, strs, arena)) return false;
     Sym *p;
-    if (!lookup_sym(&out->scopes, st->assign.name, &p)) {
+    if (!lookup_sym(&out->scopes, ast_name(&tree->ast, st->assign.name), &p)) {
         log_diagnostic(LL_ERROR, "Tried to reassign an unknown variable");
-        report_error(st->begin, tree->source.src.items, tree->source.name);
+        report_error(tree->source.src.items + st->begin, tree->source.src.items, tree->source.name);
         return false;
     }
     Statement ir_st = {
@@ -332,25 +751,25 @@ static bool generate_assign_st(const AstRoot *tree, Function *out, const AstStat
 }
 static bool generate_call_st(const AstRoot *tree, Function *out, const AstStatement *st, StringPool *strs,
                              Arena *arena) {
+    const AstCall *call = ast_call(&tree->ast, st->call);
     InputArgs args = {0};
-    for (size_t i = 0; i < st->call.args.count; i++) {
+    for (size_t i = 0; i < call->args.count; i++) {
         Value v = {0};
-        if (!generate_expr(tree, &st->call.args.items[i], &v, out, strs, arena)) return false;
+        if (!generate_expr(tree, ast_ref(&tree->ast, call->args, i), &v, out, strs, arena)) return false;
         da_push(&args, v, arena);
     }
-    Statement call_st = {.type = ST_CALL, .call = {.name = st->call.name, .args = args}};
+    // nested calls in the arguments push their own arguments first, so these are only copied once all are known
+    IrCallId call_id = ir_push_call(out, ast_name(&tree->ast, call->name), args.items, args.count, arena);
+    Statement call_st = {.type = ST_CALL, .call = {.id = call_id}};
     da_push(&out->body, call_st, arena);
     return true;
 }
 static bool generate_if_st(const AstRoot *tree, Function *out, const AstStatement *st, StringPool *strs, Arena *arena) {
-    Value v = {0};
-    if (!generate_expr(tree, &st->if_st.cond, &v, out, strs, arena)) return false;
-    uint64_t jump_over = out->label_count++;
-    Statement jump_st = {.type = ST_JZ, .jz = {.cond = v, .to = jump_over}};
-    da_push(&out->body, jump_st, arena);
+    IrLabel jump_over = out->label_count++;
+    if (!generate_branch(tree, st->if_st.cond, false, jump_over, out, strs, arena)) return false;
     push_scope(&out->scopes, arena);
     for (size_t i = 0; i < st->if_st.block.count; i++) {
-        if (!generate_statement(tree, &st->if_st.block.items[i], out, strs, arena)) return false;
+        if (!generate_statement(tree, ast_ref(&tree->ast, st->if_st.block, i), out, strs, arena)) return false;
     }
     Statement label_st = {
         .type = ST_LABEL,
@@ -360,38 +779,29 @@ static bool generate_if_st(const AstRoot *tree, Function *out, const AstStatemen
     pop_scope(&out->scopes);
     return true;
 }
+// The loop is rotated: the condition is tested once on the way in and then at the bottom, where it jumps back to
+// the top of the body, so an iteration takes one branch instead of a jz and a jmp
+//   (cond) jz over; body: ...; (cond) jnz body; over:
 static bool generate_while_st(const AstRoot *tree, Function *out, const AstStatement *st, StringPool *strs,
                               Arena *arena) {
-    uint64_t header = out->label_count++;
-    uint64_t over = out->label_count++;
-    Statement header_st = {
-        .type = ST_LABEL,
-        .label = header,
-    };
-    Statement over_st = {
-        .type = ST_LABEL,
-        .label = over,
-    };
-    da_push(&out->body, header_st, arena);
-    Value v = {0};
-    if (!generate_expr(tree, &st->while_st.cond, &v, out, strs, arena)) return false;
-    Statement jump_st = {.type = ST_JZ, .jz = {.cond = v, .to = over}};
-    da_push(&out->body, jump_st, arena);
+    IrLabel body = out->label_count++;
+    IrLabel over = out->label_count++;
+    if (!generate_branch(tree, st->while_st.cond, false, over, out, strs, arena)) return false;
+    ir_push_label(&out->body, body, arena);
     push_scope(&out->scopes, arena);
     for (size_t i = 0; i < st->while_st.block.count; i++) {
-        if (!generate_statement(tree, &st->while_st.block.items[i], out, strs, arena)) return false;
+        if (!generate_statement(tree, ast_ref(&tree->ast, st->while_st.block, i), out, strs, arena)) return false;
     }
-    Statement jump_back_st = {.type = ST_JMP, .jmp = header};
-    da_push(&out->body, jump_back_st, arena);
-    da_push(&out->body, over_st, arena);
+    // the names of the body are gone again when the condition runs at the bottom
     pop_scope(&out->scopes);
+    if (!generate_branch(tree, st->while_st.cond, true, body, out, strs, arena)) return false;
+    ir_push_label(&out->body, over, arena);
     return true;
 }
 static bool generate_asm_st(const AstRoot *tree, Function *out, const AstStatement *st, StringPool *strs,
                             Arena *arena) {
     (void) strs;
-    (void) tree;
-    Statement s = {.type = ST_ASM, .asm = st->asm};
+    Statement s = {.type = ST_ASM, .asm = ir_push_name(out, ast_name(&tree->ast, st->asm), arena)};
     da_push(&out->body, s, arena);
     return true;
 }
@@ -2,11 +2,13 @@
 #define SSA_H_
 
 #include "../../frontend/parser.h"
+#include <assert.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 typedef enum {
+    VT_NONE,
     VT_CONST,
     VT_TEMP,
     VT_ARG,
@@ -14,17 +16,16 @@ typedef enum {
 } ValueType;
 
 typedef uint64_t ConstValue;
-typedef uint64_t TempValueIndex;
+typedef uint32_t TempValueIndex;
+typedef uint32_t IrLabel;
+typedef uint32_t IrCallId;
+typedef uint32_t IrNameId;
 
+// 32-bit operand reference
+// `index` is the temp, the argument, the string (str%zu in the data section) or the slot in `Function.consts`
 typedef struct {
-    ValueType type;
-    union {
-        ConstValue constant;
-        TempValueIndex temp;
-        // strings will be in the data section like this
-        // str%zu... db ..., 0
-        uint64_t string_index, arg_index;
-    };
+    ValueType type : 3;
+    uint32_t index : 29;
 } Value;
 
 typedef enum {
@@ -34,12 +35,23 @@ typedef enum {
     ST_SUB,
     ST_MUL,
     ST_DIV,
+    // comparisons produce 1 or 0, operands are compared as unsigned
+    ST_EQ,
+    ST_NE,
+    ST_LT,
+    ST_LE,
+    ST_GT,
+    ST_GE,
     ST_ASSIGN,
     ST_CALL,
     ST_LABEL,
     ST_JZ,
     ST_JMP,
     ST_ASM,
+    // only exists between `to_ssa` and `from_ssa`, always right after the label of its block
+    ST_PHI,
+    // `result = cond != 0 ? a : b` without a branch, both values are computed either way
+    ST_SELECT,
 } StatementType;
 
 typedef struct {
@@ -48,8 +60,10 @@ typedef struct {
     size_t capacity;
 } InputArgs;
 
+// Fixed 16-byte instruction, everything that doesn't fit in three 32-bit operands lives in the side tables of
+// `Function`
 typedef struct {
-    StatementType type;
+    StatementType type : 8;
     union {
         struct {
             Value value;
@@ -64,20 +78,70 @@ typedef struct {
             Value value;
         } assign;
         struct {
-            StringView name;
-            bool returns;
+            // VT_NONE if the result is unused
             Value return_v;
-            InputArgs args;
+            IrCallId id;
         } call;
         struct {
             Value cond;
-            uint64_t to;
+            IrLabel to;
         } jz;
-        uint64_t jmp, label;
-        StringView asm;
+        IrLabel jmp, label;
+        IrNameId asm;
+        struct {
+            Value result;
+            // `args_count` entries starting at `Function.phi_args[args_begin]`
+            uint32_t args_begin;
+            uint32_t args_count;
+        } phi;
+        struct {
+            Value result;
+            Value cond;
+            // the value for a nonzero `cond` at `Function.call_args[args_begin]`, the one for zero right after it
+            uint32_t args_begin;
+        } select;
     };
 } Statement;
 
+static_assert(sizeof(Statement) == 16, "Statements are meant to stay 16 bytes");
+
+typedef struct {
+    IrNameId name;
+    // `args_count` operands starting at `Function.call_args[args_begin]`
+    uint32_t args_begin;
+    uint32_t args_count;
+} IrCall;
+
+typedef struct {
+    IrCall *items;
+    size_t count;
+    size_t capacity;
+} IrCalls;
+
+typedef struct {
+    ConstValue *items;
+    size_t count;
+    size_t capacity;
+} IrConsts;
+
+// The value a phi takes when control comes from the block labeled `pred`
+typedef struct {
+    IrLabel pred;
+    Value value;
+} IrPhiArg;
+
+typedef struct {
+    IrPhiArg *items;
+    size_t count;
+    size_t capacity;
+} IrPhiArgs;
+
+typedef struct {
+    StringView *items;
+    size_t count;
+    size_t capacity;
+} StringPool;
+
 typedef struct {
     Statement *items;
     size_t count;
@@ -106,13 +170,103 @@ void pop_scope(ScopeStack *stack);
 bool define_sym(ScopeStack *stack, StringView name, Value value, Arena *arena);
 bool lookup_sym(ScopeStack *stack, StringView name, Sym **out_value);
 
+// Pending node of `generate_expr`, `expanded` is set once its operands have been queued
+typedef struct {
+    AstExprId expr;
+    bool expanded;
+    // `&&` and `||` lower their right side on its own, after the left one has decided whether it runs at all
+    bool right;
+    Value result;
+    IrLabel skip;
+} ExprWork;
+
+typedef struct {
+    ExprWork *items;
+    size_t count;
+    size_t capacity;
+} ExprWorkStack;
+
+// Pending piece of `generate_branch`: either jump to `target` if `expr` is `when`, or place the label `target`
+typedef struct {
+    AstExprId expr;
+    bool is_label;
+    bool when;
+    IrLabel target;
+} BranchWork;
+
+typedef struct {
+    BranchWork *items;
+    size_t count;
+    size_t capacity;
+} BranchWorkStack;
+
+typedef uint32_t BlockId;
+
+typedef struct {
+    BlockId *items;
+    size_t count;
+    size_t capacity;
+} BlockIds;
+
+// Maximal run of statements that is only entered at the top and only left at the bottom
+typedef struct {
+    // statements [begin, end) of the function body
+    uint32_t begin;
+    uint32_t end;
+    BlockIds preds;
+    // a conditional jump has the fall through edge first and the taken one second
+    BlockIds succs;
+    // position in `Cfg.rpo`, BLOCK_UNREACHABLE if the entry can't reach this block
+    uint32_t rpo_index;
+    // filled by `cfg_compute_dominators`, BLOCK_UNREACHABLE for the entry and unreachable blocks
+    BlockId idom;
+    BlockIds dom_children;
+} BasicBlock;
+
+#define BLOCK_UNREACHABLE UINT32_MAX
+
+typedef struct {
+    BasicBlock *items;
+    size_t count;
+    size_t capacity;
+} BasicBlocks;
+
+// Block 0 is the entry, a block without successors leaves the function
+// Empty until `cfg_build` runs, and stale once a pass edits the body (passes rebuild it before use)
+// Rebuilding reuses every array of the previous build, passes rebuild once per loop and the arena never frees
+typedef struct {
+    BasicBlocks blocks;
+    // reachable blocks in reverse postorder
+    BlockIds rpo;
+    // block that starts with label `l`, indexed by the label
+    BlockIds label_blocks;
+    // `blocks.items[0..block_slots)` own their edge arrays, also past `blocks.count` after a smaller rebuild
+    size_t block_slots;
+    // stack of the DFS that numbers the blocks
+    BlockIds dfs;
+} Cfg;
+
 typedef struct {
     StringView name;
     size_t arg_count;
     FunctionBody body;
+    // storage of the body before the last rebuild, the next one reuses it (see `ir_begin_body`)
+    FunctionBody spare_body;
+    Cfg cfg;
+    // side tables of `body`
+    IrConsts consts;
+    IrCalls calls;
+    InputArgs call_args;
+    IrPhiArgs phi_args;
+    // callee names and asm text
+    StringPool names;
     ScopeStack scopes;
+    // scratch stacks of `generate_expr` and `generate_branch`, which lower expressions without recursing
+    ExprWorkStack expr_work;
+    InputArgs expr_values;
+    BranchWorkStack branch_work;
     size_t max_temps;
-    uint64_t label_count;
+    IrLabel label_count;
 } Function;
 
 typedef struct {
@@ -121,24 +275,75 @@ typedef struct {
     size_t capacity;
 } Functions;
 
-typedef struct {
-    StringView *items;
-    size_t count;
-    size_t capacity;
-} StringPool;
-
 typedef struct {
     Functions functions;
     StringPool strings;
 } Module;
 
+// Inline asm may depend on the exact stack layout and registers, so passes leave these functions alone
+bool function_has_asm(const Function *f);
+
+typedef struct {
+    Value **items;
+    size_t count;
+    size_t capacity;
+} ValueRefs;
+
+// Collects pointers to every value `st` reads into `out` (cleared first), call and phi arguments included
+// The pointers are only valid until the next push into one of the side tables of `f`
+void statement_uses(Function *f, Statement *st, ValueRefs *out, Arena *arena);
+// The temp `st` writes, NULL if it doesn't write one (assignments to arguments included)
+Value *statement_def(Statement *st);
+// true for ST_EQ through ST_GE, which write 1 or 0
+bool statement_is_comparison(StatementType type);
+// The comparison that is true exactly when `type` is false
+StatementType negate_comparison(StatementType type);
+
+Value ir_const(Function *f, ConstValue c, Arena *arena);
+ConstValue ir_const_value(const Function *f, Value v);
+IrNameId ir_push_name(Function *f, StringView name, Arena *arena);
+StringView ir_name(const Function *f, IrNameId id);
+const IrCall *ir_call(const Function *f, IrCallId id);
+// Adds a call to `name`, copying the arguments into the side table so they stay contiguous
+IrCallId ir_push_call(Function *f, StringView name, const Value *args, size_t count, Arena *arena);
+// The argument at `index` of `call`
+Value ir_call_arg(const Function *f, const IrCall *call, size_t index);
+// true if `a` and `b` are the same place, or constants with the same value
+bool ir_values_equal(const Function *f, Value a, Value b);
+// A temp nothing writes yet
+Value ir_new_temp(Function *f);
+/*
+ * An empty body with room for `size` statements, for a pass to rebuild the body of `f` in (one at a time)
+ * It lives in the storage of the body the last `ir_replace_body` replaced, so once the body stops growing passes
+ * rebuild it without costing the arena anything, a rebuild that gets dropped leaves the storage to the next one
+ */
+FunctionBody ir_begin_body(Function *f, size_t size, Arena *arena);
+// Makes `body` (from `ir_begin_body`) the body of `f`, the old body is what the next `ir_begin_body` reuses
+void ir_replace_body(Function *f, FunctionBody body);
+// Builders that append one statement to `body`, which doesn't have to be the body of a function yet
+Value ir_push_binop(FunctionBody *body, StatementType type, Value l, Value r, Value result, Arena *arena);
+void ir_push_assign(FunctionBody *body, Value place, Value value, Arena *arena);
+void ir_push_label(FunctionBody *body, IrLabel label, Arena *arena);
+void ir_push_jz(FunctionBody *body, Value cond, IrLabel to, Arena *arena);
+// `result = cond ? if_true : if_false`, with both values in the side table of the call arguments
+Statement ir_select(Function *f, Value result, Value cond, Value if_true, Value if_false, Arena *arena);
+// The value `select` takes when its condition is nonzero (`when` true) or zero
+Value ir_select_value(const Function *f, const Statement *select, bool when);
+
 void dump_ir(const Module *mod);
 
 bool generate_module(const AstRoot *ast, Module *out, Arena *arena);
 bool generate_function(Function *out, const AstFunction *ast_func, Arena *arena, StringPool *strs,
                            const AstRoot *tree);
-bool generate_statement(const AstRoot *tree, const AstStatement *st, Function *out, StringPool *strs, Arena *arena);
-bool generate_expr(const AstRoot *tree, const AstExpression *expr, Value *out_value, Function *out,
-                       StringPool *strs, Arena *arena);
+bool generate_statement(const AstRoot *tree, AstStmtId st, Function *out, StringPool *strs, Arena *arena);
+bool generate_expr(const AstRoot *tree, AstExprId expr, Value *out_value, Function *out, StringPool *strs,
+                   Arena *arena);
+/*
+ * Lowers the condition `expr` into jumps: to `target` if it is `when` (nonzero for true), falling through otherwise
+ * `&&`, `||` and `!` become chains of jumps, so their operands only run while the outcome is still open and no
+ * 0 or 1 gets computed for them
+ */
+bool generate_branch(const AstRoot *tree, AstExprId expr, bool when, IrLabel target, Function *out, StringPool *strs,
+                     Arena *arena);
 
 #endif
@@ -0,0 +1,402 @@
+#include "ssa_form.h"
+#include "../../util.h"
+#include "cfg.h"
+
+#define NOT_A_VARIABLE UINT32_MAX
+#define NO_LINK UINT32_MAX
+
+typedef struct {
+    uint32_t *items;
+    size_t count;
+    size_t capacity;
+} Indices;
+
+// Many small lists in one array, each is the index of its last entry, which links to the one added before it
+// One array instead of one per variable or block keeps large functions from costing the arena a lot of them
+typedef struct {
+    uint32_t value;
+    uint32_t next;
+} Link;
+
+typedef struct {
+    Link *items;
+    size_t count;
+    size_t capacity;
+} Links;
+
+// A name of a variable during renaming, `prev` is the one it had before (NO_LINK if none)
+typedef struct {
+    Value value;
+    uint32_t var;
+    uint32_t prev;
+} Name;
+
+typedef struct {
+    Name *items;
+    size_t count;
+    size_t capacity;
+} Names;
+
+typedef struct {
+    BlockId block;
+    bool exit;
+} RenameWork;
+
+typedef struct {
+    RenameWork *items;
+    size_t count;
+    size_t capacity;
+} RenameStack;
+
+static uint32_t *alloc_filled(Arena *arena, size_t count, uint32_t fill) {
+    uint32_t *items = arena_alloc(arena, sizeof(*items) * (count + 1));
+    for (size_t i = 0; i < count; i++) items[i] = fill;
+    return items;
+}
+
+static void push_index(Indices *list, uint32_t index, Arena *arena) { da_push(list, index, arena); }
+
+static void push_link(Links *links, uint32_t *list, uint32_t value, Arena *arena) {
+    Link link = {.value = value, .next = *list};
+    da_push(links, link, arena);
+    *list = links->count - 1;
+}
+
+static void ensure_terminator(FunctionBody *body, Arena *arena) {
+    if (body->count == 0 || statement_falls_through(body->items[body->count - 1].type)) {
+        da_push(body, (Statement){.type = ST_RETURN_EMPTY}, arena);
+    }
+}
+
+// Every reachable block starts with a label, the entry has no predecessors, the body ends in a terminator
+// and arguments are only read once, at the entry
+static void normalize(Function *f, Arena *arena) {
+    cfg_build(f, arena);
+
+    uint32_t *arg_temps = alloc_filled(arena, f->arg_count, 0);
+    // a label for every block and the entry, the copies of the arguments and a terminator
+    FunctionBody body = ir_begin_body(f, f->body.count + f->cfg.blocks.count + f->arg_count + 2, arena);
+    ir_push_label(&body, f->label_count++, arena);
+    for (size_t i = 0; i < f->arg_count; i++) {
+        arg_temps[i] = f->max_temps++;
+        Value arg = {.type = VT_ARG, .index = i};
+        ir_push_assign(&body, (Value){.type = VT_TEMP, .index = arg_temps[i]}, arg, arena);
+    }
+
+    ValueRefs uses = {0};
+    for (BlockId b = 0; b < f->cfg.blocks.count; b++) {
+        const BasicBlock *block = &f->cfg.blocks.items[b];
+        if (block->rpo_index == BLOCK_UNREACHABLE) continue;
+        // the old entry block can only be reached by falling into it when it has no label
+        if (b != 0 && (block->begin == block->end || f->body.items[block->begin].type != ST_LABEL)) {
+            ir_push_label(&body, f->label_count++, arena);
+        }
+        for (size_t i = block->begin; i < block->end; i++) {
+            Statement st = f->body.items[i];
+            statement_uses(f, &st, &uses, arena);
+            for (size_t j = 0; j < uses.count; j++) {
+                if (uses.items[j]->type == VT_ARG) *uses.items[j] = (Value){.type = VT_TEMP, .index = arg_temps[uses.items[j]->index]};
+            }
+            if (st.type == ST_ASSIGN && st.assign.place.type == VT_ARG) {
+                st.assign.place = (Value){.type = VT_TEMP, .index = arg_temps[st.assign.place.index]};
+            }
+            da_push(&body, st, arena);
+        }
+    }
+    ensure_terminator(&body, arena);
+
+    ir_replace_body(f, body);
+    cfg_build(f, arena);
+}
+
+void to_ssa(Function *f, Arena *arena) {
+    normalize(f, arena);
+    cfg_compute_dominators(f, arena);
+    size_t block_count = f->cfg.blocks.count;
+
+    // variables are the temps written by assignments, everything else is written exactly once already
+    size_t temp_limit = f->max_temps;
+    uint32_t *var_of = alloc_filled(arena, temp_limit, NOT_A_VARIABLE);
+    Indices var_temps = {0};
+    for (size_t i = 0; i < f->body.count; i++) {
+        const Statement *st = &f->body.items[i];
+        if (st->type != ST_ASSIGN || st->assign.place.type != VT_TEMP) continue;
+        if (var_of[st->assign.place.index] != NOT_A_VARIABLE) continue;
+        var_of[st->assign.place.index] = var_temps.count;
+        push_index(&var_temps, st->assign.place.index, arena);
+    }
+    size_t var_count = var_temps.count;
+
+    // only variables that are read in a block before that block writes them can need a phi
+    bool *global = arena_alloc_zeroed(arena, sizeof(*global) * var_count);
+    uint32_t *written_in = alloc_filled(arena, var_count, BLOCK_UNREACHABLE);
+    // the blocks that write each variable, and the dominance frontier of each block, in `links`
+    Links links = {0};
+    uint32_t *defsites = alloc_filled(arena, var_count, NO_LINK);
+    ValueRefs uses = {0};
+    for (BlockId b = 0; b < block_count; b++) {
+        const BasicBlock *block = &f->cfg.blocks.items[b];
+        for (size_t i = block->begin; i < block->end; i++) {
+            Statement *st = &f->body.items[i];
+            statement_uses(f, st, &uses, arena);
+            for (size_t j = 0; j < uses.count; j++) {
+                Value v = *uses.items[j];
+                if (v.type == VT_TEMP && var_of[v.index] != NOT_A_VARIABLE && written_in[var_of[v.index]] != b) {
+                    global[var_of[v.index]] = true;
+                }
+            }
+            if (st->type != ST_ASSIGN || st->assign.place.type != VT_TEMP) continue;
+            uint32_t var = var_of[st->assign.place.index];
+            if (written_in[var] != b) push_link(&links, &defsites[var], b, arena);
+            written_in[var] = b;
+        }
+    }
+
+    uint32_t *frontiers = alloc_filled(arena, block_count, NO_LINK);
+    for (BlockId b = 0; b < block_count; b++) {
+        const BasicBlock *block = &f->cfg.blocks.items[b];
+        if (block->preds.count < 2) continue;
+        for (size_t j = 0; j < block->preds.count; j++) {
+            for (BlockId runner = block->preds.items[j]; runner != block->idom; runner = f->cfg.blocks.items[runner].idom) {
+                uint32_t *df = &frontiers[runner];
+                if (*df == NO_LINK || links.items[*df].value != b) push_link(&links, df, b, arena);
+            }
+        }
+    }
+
+    // phi placement over the iterated dominance frontier, stamped with the variable to avoid clearing
+    Indices *block_phis = arena_alloc_zeroed(arena, sizeof(*block_phis) * block_count);
+    uint32_t *has_phi = alloc_filled(arena, block_count, NOT_A_VARIABLE);
+    uint32_t *queued = alloc_filled(arena, block_count, NOT_A_VARIABLE);
+    Indices work = {0};
+    size_t phi_count = 0;
+    for (uint32_t var = 0; var < var_count; var++) {
+        if (!global[var]) continue;
+        for (uint32_t l = defsites[var]; l != NO_LINK; l = links.items[l].next) {
+            queued[links.items[l].value] = var;
+            push_index(&work, links.items[l].value, arena);
+        }
+        while (work.count > 0) {
+            BlockId b = work.items[--work.count];
+            for (uint32_t l = frontiers[b]; l != NO_LINK; l = links.items[l].next) {
+                BlockId d = links.items[l].value;
+                if (has_phi[d] == var) continue;
+                has_phi[d] = var;
+                push_index(&block_phis[d], var, arena);
+                phi_count++;
+                if (queued[d] != var) {
+                    queued[d] = var;
+                    push_index(&work, d, arena);
+                }
+            }
+        }
+    }
+
+    // phis go right after the label, their arguments start out undefined
+    Value undefined = ir_const(f, 0, arena);
+    FunctionBody body = ir_begin_body(f, f->body.count + phi_count, arena);
+    // the variable of every phi, by its index in the new body
+    uint32_t *phi_var = alloc_filled(arena, f->body.count + phi_count, NOT_A_VARIABLE);
+    for (BlockId b = 0; b < block_count; b++) {
+        const BasicBlock *block = &f->cfg.blocks.items[b];
+        da_push(&body, f->body.items[block->begin], arena);
+        for (size_t j = 0; j < block_phis[b].count; j++) {
+            uint32_t var = block_phis[b].items[j];
+            Statement phi = {
+                .type = ST_PHI,
+                .phi = {.result = {.type = VT_TEMP, .index = var_temps.items[var]},
+                        .args_begin = f->phi_args.count,
+                        .args_count = block->preds.count},
+            };
+            for (size_t k = 0; k < block->preds.count; k++) {
+                IrPhiArg arg = {.pred = cfg_block_label(f, block->preds.items[k]), .value = undefined};
+                da_push(&f->phi_args, arg, arena);
+            }
+            phi_var[body.count] = var;
+            da_push(&body, phi, arena);
+        }
+        for (size_t i = block->begin + 1; i < block->end; i++) {
+            da_push(&body, f->body.items[i], arena);
+        }
+    }
+    ir_replace_body(f, body);
+    cfg_build(f, arena);
+    cfg_compute_dominators(f, arena);
+
+    // renaming, walking the dominator tree with an explicit stack
+    // `names` holds the names of every variable, `current` the index of the latest one of each, leaving a block pops
+    // the ones it pushed and brings back the names they hid
+    Names names = {0};
+    uint32_t *current = alloc_filled(arena, var_count, NO_LINK);
+    uint32_t *defined_mark = alloc_filled(arena, block_count, 0);
+    RenameStack stack = {0};
+    da_push(&stack, ((RenameWork){.block = 0}), arena);
+    while (stack.count > 0) {
+        RenameWork item = stack.items[--stack.count];
+        BlockId b = item.block;
+        if (item.exit) {
+            while (names.count > defined_mark[b]) {
+                const Name *name = &names.items[--names.count];
+                current[name->var] = name->prev;
+            }
+            continue;
+        }
+        defined_mark[b] = names.count;
+        RenameWork leave = {.block = b, .exit = true};
+        da_push(&stack, leave, arena);
+
+        const BasicBlock *block = &f->cfg.blocks.items[b];
+        for (size_t i = block->begin; i < block->end; i++) {
+            Statement *st = &f->body.items[i];
+            uint32_t var = NOT_A_VARIABLE;
+            if (st->type == ST_PHI) {
+                var = phi_var[i];
+            } else {
+                statement_uses(f, st, &uses, arena);
+                for (size_t j = 0; j < uses.count; j++) {
+                    Value *v = uses.items[j];
+                    if (v->type != VT_TEMP || v->index >= temp_limit || var_of[v->index] == NOT_A_VARIABLE) continue;
+                    uint32_t name = current[var_of[v->index]];
+                    *v = name != NO_LINK ? names.items[name].value : undefined;
+                }
+                if (st->type == ST_ASSIGN && st->assign.place.type == VT_TEMP && st->assign.place.index < temp_limit) {
+                    var = var_of[st->assign.place.index];
+                }
+            }
+            if (var == NOT_A_VARIABLE) continue;
+
+            Value fresh = {.type = VT_TEMP, .index = f->max_temps++};
+            *statement_def(st) = fresh;
+            Name name = {.value = fresh, .var = var, .prev = current[var]};
+            da_push(&names, name, arena);
+            current[var] = names.count - 1;
+        }
+
+        IrLabel label = cfg_block_label(f, b);
+        for (size_t j = 0; j < block->succs.count; j++) {
+            const BasicBlock *succ = &f->cfg.blocks.items[block->succs.items[j]];
+            for (size_t i = succ->begin + 1; i < succ->end && f->body.items[i].type == ST_PHI; i++) {
+                const Statement *phi = &f->body.items[i];
+                uint32_t name = current[phi_var[i]];
+                for (size_t k = 0; k < phi->phi.args_count; k++) {
+                    IrPhiArg *arg = &f->phi_args.items[phi->phi.args_begin + k];
+                    if (arg->pred == label) arg->value = name != NO_LINK ? names.items[name].value : undefined;
+                }
+            }
+        }
+
+        for (size_t j = block->dom_children.count; j-- > 0;) {
+            RenameWork child = {.block = block->dom_children.items[j]};
+            da_push(&stack, child, arena);
+        }
+    }
+}
+
+static bool block_has_phis(const Function *f, BlockId b) {
+    const BasicBlock *block = &f->cfg.blocks.items[b];
+    return block->begin + 1 < block->end && f->body.items[block->begin + 1].type == ST_PHI;
+}
+
+// The copies that feed the phis of `to` when control comes from `from`
+static void push_phi_copies(const Function *f, BlockId from, BlockId to, const uint32_t *phi_temps,
+                            FunctionBody *body, Arena *arena) {
+    IrLabel label = cfg_block_label(f, from);
+    const BasicBlock *block = &f->cfg.blocks.items[to];
+    for (size_t i = block->begin + 1; i < block->end && f->body.items[i].type == ST_PHI; i++) {
+        const Statement *phi = &f->body.items[i];
+        for (size_t k = 0; k < phi->phi.args_count; k++) {
+            const IrPhiArg *arg = &f->phi_args.items[phi->phi.args_begin + k];
+            if (arg->pred != label) continue;
+            ir_push_assign(body, (Value){.type = VT_TEMP, .index = phi_temps[i]}, arg->value, arena);
+        }
+    }
+}
+
+void from_ssa(Function *f, Arena *arena) {
+    cfg_build(f, arena);
+
+    bool any_phi = false;
+    uint32_t *phi_temps = alloc_filled(arena, f->body.count, 0);
+    for (size_t i = 0; i < f->body.count; i++) {
+        if (f->body.items[i].type != ST_PHI) continue;
+        phi_temps[i] = f->max_temps++;
+        any_phi = true;
+    }
+    if (!any_phi) {
+        cfg_clear(&f->cfg);
+        return;
+    }
+
+    FunctionBody body = ir_begin_body(f, f->body.count, arena);
+    // blocks for the taken edges of conditional jumps, they go after the rest of the function
+    FunctionBody split = {0};
+    for (BlockId b = 0; b < f->cfg.blocks.count; b++) {
+        const BasicBlock *block = &f->cfg.blocks.items[b];
+        BlockId fallthrough = cfg_fallthrough(f, b);
+        for (size_t i = block->begin; i < block->end; i++) {
+            Statement st = f->body.items[i];
+            bool last = i + 1 == block->end;
+            if (st.type == ST_PHI) {
+                ir_push_assign(&body, st.phi.result, (Value){.type = VT_TEMP, .index = phi_temps[i]}, arena);
+                continue;
+            }
+            if (!last || (st.type != ST_JZ && st.type != ST_JMP)) {
+                da_push(&body, st, arena);
+                continue;
+            }
+
+            if (st.type == ST_JMP) {
+                BlockId target = f->cfg.label_blocks.items[st.jmp];
+                push_phi_copies(f, b, target, phi_temps, &body, arena);
+                da_push(&body, st, arena);
+                continue;
+            }
+
+            BlockId taken = f->cfg.label_blocks.items[st.jz.to];
+            if (taken == fallthrough) {
+                // both ways lead to the same block, and the copies don't touch the condition
+                push_phi_copies(f, b, taken, phi_temps, &body, arena);
+                da_push(&body, st, arena);
+                continue;
+            }
+            if (block_has_phis(f, taken) && taken <= b) {
+                // a jump back up is the bottom of a loop, the copies only write the phi temps of `taken`, which
+                // nothing on the other edge reads, so they can run before the jump and keep the loop at one branch
+                // They go in front of a comparison that feeds the jump too, the code generator fuses the two
+                const Statement *prev = i > block->begin ? &f->body.items[i - 1] : NULL;
+                bool feeds = prev != NULL && statement_is_comparison(prev->type) && st.jz.cond.type == VT_TEMP &&
+                             prev->binop.result.index == st.jz.cond.index;
+                if (feeds) body.count--;
+                push_phi_copies(f, b, taken, phi_temps, &body, arena);
+                if (feeds) {
+                    da_push(&body, *prev, arena);
+                }
+            } else if (block_has_phis(f, taken)) {
+                IrLabel edge = f->label_count++;
+                ir_push_label(&split, edge, arena);
+                push_phi_copies(f, b, taken, phi_temps, &split, arena);
+                Statement jmp = {.type = ST_JMP, .jmp = st.jz.to};
+                da_push(&split, jmp, arena);
+                st.jz.to = edge;
+            }
+            da_push(&body, st, arena);
+            if (block_has_phis(f, fallthrough)) {
+                ir_push_label(&body, f->label_count++, arena);
+                push_phi_copies(f, b, fallthrough, phi_temps, &body, arena);
+            }
+            fallthrough = BLOCK_UNREACHABLE;
+        }
+
+        const Statement *last = &f->body.items[block->end - 1];
+        if (last->type != ST_JZ && statement_falls_through(last->type) && fallthrough != BLOCK_UNREACHABLE) {
+            push_phi_copies(f, b, fallthrough, phi_temps, &body, arena);
+        }
+    }
+
+    if (split.count > 0) ensure_terminator(&body, arena);
+    for (size_t i = 0; i < split.count; i++) {
+        da_push(&body, split.items[i], arena);
+    }
+    ir_replace_body(f, body);
+    cfg_clear(&f->cfg);
+}
@@ -0,0 +1,24 @@
+#ifndef SSA_FORM_H_
+#define SSA_FORM_H_
+
+#include "ssa.h"
+
+/*
+ * Rewrites `f` into SSA form: every temp gets written by exactly one statement, and where different
+ * definitions of a variable meet an ST_PHI picks between them (Cytron et al., semi-pruned)
+ * Before that every block gets a label of its own (phi arguments name their predecessor by it), the entry
+ * gets a block without predecessors, unreachable blocks are dropped and the arguments are copied into temps
+ * Leaves `f->cfg` built, dominators included
+ */
+void to_ssa(Function *f, Arena *arena);
+
+/*
+ * Replaces every ST_PHI with copies: each predecessor copies its value into a fresh temp, and the block of
+ * the phi copies that temp into the result, which keeps swapped or lost copies from clobbering each other
+ * Edges that leave a conditional jump get a block of their own for their copies, except jumps back up to a loop
+ * header, whose copies go in front of the jump
+ * Leaves `f->cfg` stale
+ */
+void from_ssa(Function *f, Arena *arena);
+
+#endif
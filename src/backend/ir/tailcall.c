@@ -0,0 +1,46 @@
+#include "../../util.h"
+#include "cfg.h"
+#include "passes.h"
+
+static bool is_self_tail_call(const Function *f, size_t i) {
+    if (!statement_is_tail_call(f, i)) return false;
+    const IrCall *call = ir_call(f, f->body.items[i].call.id);
+    StringView name = ir_name(f, call->name);
+    return call->args_count == f->arg_count && name.count == f->name.count &&
+           strncmp(name.items, f->name.items, name.count) == 0;
+}
+
+bool eliminate_tail_recursion(Function *f, Arena *arena) {
+    bool found = false;
+    for (size_t i = 0; i < f->body.count && !found; i++) found = is_self_tail_call(f, i);
+    if (!found) return false;
+
+    // `to_ssa` copies the arguments into temps ahead of this label, so the loop it heads has phis for them
+    IrLabel entry = f->label_count++;
+    FunctionBody body = ir_begin_body(f, f->body.count + 1, arena);
+    Statement label = {.type = ST_LABEL, .label = entry};
+    da_push(&body, label, arena);
+    for (size_t i = 0; i < f->body.count; i++) {
+        if (!is_self_tail_call(f, i)) {
+            da_push(&body, f->body.items[i], arena);
+            continue;
+        }
+        // every new argument is computed from the old ones before any of them is overwritten
+        const IrCall *call = ir_call(f, f->body.items[i].call.id);
+        uint32_t first = f->max_temps;
+        f->max_temps += call->args_count;
+        for (size_t a = 0; a < call->args_count; a++) {
+            ir_push_assign(&body, (Value){.type = VT_TEMP, .index = first + a}, ir_call_arg(f, call, a), arena);
+        }
+        for (size_t a = 0; a < call->args_count; a++) {
+            Value arg = {.type = VT_ARG, .index = a};
+            ir_push_assign(&body, arg, (Value){.type = VT_TEMP, .index = first + a}, arena);
+        }
+        Statement jmp = {.type = ST_JMP, .jmp = entry};
+        da_push(&body, jmp, arena);
+        // the return after the call is dead now
+        if (i + 1 < f->body.count) i++;
+    }
+    ir_replace_body(f, body);
+    return true;
+}
@@ -0,0 +1,314 @@
+#include "../../util.h"
+#include "cfg.h"
+#include "passes.h"
+
+// Bodies repeated `factor` times stop growing past this many statements, a smaller factor is used instead
+#define UNROLL_STATEMENTS 64
+// A loop with a known trip count disappears if all its iterations fit in this many statements
+#define FULL_UNROLL_STATEMENTS 96
+
+// Loop that is a single block: the label at `head`, the statements after it and the jump back at `tail`
+// Its counter `iv` goes up by `step` once per iteration, after that the loop goes on while `iv op limit`
+typedef struct {
+    size_t head;
+    size_t tail;
+    Value iv;
+    ConstValue step;
+    StatementType op;
+    Value limit;
+} CountedLoop;
+
+static bool writes(const Function *f, Statement *st, Value v) {
+    // assignments to arguments don't count as a definition
+    if (st->type == ST_ASSIGN) return ir_values_equal(f, st->assign.place, v);
+    Value *d = statement_def(st);
+    return d != NULL && ir_values_equal(f, *d, v);
+}
+
+// The last statement in [begin, end) that writes `v`, `end` if none does
+static size_t last_write(Function *f, size_t begin, size_t end, Value v) {
+    for (size_t i = end; i-- > begin;) {
+        if (writes(f, &f->body.items[i], v)) return i;
+    }
+    return end;
+}
+
+// `a op b` turned around into `b op' a`
+static StatementType mirror_comparison(StatementType op) {
+    switch (op) {
+    case ST_LT: return ST_GT;
+    case ST_LE: return ST_GE;
+    case ST_GT: return ST_LT;
+    case ST_GE: return ST_LE;
+    default: return op;
+    }
+}
+
+static bool compare(StatementType op, ConstValue l, ConstValue r) {
+    switch (op) {
+    case ST_EQ: return l == r;
+    case ST_NE: return l != r;
+    case ST_LT: return l < r;
+    case ST_LE: return l <= r;
+    case ST_GT: return l > r;
+    case ST_GE: return l >= r;
+    default: UNREACHABLE("Not a comparison");
+    }
+    return false;
+}
+
+// Matches `x <- t` at `assign` with `t <- x + c` (or `x - c`) in front of it, the step is what it adds
+static bool constant_step(Function *f, size_t head, size_t assign, Value x, ConstValue *step) {
+    const Statement *st = &f->body.items[assign];
+    if (st->type != ST_ASSIGN || st->assign.value.type != VT_TEMP) return false;
+    size_t def = last_write(f, head + 1, assign, st->assign.value);
+    if (def == assign) return false;
+    const Statement *add = &f->body.items[def];
+    if (add->type == ST_ADD && ir_values_equal(f, add->binop.l, x) && add->binop.r.type == VT_CONST) {
+        *step = ir_const_value(f, add->binop.r);
+    } else if (add->type == ST_ADD && ir_values_equal(f, add->binop.r, x) && add->binop.l.type == VT_CONST) {
+        *step = ir_const_value(f, add->binop.l);
+    } else if (add->type == ST_SUB && ir_values_equal(f, add->binop.l, x) && add->binop.r.type == VT_CONST) {
+        *step = -ir_const_value(f, add->binop.r);
+    } else {
+        return false;
+    }
+    return *step != 0;
+}
+
+static bool find_counted_loop(Function *f, size_t tail, CountedLoop *out) {
+    const Statement *jz = &f->body.items[tail];
+    if (jz->type != ST_JZ || jz->jz.cond.type != VT_TEMP) return false;
+    size_t head = tail;
+    while (head-- > 0) {
+        StatementType type = f->body.items[head].type;
+        if (type == ST_LABEL || statement_ends_block(type)) break;
+    }
+    if (head == SIZE_MAX || f->body.items[head].type != ST_LABEL || f->body.items[head].label != jz->jz.to) {
+        return false;
+    }
+    // the jump back has to be the only way in besides falling through from the block in front
+    for (size_t i = 0; i < f->body.count; i++) {
+        const Statement *st = &f->body.items[i];
+        if (i == tail) continue;
+        if ((st->type == ST_JZ && st->jz.to == jz->jz.to) || (st->type == ST_JMP && st->jmp == jz->jz.to)) {
+            return false;
+        }
+    }
+
+    size_t cmp = last_write(f, head + 1, tail, jz->jz.cond);
+    if (cmp == tail || !statement_is_comparison(f->body.items[cmp].type)) return false;
+    const Statement *test = &f->body.items[cmp];
+    // the jump goes back while the comparison is false
+    StatementType op = negate_comparison(test->type);
+    for (int side = 0; side < 2; side++) {
+        Value iv = side == 0 ? test->binop.l : test->binop.r;
+        Value limit = side == 0 ? test->binop.r : test->binop.l;
+        if (iv.type != VT_TEMP && iv.type != VT_ARG) continue;
+        if (limit.type != VT_CONST && limit.type != VT_TEMP && limit.type != VT_ARG) continue;
+        if (limit.type != VT_CONST && last_write(f, head + 1, tail, limit) != tail) continue;
+
+        // the counter is written once, before the test reads it
+        size_t assign = last_write(f, head + 1, cmp, iv);
+        if (assign == cmp || last_write(f, head + 1, assign, iv) != assign) continue;
+        if (last_write(f, cmp, tail, iv) != tail) continue;
+        ConstValue step = 0;
+        if (!constant_step(f, head, assign, iv, &step)) continue;
+        *out = (CountedLoop){
+            .head = head,
+            .tail = tail,
+            .iv = iv,
+            .step = step,
+            .op = side == 0 ? op : mirror_comparison(op),
+            .limit = limit,
+        };
+        return true;
+    }
+    return false;
+}
+
+// The constant `v` holds when control falls into the loop, if the block in front of it sets one
+static bool entry_constant(Function *f, const CountedLoop *loop, Value v, ConstValue *out) {
+    if (v.type == VT_CONST) {
+        *out = ir_const_value(f, v);
+        return true;
+    }
+    for (size_t i = loop->head; i-- > 0;) {
+        Statement *st = &f->body.items[i];
+        // the jump that skips the loop can stay, anything else that ends a block means control comes from elsewhere
+        if (st->type == ST_LABEL || (statement_ends_block(st->type) && !(i + 1 == loop->head && st->type == ST_JZ))) {
+            return false;
+        }
+        if (!writes(f, st, v)) continue;
+        if (st->type != ST_ASSIGN || st->assign.value.type != VT_CONST) return false;
+        *out = ir_const_value(f, st->assign.value);
+        return true;
+    }
+    return false;
+}
+
+// How many times the body runs when it's entered, 0 if that's more than `max`
+static size_t trip_count(Function *f, const CountedLoop *loop, size_t max) {
+    ConstValue iv = 0, limit = 0;
+    if (!entry_constant(f, loop, loop->iv, &iv) || !entry_constant(f, loop, loop->limit, &limit)) return 0;
+    for (size_t trips = 1; trips <= max; trips++) {
+        iv += loop->step;
+        if (!compare(loop->op, iv, limit)) return trips;
+    }
+    return 0;
+}
+
+// Temps only the loop body reads, written once per iteration by a computation (everything else is a variable,
+// written by assignments), get fresh names in every copy so they stay written by a single statement
+typedef struct {
+    Function *f;
+    // indexed by temp, true for the places of assignments
+    bool *variable;
+    // indexed by temp, the name the current copy gave it
+    uint32_t *rename;
+    ValueRefs uses;
+    Arena *arena;
+} Unroller;
+
+static bool is_local(const Unroller *u, Value v) { return v.type == VT_TEMP && !u->variable[v.index]; }
+
+static Value renamed(const Unroller *u, Value v) {
+    if (is_local(u, v)) v.index = u->rename[v.index];
+    return v;
+}
+
+// false if something after the loop reads a temp the body computes, the copies would leave it stale
+static bool locals_stay_inside(Unroller *u, const CountedLoop *loop) {
+    Function *f = u->f;
+    bool *defined = arena_alloc(u->arena, sizeof(*defined) * (f->max_temps + 1));
+    memset(defined, 0, sizeof(*defined) * f->max_temps);
+    for (size_t i = loop->head + 1; i < loop->tail; i++) {
+        Value *d = statement_def(&f->body.items[i]);
+        if (d != NULL && is_local(u, *d)) defined[d->index] = true;
+    }
+    for (size_t i = 0; i < f->body.count; i++) {
+        if (i >= loop->head && i <= loop->tail) continue;
+        statement_uses(f, &f->body.items[i], &u->uses, u->arena);
+        for (size_t k = 0; k < u->uses.count; k++) {
+            if (is_local(u, *u->uses.items[k]) && defined[u->uses.items[k]->index]) return false;
+        }
+    }
+    return true;
+}
+
+// One iteration without the jump back
+static void push_iteration(Unroller *u, const CountedLoop *loop, FunctionBody *out) {
+    Function *f = u->f;
+    for (size_t i = loop->head + 1; i < loop->tail; i++) {
+        Statement st = f->body.items[i];
+        if (st.type == ST_CALL) {
+            // the arguments live in a side table, the copy needs a call of its own
+            const IrCall *call = ir_call(f, st.call.id);
+            Value *args = arena_alloc(u->arena, sizeof(*args) * (call->args_count + 1));
+            for (size_t a = 0; a < call->args_count; a++) args[a] = renamed(u, ir_call_arg(f, call, a));
+            st.call.id = ir_push_call(f, ir_name(f, call->name), args, call->args_count, u->arena);
+        } else {
+            statement_uses(f, &st, &u->uses, u->arena);
+            for (size_t k = 0; k < u->uses.count; k++) *u->uses.items[k] = renamed(u, *u->uses.items[k]);
+        }
+        Value *d = statement_def(&st);
+        if (d != NULL && is_local(u, *d)) {
+            u->rename[d->index] = f->max_temps++;
+            d->index = u->rename[d->index];
+        }
+        da_push(out, st, u->arena);
+    }
+}
+
+// The loop as it was runs the remaining iterations, in front of it goes one that runs `factor` of them per test
+// With `extra` = (factor - 1) * step, `iv < limit - extra` means the next `factor` iterations all run:
+//     if !(limit >= extra) goto rest
+//     bound = limit - extra
+//     if !(iv < bound) goto rest
+//   unrolled:
+//     `factor` iterations
+//     if iv < bound goto unrolled
+//     if !(iv < limit) goto done
+//   rest:
+//     the original loop
+//   done:
+static void push_partially_unrolled(Unroller *u, const CountedLoop *loop, size_t factor, FunctionBody *out) {
+    Function *f = u->f;
+    Arena *arena = u->arena;
+    IrLabel rest = f->body.items[loop->head].label;
+    IrLabel unrolled = f->label_count++;
+    IrLabel done = f->label_count++;
+    Value extra = ir_const(f, (factor - 1) * loop->step, arena);
+
+    // a constant limit was already checked, see `unroll_loops`
+    Value bound = ir_new_temp(f);
+    if (loop->limit.type != VT_CONST) {
+        Value enough = ir_new_temp(f);
+        ir_push_binop(out, ST_GE, loop->limit, extra, enough, arena);
+        ir_push_jz(out, enough, rest, arena);
+    }
+    ir_push_binop(out, ST_SUB, loop->limit, extra, bound, arena);
+    Value ahead = ir_new_temp(f);
+    ir_push_binop(out, ST_LT, loop->iv, bound, ahead, arena);
+    ir_push_jz(out, ahead, rest, arena);
+
+    ir_push_label(out, unrolled, arena);
+    for (size_t k = 0; k < factor; k++) push_iteration(u, loop, out);
+    // jumps back while the comparison is false
+    Value behind = ir_new_temp(f);
+    ir_push_binop(out, ST_GE, loop->iv, bound, behind, arena);
+    ir_push_jz(out, behind, unrolled, arena);
+
+    Value more = ir_new_temp(f);
+    ir_push_binop(out, ST_LT, loop->iv, loop->limit, more, arena);
+    ir_push_jz(out, more, done, arena);
+    for (size_t i = loop->head; i <= loop->tail; i++) {
+        da_push(out, f->body.items[i], arena);
+    }
+    ir_push_label(out, done, arena);
+}
+
+bool unroll_loops(Function *f, size_t factor, Arena *arena) {
+    if (factor < 2) return false;
+    Unroller u = {.f = f, .arena = arena};
+    u.variable = arena_alloc(arena, sizeof(*u.variable) * (f->max_temps + 1));
+    u.rename = arena_alloc(arena, sizeof(*u.rename) * (f->max_temps + 1));
+    memset(u.variable, 0, sizeof(*u.variable) * f->max_temps);
+    for (size_t t = 0; t < f->max_temps; t++) u.rename[t] = t;
+    for (size_t i = 0; i < f->body.count; i++) {
+        const Statement *st = &f->body.items[i];
+        if (st->type == ST_ASSIGN && st->assign.place.type == VT_TEMP) u.variable[st->assign.place.index] = true;
+    }
+
+    FunctionBody body = ir_begin_body(f, f->body.count, arena);
+    size_t copied = 0;
+    for (size_t tail = 0; tail < f->body.count; tail++) {
+        CountedLoop loop = {0};
+        if (!find_counted_loop(f, tail, &loop)) continue;
+        size_t size = loop.tail - loop.head - 1;
+        size_t trips = trip_count(f, &loop, FULL_UNROLL_STATEMENTS / size);
+        // an upward counter that stops at the limit is the only kind whose trips can be counted ahead at runtime
+        size_t ways = factor < UNROLL_STATEMENTS / size ? factor : UNROLL_STATEMENTS / size;
+        bool partial = trips == 0 && ways >= 2 && loop.op == ST_LT && loop.step <= UINT32_MAX;
+        // a constant limit too small for a single round of the unrolled loop leaves nothing to unroll
+        if (partial && loop.limit.type == VT_CONST) partial = ir_const_value(f, loop.limit) > (ways - 1) * loop.step;
+        if ((trips == 0 && !partial) || !locals_stay_inside(&u, &loop)) continue;
+
+        for (size_t i = copied; i < loop.head; i++) {
+            da_push(&body, f->body.items[i], arena);
+        }
+        if (partial) {
+            push_partially_unrolled(&u, &loop, ways, &body);
+        } else {
+            da_push(&body, f->body.items[loop.head], arena);
+            for (size_t k = 0; k < trips; k++) push_iteration(&u, &loop, &body);
+        }
+        copied = loop.tail + 1;
+    }
+    if (copied == 0) return false;
+    for (size_t i = copied; i < f->body.count; i++) {
+        da_push(&body, f->body.items[i], arena);
+    }
+    ir_replace_body(f, body);
+    return true;
+}
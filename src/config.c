@@ -1,4 +1,5 @@
 #include "config.h"
+#include "backend/ir/opt.h"
 #include "log.h"
 #include "target.h"
 #include "util.h"
@@ -18,6 +19,8 @@ bool parse_config(Config *conf, int argc, char **argv, Arena *arena) {
     argc--;
     argv++;
     find_target(&conf->target, target_enum_to_str(default_target));
+    conf->opt_level = OPT_LEVEL_DEFAULT;
+    conf->unroll_factor = UNROLL_FACTOR_DEFAULT;
 
     while (argc > 0) {
         if (strcmp(*argv, "-o") == 0) {
@@ -62,6 +65,34 @@ bool parse_config(Config *conf, int argc, char **argv, Arena *arena) {
             conf->dump_ir = true;
             argc--;
             argv++;
+        } else if (strcmp(*argv, "-no-opt") == 0) {
+            conf->opt_level = 0;
+            argc--;
+            argv++;
+        } else if (strncmp(*argv, "-O", 2) == 0) {
+            char *end = NULL;
+            conf->opt_level = strtoull(*argv + 2, &end, 10);
+            if (end == *argv + 2 || *end != 0 || conf->opt_level > OPT_LEVEL_MAX) {
+                log_diagnostic(LL_ERROR, "Invalid optimization level %s (expected -O0 to -O%d)", *argv, OPT_LEVEL_MAX);
+                return false;
+            }
+            argc--;
+            argv++;
+        } else if (strcmp(*argv, "-unroll") == 0) {
+            argc--;
+            argv++;
+            char *end = NULL;
+            if (argc > 0) conf->unroll_factor = strtoull(*argv, &end, 10);
+            if (argc <= 0 || end == *argv || *end != 0 || conf->unroll_factor > UNROLL_FACTOR_MAX) {
+                log_diagnostic(LL_ERROR, "Expected an unroll factor from 0 to %d", UNROLL_FACTOR_MAX);
+                return false;
+            }
+            argc--;
+            argv++;
+        } else if (strcmp(*argv, "-rdtsc") == 0) {
+            conf->target_options.rdtsc = true;
+            argc--;
+            argv++;
         } else {
             if (**argv == '-') {
                 log_diagnostic(LL_ERROR, "Unknown flag supplied");
@@ -82,6 +113,8 @@ bool parse_config(Config *conf, int argc, char **argv, Arena *arena) {
         return false;
     }
 
+    conf->target_options.opt_level = conf->opt_level;
+
     if (conf->output_name == NULL) {
         size_t len = strlen(conf->input_name) - 3;
         conf->output_name = arena_alloc(arena, sizeof(char) * (len + 1));
@@ -100,7 +133,12 @@ void usage(char *program_name) {
     log_diagnostic(LL_INFO, "    -help           : Show this help message");
     log_diagnostic(LL_INFO, "    -o              : Customize the output file name (format: -o <name>)");
     log_diagnostic(LL_INFO, "    -keep-artifacts : Keep the build artifacts (.asm, .o files)");
-    log_diagnostic(LL_INFO, "    -no-opt         : Don't optimize the code");
+    log_diagnostic(LL_INFO, "    -no-opt         : Don't optimize the code (same as -O0)");
+    log_diagnostic(LL_INFO, "    -O<LEVEL>       : Set the optimization level (0 to %d, default: %d)", OPT_LEVEL_MAX,
+                   OPT_LEVEL_DEFAULT);
+    log_diagnostic(LL_INFO, "    -unroll <N>     : Unroll counted loops N times at -O2 (0 to %d, default: %d)",
+                   UNROLL_FACTOR_MAX, UNROLL_FACTOR_DEFAULT);
+    log_diagnostic(LL_INFO, "    -rdtsc          : Time `main` with rdtsc and write the cycle count to fd 3");
     log_diagnostic(LL_INFO, "    -target <TARGET>: Select the target");
     log_diagnostic(LL_INFO, "    -list-targets   : List available targets");
     log_diagnostic(LL_INFO, "    -ir             : Dump the IR");
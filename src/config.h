@@ -12,6 +12,11 @@ typedef struct {
     bool should_free_output_name;
     bool keep_build_artifacts;
     bool dump_ir;
+    // 0 disables every IR pass, see `optimize_module`
+    size_t opt_level;
+    // how many iterations an unrolled loop runs per test at -O2, see `unroll_loops`
+    size_t unroll_factor;
+    TargetOptions target_options;
 } Config;
 
 bool parse_config(Config *conf, int argc, char **argv, Arena* arena);
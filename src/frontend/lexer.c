@@ -13,6 +13,12 @@ static const OperatorType char_to_op[] = {
     ['/'] = OT_DIV,
 };
 
+static void lex_operator(Lexer *lexer, Tokens *out, OperatorType op, size_t len) {
+    Token t = {.type = TT_OPERATOR, .len = len, .begin = lexer->file.src.items, .operator= op};
+    da_push(out, t, lexer->arena);
+    for (size_t i = 0; i < len; i++) lexer_consume(lexer);
+}
+
 static void lex_single_char(Lexer *lexer, Tokens *out, TokenType new) {
     Token t = {.len = 1, .begin = lexer->file.src.items, .type = new};
     da_push(out, t, lexer->arena);
@@ -45,18 +51,42 @@ bool lexer_run(Lexer *lexer, Tokens *out) {
         case '+':
         case '-':
         case '*':
-        case '/': {
-            Token t = {0};
-            t.type = TT_OPERATOR;
-            t.len = 1;
-            t.begin = lexer->file.src.items;
-            t.operator= char_to_op[(size_t)lexer_peek(lexer, 0)];
-            da_push(out, t, lexer->arena);
+        case '/': lex_operator(lexer, out, char_to_op[(size_t)lexer_peek(lexer, 0)], 1); continue;
+        case '=': {
+            if (lexer->file.src.count > 1 && lexer_peek(lexer, 1) == '=') {
+                lex_operator(lexer, out, OT_EQ, 2);
+            } else {
+                lex_single_char(lexer, out, TT_ASSIGN);
+            }
+            continue;
+        }
+        case '!': {
+            bool eq = lexer->file.src.count > 1 && lexer_peek(lexer, 1) == '=';
+            lex_operator(lexer, out, eq ? OT_NE : OT_NOT, eq ? 2 : 1);
+            continue;
+        }
+        case '&':
+        case '|': {
+            char c = lexer_peek(lexer, 0);
+            if (lexer->file.src.count > 1 && lexer_peek(lexer, 1) == c) {
+                lex_operator(lexer, out, c == '&' ? OT_AND : OT_OR, 2);
+                continue;
+            }
+            log_diagnostic(LL_INFO, "Don't know some letter skipping for sake of asm");
             lexer_consume(lexer);
             continue;
         }
+        case '<': {
+            bool eq = lexer->file.src.count > 1 && lexer_peek(lexer, 1) == '=';
+            lex_operator(lexer, out, eq ? OT_LE : OT_LT, eq ? 2 : 1);
+            continue;
+        }
+        case '>': {
+            bool eq = lexer->file.src.count > 1 && lexer_peek(lexer, 1) == '=';
+            lex_operator(lexer, out, eq ? OT_GE : OT_GT, eq ? 2 : 1);
+            continue;
+        }
         case ';': lex_single_char(lexer, out, TT_SEMICOLON); continue;
-        case '=': lex_single_char(lexer, out, TT_ASSIGN); continue;
         case '{': lex_single_char(lexer, out, TT_OPEN_CURLY); continue;
         case '}': lex_single_char(lexer, out, TT_CLOSE_CURLY); continue;
         case '(': lex_single_char(lexer, out, TT_OPEN_PAREN); continue;
@@ -33,6 +33,15 @@ typedef enum {
     OT_MINUS,
     OT_MULT,
     OT_DIV,
+    OT_EQ,
+    OT_NE,
+    OT_LT,
+    OT_LE,
+    OT_GT,
+    OT_GE,
+    OT_AND,
+    OT_OR,
+    OT_NOT,
 } OperatorType;
 
 typedef enum {
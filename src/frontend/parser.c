@@ -3,11 +3,95 @@
 #include "../util.h"
 #include "lexer.h"
 
+AstExpression *ast_expr(const Ast *ast, AstExprId id) {
+    ASSERT(id < ast->exprs.count, "Invalid expression id %u", id);
+    return &ast->exprs.items[id];
+}
+
+AstStatement *ast_stmt(const Ast *ast, AstStmtId id) {
+    ASSERT(id < ast->stmts.count, "Invalid statement id %u", id);
+    return &ast->stmts.items[id];
+}
+
+AstCall *ast_call(const Ast *ast, AstPayloadId id) {
+    ASSERT(id < ast->calls.count, "Invalid call id %u", id);
+    return &ast->calls.items[id];
+}
+
+StringView ast_name(const Ast *ast, AstPayloadId id) {
+    ASSERT(id < ast->names.count, "Invalid name id %u", id);
+    return ast->names.items[id];
+}
+
+uint64_t ast_number(const Ast *ast, AstPayloadId id) {
+    ASSERT(id < ast->numbers.count, "Invalid number id %u", id);
+    return ast->numbers.items[id];
+}
+
+uint32_t ast_ref(const Ast *ast, AstRange range, size_t index) {
+    ASSERT(index < range.count, "Index out of the range");
+    return ast->refs.items[range.begin + index];
+}
+
+static AstExprId push_expr(Parser *parser, AstExpression expr) {
+    da_push(&parser->ast->exprs, expr, parser->arena);
+    return parser->ast->exprs.count - 1;
+}
+
+static AstStmtId push_stmt(Parser *parser, AstStatement st) {
+    da_push(&parser->ast->stmts, st, parser->arena);
+    return parser->ast->stmts.count - 1;
+}
+
+static AstPayloadId push_name(Parser *parser, StringView name) {
+    da_push(&parser->ast->names, name, parser->arena);
+    return parser->ast->names.count - 1;
+}
+
+static AstPayloadId push_number(Parser *parser, uint64_t number) {
+    da_push(&parser->ast->numbers, number, parser->arena);
+    return parser->ast->numbers.count - 1;
+}
+
+// Moves everything above `mark` in the scratch stack into `refs`
+static AstRange flush_scratch(Parser *parser, size_t mark) {
+    AstRange range = {.begin = parser->ast->refs.count, .count = parser->scratch.count - mark};
+    for (size_t i = mark; i < parser->scratch.count; i++) {
+        da_push(&parser->ast->refs, parser->scratch.items[i], parser->arena);
+    }
+    parser->scratch.count = mark;
+    return range;
+}
+
+static uint32_t source_offset(const Parser *parser, const char *ptr) {
+    ASSERT(parser->origin.src.items <= ptr, "The pointer has to point into the source");
+    return ptr - parser->origin.src.items;
+}
+
+// Parses `(arg, arg, ...)` after the name of a called function, the opening paren is already consumed
+static bool parse_call_args(Parser *parser, AstRange *out) {
+    size_t mark = parser->scratch.count;
+    while (!parser_is_empty(parser) && parser_peek(parser, 0).type != TT_CLOSE_PAREN) {
+        AstExprId arg = 0;
+        if (!parser_parse_expr(parser, &arg)) return false;
+        da_push(&parser->scratch, arg, parser->arena);
+        if (!parser_expect_and_skip(parser, TT_COMMA)) break;
+    }
+    *out = flush_scratch(parser, mark);
+    if (!parser_expect_and_skip(parser, TT_CLOSE_PAREN)) {
+        log_diagnostic(LL_ERROR, "Argument list wasn't terminated with a `)`");
+        report_error(parser->last_token.begin, parser->origin.src.items, parser->origin.name);
+        return false;
+    }
+    return true;
+}
+
 bool parser_parse(Parser *parser, AstRoot *out) {
     ASSERT(parser, "Uh oh");
     ASSERT(out, "Uh oh");
 
     out->source = parser->origin;
+    parser->ast = &out->ast;
 
     while (!parser_is_empty(parser)) {
         Token t = parser_pop(parser);
@@ -67,18 +151,20 @@ bool parser_parse(Parser *parser, AstRoot *out) {
     return true;
 }
 
-bool parser_parse_block(Parser *parser, AstBlock *out) {
+bool parser_parse_block(Parser *parser, AstRange *out) {
     if (!parser_expect_and_skip(parser, TT_OPEN_CURLY)) {
         log_diagnostic(LL_ERROR, "Expected a `{` to begin a block");
         report_error(parser->last_token.begin,
                      parser->origin.src.items, parser->origin.name);
         return false;
     }
+    size_t mark = parser->scratch.count;
     while (!parser_is_empty(parser) && parser_peek(parser, 0).type != TT_CLOSE_CURLY) {
-        AstStatement st = {0};
+        AstStmtId st = 0;
         if (!parser_parse_statement(parser, &st)) return false;
-        da_push(out, st, parser->arena);
+        da_push(&parser->scratch, st, parser->arena);
     }
+    *out = flush_scratch(parser, mark);
     if (parser_is_empty(parser)) {
         log_diagnostic(LL_ERROR, "Expected a `}` to end a block");
         report_error(parser->last_token.begin,
@@ -126,9 +212,7 @@ bool parser_expect_and_skip(Parser *parser, TokenType type) {
     return false;
 }
 
-bool parser_parse_expr(Parser *parser, AstExpression *out) { return parser_parse_term(parser, out); }
-
-bool parser_parse_primary(Parser *parser, AstExpression *out) {
+bool parser_parse_primary(Parser *parser, AstExprId *out) {
     if (parser_is_empty(parser)) {
         log_diagnostic(LL_ERROR, "Expected an expression to be here");
         report_error(parser->last_token.begin,
@@ -136,40 +220,31 @@ bool parser_parse_primary(Parser *parser, AstExpression *out) {
         return false;
     }
     Token t = parser_pop(parser);
+    AstExpression expr = {.begin = source_offset(parser, t.begin)};
     switch (t.type) {
     case TT_NUMBER: {
-        out->type = AET_PRIMARY;
-        out->len = t.len;
-        out->number = t.number;
-        out->begin = t.begin;
+        expr.type = AET_PRIMARY;
+        expr.len = t.len;
+        expr.number = push_number(parser, t.number);
+        *out = push_expr(parser, expr);
         return true;
     }
     case TT_IDENT: {
         if (!parser_is_empty(parser) && parser_peek(parser, 0).type == TT_OPEN_PAREN) {
-            out->type = AET_FUNCTION_CALL;
             parser_pop(parser);
-            Token closing_paren = parser_peek(parser, 0);
-            while (!parser_is_empty(parser) && parser_peek(parser, 0).type != TT_CLOSE_PAREN) {
-                AstExpression arg = {0};
-                if (!parser_parse_expr(parser, &arg)) return false;
-                da_push(&out->func_call.args, arg, parser->arena);
-                if (!parser_expect_and_skip(parser, TT_COMMA)) break;
-            }
-            if (!parser_expect_and_skip(parser, TT_CLOSE_PAREN)) {
-                log_diagnostic(LL_ERROR, "Argument list wasn't terminated with a `)`");
-                report_error(parser->last_token.begin,
-                             parser->origin.src.items, parser->origin.name);
-                return false;
-            }
-            out->len = closing_paren.begin + 1 - t.begin;
-            out->func_call.name = t.identifier;
-            out->begin = t.begin;
+            AstCall call = {.name = push_name(parser, t.identifier)};
+            if (!parse_call_args(parser, &call.args)) return false;
+            da_push(&parser->ast->calls, call, parser->arena);
+            expr.type = AET_FUNCTION_CALL;
+            expr.len = (parser->last_token.begin + 1) - t.begin;
+            expr.func_call = parser->ast->calls.count - 1;
+            *out = push_expr(parser, expr);
             return true;
         }
-        out->type = AET_IDENT;
-        out->len = t.identifier.count;
-        out->ident = t.identifier;
-        out->begin = t.begin;
+        expr.type = AET_IDENT;
+        expr.len = t.identifier.count;
+        expr.ident = push_name(parser, t.identifier);
+        *out = push_expr(parser, expr);
         return true;
     }
     case TT_DOUBLE_QUOTE: {
@@ -181,11 +256,11 @@ bool parser_parse_primary(Parser *parser, AstExpression *out) {
             return false;
         }
         parser_pop(parser);
-        out->type = AET_STRING;
-        out->begin = t.begin;
-        out->len = parser->last_token.begin - t.begin;
-        out->string.items = t.begin + 1;
-        out->string.count = (parser->last_token.begin - t.begin) - 1;
+        expr.type = AET_STRING;
+        expr.len = parser->last_token.begin - t.begin;
+        expr.string = push_name(parser, (StringView){.items = t.begin + 1,
+                                                     .count = (parser->last_token.begin - t.begin) - 1});
+        *out = push_expr(parser, expr);
         return true;
     }
     default: {
@@ -197,68 +272,150 @@ bool parser_parse_primary(Parser *parser, AstExpression *out) {
     }
     return true;
 }
-bool parser_parse_factor(Parser *parser, AstExpression *out) {
-    if (parser_is_empty(parser)) {
-        log_diagnostic(LL_ERROR, "Expected an expression to be here");
-        report_error(parser->last_token.begin,
-                     parser->origin.src.items, parser->origin.name);
-        return false;
-    }
 
-    if (!parser_parse_primary(parser, out)) return false;
-
-    while (!parser_is_empty(parser) && parser_peek(parser, 0).type == TT_OPERATOR &&
-           (parser_peek(parser, 0).operator== OT_MULT || parser_peek(parser, 0).operator== OT_DIV)) {
-
-        Token op = parser_pop(parser);
+// Both sides are already in the pool, so this only adds the node linking them
+static AstExprId push_binary(Parser *parser, AstExprId l, OperatorType op, AstExprId r) {
+    const AstExpression *lhs = ast_expr(parser->ast, l);
+    const AstExpression *rhs = ast_expr(parser->ast, r);
+    AstExpression expr = {
+        .type = AET_BINARY,
+        .begin = lhs->begin,
+        .len = (rhs->begin + rhs->len) - lhs->begin,
+        .bin = {.l = l, .op = op, .r = r},
+    };
+    return push_expr(parser, expr);
+}
 
-        AstExpression *lhs = arena_alloc(parser->arena, sizeof(AstExpression));
-        *lhs = *out;
+static AstExprId push_unary(Parser *parser, OperatorType op, uint32_t begin, AstExprId operand) {
+    const AstExpression *e = ast_expr(parser->ast, operand);
+    AstExpression expr = {
+        .type = AET_UNARY,
+        .begin = begin,
+        .len = (e->begin + e->len) - begin,
+        .unary = {.op = op, .operand = operand},
+    };
+    return push_expr(parser, expr);
+}
 
-        AstExpression *rhs = arena_alloc(parser->arena, sizeof(AstExpression));
-        if (!parser_parse_primary(parser, rhs)) return false;
+// Binding power of the binary operators, higher binds tighter, all of them are left associative
+// 0 means the operator can't be used as a binary one
+static const uint8_t binary_precedence[] = {
+    [OT_OR] = 1,
+    [OT_AND] = 2,
+    [OT_EQ] = 3, [OT_NE] = 3,
+    [OT_LT] = 4, [OT_LE] = 4, [OT_GT] = 4, [OT_GE] = 4,
+    [OT_PLUS] = 5, [OT_MINUS] = 5,
+    [OT_MULT] = 6, [OT_DIV] = 6,
+    [OT_NOT] = 0,
+};
+// prefix operators bind tighter than any binary one
+#define UNARY_PRECEDENCE 7
 
-        out->type = AET_BINARY;
-        out->len = (rhs->begin + rhs->len) - lhs->begin;
-        out->bin.op = op.operator;
-        out->bin.l = lhs;
-        out->bin.r = rhs;
+static uint8_t operator_precedence(const ParserOperator *op) {
+    switch (op->kind) {
+    case POK_BINARY: return binary_precedence[op->op];
+    case POK_UNARY: return UNARY_PRECEDENCE;
+    case POK_PAREN: return 0;
     }
-    return true;
+    UNREACHABLE("Unknown operator kind");
+    return 0;
 }
-bool parser_parse_term(Parser *parser, AstExpression *out) {
-    if (parser_is_empty(parser)) {
-        log_diagnostic(LL_ERROR, "Expected an expression to be here");
-        report_error(parser->last_token.begin,
-                     parser->origin.src.items, parser->origin.name);
-        return false;
+
+// Pops the top operator and the operands it needs, and pushes the node combining them
+static void reduce(Parser *parser) {
+    ASSERT(parser->operators.count > 0, "The caller ensures this condition");
+    ParserOperator op = parser->operators.items[--parser->operators.count];
+    AstRefs *operands = &parser->operands;
+    switch (op.kind) {
+    case POK_BINARY: {
+        ASSERT(operands->count >= 2, "A binary operator always has two operands by now");
+        AstExprId r = operands->items[--operands->count];
+        AstExprId l = operands->items[operands->count - 1];
+        operands->items[operands->count - 1] = push_binary(parser, l, op.op, r);
+        return;
+    }
+    case POK_UNARY: {
+        ASSERT(operands->count >= 1, "A unary operator always has an operand by now");
+        operands->items[operands->count - 1] = push_unary(parser, op.op, op.begin, operands->items[operands->count - 1]);
+        return;
     }
+    case POK_PAREN: UNREACHABLE("Parens are never reduced, only popped by `)`");
+    }
+}
 
-    if (!parser_parse_factor(parser, out)) return false;
+static bool is_operator(const Parser *parser) {
+    return !parser_is_empty(parser) && parser_peek(parser, 0).type == TT_OPERATOR;
+}
 
-    while (!parser_is_empty(parser) && parser_peek(parser, 0).type == TT_OPERATOR &&
-           (parser_peek(parser, 0).operator== OT_PLUS || parser_peek(parser, 0).operator== OT_MINUS)) {
+bool parser_parse_expr(Parser *parser, AstExprId *out) {
+    // this call may be parsing an argument list of an outer expression, so only touch what's above these
+    size_t operand_base = parser->operands.count;
+    size_t operator_base = parser->operators.count;
+    size_t open_parens = 0;
 
-        Token op = parser_pop(parser);
+    for (;;) {
+        // prefix position: parens and unary operators until there's an operand
+        if (parser_is_empty(parser)) {
+            log_diagnostic(LL_ERROR, "Expected an expression to be here");
+            report_error(parser->last_token.begin, parser->origin.src.items, parser->origin.name);
+            return false;
+        }
+        Token t = parser_peek(parser, 0);
+        if (t.type == TT_OPEN_PAREN) {
+            parser_pop(parser);
+            ParserOperator paren = {.kind = POK_PAREN, .begin = source_offset(parser, t.begin)};
+            da_push(&parser->operators, paren, parser->arena);
+            open_parens++;
+            continue;
+        }
+        if (t.type == TT_OPERATOR && (t.operator== OT_MINUS || t.operator== OT_NOT)) {
+            parser_pop(parser);
+            ParserOperator prefix = {.kind = POK_UNARY, .op = t.operator, .begin = source_offset(parser, t.begin)};
+            da_push(&parser->operators, prefix, parser->arena);
+            continue;
+        }
 
-        AstExpression *lhs = arena_alloc(parser->arena, sizeof(AstExpression));
-        *lhs = *out;
+        AstExprId operand = 0;
+        if (!parser_parse_primary(parser, &operand)) return false;
+        da_push(&parser->operands, operand, parser->arena);
 
-        AstExpression *rhs = arena_alloc(parser->arena, sizeof(AstExpression));
-        if (!parser_parse_factor(parser, rhs)) return false;
-        out->type = AET_BINARY;
-        out->bin.op = op.operator;
-        out->len = (rhs->begin + rhs->len) - lhs->begin;
-        out->bin.l = lhs;
-        out->bin.r = rhs;
+        // infix position: close as many parens as there are, then either a binary operator or the end
+        while (open_parens > 0 && !parser_is_empty(parser) && parser_peek(parser, 0).type == TT_CLOSE_PAREN) {
+            parser_pop(parser);
+            while (parser->operators.items[parser->operators.count - 1].kind != POK_PAREN) reduce(parser);
+            parser->operators.count--;
+            open_parens--;
+        }
+
+        if (!is_operator(parser) || binary_precedence[parser_peek(parser, 0).operator] == 0) break;
+
+        Token op_token = parser_pop(parser);
+        ParserOperator op = {.kind = POK_BINARY, .op = op_token.operator, .begin = source_offset(parser, op_token.begin)};
+        uint8_t precedence = binary_precedence[op.op];
+        while (parser->operators.count > operator_base &&
+               operator_precedence(&parser->operators.items[parser->operators.count - 1]) >= precedence) {
+            reduce(parser);
+        }
+        da_push(&parser->operators, op, parser->arena);
     }
+
+    if (open_parens > 0) {
+        log_diagnostic(LL_ERROR, "Expected a `)` to close this expression");
+        report_error(parser->last_token.begin, parser->origin.src.items, parser->origin.name);
+        return false;
+    }
+    while (parser->operators.count > operator_base) reduce(parser);
+
+    ASSERT(parser->operands.count == operand_base + 1, "Every operator got reduced, so one operand has to be left");
+    *out = parser->operands.items[--parser->operands.count];
     return true;
 }
 
 // statements that require a semicolon break out of the switch
 // those that don't return true, but they have to setup the length of themselves
-bool parser_parse_statement(Parser *parser, AstStatement *out) {
-    out->begin = parser->tokens.items[0].begin;
+static bool parse_statement_into(Parser *parser, AstStatement *out) {
+    const char *begin = parser->tokens.items[0].begin;
+    out->begin = source_offset(parser, begin);
     Token t = parser_pop(parser);
 
     if (t.type == TT_KEYWORD) {
@@ -276,7 +433,7 @@ bool parser_parse_statement(Parser *parser, AstStatement *out) {
             case TT_SEMICOLON: {
                 out->ret.has_expr = false;
                 parser_pop(parser);
-                out->len = (parser->last_token.begin + parser->last_token.len) - out->begin;
+                out->len = (parser->last_token.begin + parser->last_token.len) - begin;
                 return true;
             }
             default: {
@@ -288,7 +445,8 @@ bool parser_parse_statement(Parser *parser, AstStatement *out) {
             break;
         }
         case KT_LET: {
-            if (!parser_expect_ident(parser, &out->let.name)) {
+            StringView name = {0};
+            if (!parser_expect_ident(parser, &name)) {
                 log_diagnostic(LL_ERROR, "Expected a name for a variable definition here");
                 report_error(parser->last_token.begin,
                              parser->origin.src.items, parser->origin.name);
@@ -301,25 +459,22 @@ bool parser_parse_statement(Parser *parser, AstStatement *out) {
                 return false;
             }
 
+            out->let.name = push_name(parser, name);
             if (!parser_parse_expr(parser, &out->let.value)) return false;
             out->type = AST_LET;
             break;
         }
         case KT_IF: {
-            AstExpression cond = {0};
-            if (!parser_parse_expr(parser, &cond)) return false;
-            out->if_st.cond = cond;
+            if (!parser_parse_expr(parser, &out->if_st.cond)) return false;
             if (!parser_parse_block(parser, &out->if_st.block)) return false;
-            out->len = (parser->last_token.begin + parser->last_token.len) - out->begin;
+            out->len = (parser->last_token.begin + parser->last_token.len) - begin;
             out->type = AST_IF;
             return true;
         }
         case KT_WHILE: {
-            AstExpression cond = {0};
-            if (!parser_parse_expr(parser, &cond)) return false;
-            out->if_st.cond = cond;
-            if (!parser_parse_block(parser, &out->if_st.block)) return false;
-            out->len = (parser->last_token.begin + parser->last_token.len) - out->begin;
+            if (!parser_parse_expr(parser, &out->while_st.cond)) return false;
+            if (!parser_parse_block(parser, &out->while_st.block)) return false;
+            out->len = (parser->last_token.begin + parser->last_token.len) - begin;
             out->type = AST_WHILE;
             return true;
         }
@@ -336,10 +491,10 @@ bool parser_parse_statement(Parser *parser, AstStatement *out) {
                              parser->origin.src.items, parser->origin.name);
                 return false;
             }
-            const char *begin = parser->last_token.begin + 1;
+            const char *asm_begin = parser->last_token.begin + 1;
             while (!parser_is_empty(parser) && parser_peek(parser, 0).type != TT_CLOSE_PAREN) parser_pop(parser);
-            const char *end = parser->last_token.begin + parser->last_token.len;
-            out->asm = (StringView){.items = begin, .count = end - begin};
+            const char *asm_end = parser->last_token.begin + parser->last_token.len;
+            out->asm = push_name(parser, (StringView){.items = asm_begin, .count = asm_end - asm_begin});
             return true;
         }
         }
@@ -347,27 +502,18 @@ bool parser_parse_statement(Parser *parser, AstStatement *out) {
         switch (parser_peek(parser, 0).type) {
         case TT_ASSIGN: {
             out->type = AST_ASSIGN;
-            out->assign.name = t.identifier;
+            out->assign.name = push_name(parser, t.identifier);
             parser_pop(parser);
             if (!parser_parse_expr(parser, &out->assign.value)) return false;
             break;
         }
         case TT_OPEN_PAREN: {
             out->type = AST_CALL;
-            out->call.name = t.identifier;
             parser_pop(parser);
-            while (!parser_is_empty(parser) && parser_peek(parser, 0).type != TT_CLOSE_PAREN) {
-                AstExpression arg = {0};
-                if (!parser_parse_expr(parser, &arg)) { return false; }
-                da_push(&out->call.args, arg, parser->arena);
-                if (!parser_expect_and_skip(parser, TT_COMMA)) { break; }
-            }
-            if (!parser_expect_and_skip(parser, TT_CLOSE_PAREN)) {
-                log_diagnostic(LL_ERROR, "Argument list wasn't terminated with a `)`");
-                report_error(parser->last_token.begin,
-                             parser->origin.src.items, parser->origin.name);
-                return false;
-            }
+            AstCall call = {.name = push_name(parser, t.identifier)};
+            if (!parse_call_args(parser, &call.args)) return false;
+            da_push(&parser->ast->calls, call, parser->arena);
+            out->call = parser->ast->calls.count - 1;
             break;
         }
         default: {
@@ -386,7 +532,14 @@ bool parser_parse_statement(Parser *parser, AstStatement *out) {
         return false;
     }
     parser_pop(parser);
-    out->len = (parser->last_token.begin + parser->last_token.len) - out->begin;
+    out->len = (parser->last_token.begin + parser->last_token.len) - begin;
+
+    return true;
+}
 
+bool parser_parse_statement(Parser *parser, AstStmtId *out) {
+    AstStatement st = {0};
+    if (!parse_statement_into(parser, &st)) return false;
+    *out = push_stmt(parser, st);
     return true;
 }
@@ -4,38 +4,27 @@
 #include "lexer.h"
 #include <stddef.h>
 
-typedef struct {
-    TokensSlice tokens;
-    Token last_token;
-
-    SourceFileView origin;
-
-    Arena *arena;
-} Parser;
-
 typedef enum {
     AET_PRIMARY,
     AET_BINARY,
+    AET_UNARY,
     AET_IDENT,
     AET_FUNCTION_CALL,
     AET_STRING,
 } AstExpressionType;
 
-typedef struct AstExpression AstExpression;
-typedef struct AstStatement AstStatement;
+// The AST lives in the flat pools of `Ast` and nodes refer to each other by 32 bit indices
+// Nodes have a fixed size, anything bigger (numbers, names, call arguments, blocks) sits in a side array
+typedef uint32_t AstExprId;
+typedef uint32_t AstStmtId;
+// Index into one of the side arrays (`numbers`, `names` or `calls`)
+typedef uint32_t AstPayloadId;
 
+// `count` ids stored back to back in `Ast.refs` starting at `begin`
 typedef struct {
-    AstStatement *items;
-    size_t count;
-    size_t capacity;
-} AstBlock;
-
-// Where a function is called
-typedef struct {
-    AstExpression *items;
-    size_t count;
-    size_t capacity;
-} FunctionArgsIn;
+    uint32_t begin;
+    uint32_t count;
+} AstRange;
 
 // Where a function is defined
 // TODO: Types (since all things are just u64 now)
@@ -45,23 +34,25 @@ typedef struct {
     size_t capacity;
 } FunctionArgsOut;
 
-typedef struct AstExpression {
+// `begin` and `len` locate the node in the source (`begin` is an offset from the start of it)
+typedef struct {
     AstExpressionType type;
-    const char *begin;
-    ptrdiff_t len;
+    uint32_t begin;
+    uint32_t len;
     union {
-        uint64_t number;
-        StringView ident;
+        AstPayloadId number;
+        AstPayloadId ident;
         struct {
-            struct AstExpression *l;
+            AstExprId l;
             OperatorType op;
-            struct AstExpression *r;
+            AstExprId r;
         } bin;
         struct {
-            StringView name;
-            FunctionArgsIn args;
-        } func_call;
-        StringView string;
+            OperatorType op;
+            AstExprId operand;
+        } unary;
+        AstPayloadId func_call;
+        AstPayloadId string;
     };
 } AstExpression;
 
@@ -75,45 +66,134 @@ typedef enum {
     AST_ASM,
 } AstStatementType;
 
-struct AstStatement {
+typedef struct {
     AstStatementType type;
-    const char *begin;
-    ptrdiff_t len;
+    uint32_t begin;
+    uint32_t len;
     union {
         struct {
             bool has_expr;
-            AstExpression return_expr;
+            AstExprId return_expr;
         } ret;
         struct {
-            StringView name;
-            AstExpression value;
+            AstPayloadId name;
+            AstExprId value;
         } let, assign;
+        AstPayloadId call;
         struct {
-            StringView name;
-            FunctionArgsIn args;
-        } call;
-        struct {
-            AstExpression cond;
-            AstBlock block;
+            AstExprId cond;
+            // statement ids
+            AstRange block;
         } if_st;
         struct {
-            AstExpression cond;
-            AstBlock block;
+            AstExprId cond;
+            AstRange block;
         } while_st;
-        StringView asm;
+        AstPayloadId asm;
     };
-};
+} AstStatement;
+
+// A function call (either an expression or a statement)
+typedef struct {
+    AstPayloadId name;
+    // expression ids
+    AstRange args;
+} AstCall;
+
+typedef struct {
+    AstExpression *items;
+    size_t count;
+    size_t capacity;
+} AstExpressions;
 
 typedef struct {
     AstStatement *items;
-    SourceFileView source;
     size_t count;
     size_t capacity;
-} AstTree;
+} AstStatements;
+
+typedef struct {
+    uint32_t *items;
+    size_t count;
+    size_t capacity;
+} AstRefs;
+
+typedef struct {
+    uint64_t *items;
+    size_t count;
+    size_t capacity;
+} AstNumbers;
+
+typedef struct {
+    StringView *items;
+    size_t count;
+    size_t capacity;
+} AstNames;
+
+typedef struct {
+    AstCall *items;
+    size_t count;
+    size_t capacity;
+} AstCalls;
+
+typedef struct {
+    AstExpressions exprs;
+    AstStatements stmts;
+    AstRefs refs;
+    AstNumbers numbers;
+    AstNames names;
+    AstCalls calls;
+} Ast;
+
+AstExpression *ast_expr(const Ast *ast, AstExprId id);
+AstStatement *ast_stmt(const Ast *ast, AstStmtId id);
+AstCall *ast_call(const Ast *ast, AstPayloadId id);
+StringView ast_name(const Ast *ast, AstPayloadId id);
+uint64_t ast_number(const Ast *ast, AstPayloadId id);
+// The id at `index` inside of `range`
+uint32_t ast_ref(const Ast *ast, AstRange range, size_t index);
+
+typedef enum {
+    POK_BINARY,
+    POK_UNARY,
+    POK_PAREN,
+} ParserOperatorKind;
+
+// An entry of the operator stack of `parser_parse_expr`
+typedef struct {
+    ParserOperatorKind kind;
+    OperatorType op;
+    // where the operator (or the opening paren) is in the source
+    uint32_t begin;
+} ParserOperator;
+
+typedef struct {
+    ParserOperator *items;
+    size_t count;
+    size_t capacity;
+} ParserOperators;
+
+typedef struct {
+    TokensSlice tokens;
+    Token last_token;
+
+    SourceFileView origin;
+
+    // where the nodes go, `parser_parse` points this at the `Ast` of the root
+    Ast *ast;
+    // ids of the block or argument list that is being parsed, flushed into `ast->refs` once it's complete
+    AstRefs scratch;
+    // stacks of `parser_parse_expr`, a nested call (an argument list) works above the entries of its caller
+    AstRefs operands;
+    ParserOperators operators;
+
+    Arena *arena;
+} Parser;
 
 typedef struct {
     StringView name;
-    AstBlock body;
+    // statement ids
+    AstRange body;
     FunctionArgsOut args;
 } AstFunction;
 
@@ -126,6 +206,7 @@ typedef struct {
 typedef struct {
     AstFunctions fs;
     SourceFileView source;
+    Ast ast;
 } AstRoot;
 
 bool parser_parse(Parser *parser, AstRoot *out);
@@ -139,22 +220,27 @@ bool parser_expect_and_skip(Parser *parser, TokenType type);
 
 /*
     https://timothya.com/pdfs/crafting-interpreters.pdf
-    expression → equality ;
+    expression → or ;
+    or → and ( "||" and )* ;
+    and → equality ( "&&" equality )* ;
     equality → comparison ( ( "!=" | "==" ) comparison )* ;
     comparison → term ( ( ">" | ">=" | "<" | "<=" ) term )* ;
     term → factor ( ( "-" | "+" ) factor )* ;
     factor → unary ( ( "/" | "*" ) unary )* ;
-    unary → ( "!" | "-" ) unary
+    unary → ( "-" | "!" ) unary
     | primary ;
-    primary → NUMBER | STRING | "true" | "false" | "nil"
+    primary → NUMBER | STRING | IDENT | IDENT "(" arguments ")"
     | "(" expression ")" ;
+
+    `parser_parse_expr` doesn't follow this rule by rule, it's an operator precedence parser driven by the
+    precedence table in parser.c with explicit operand and operator stacks, so the depth of an expression (long
+    operator chains, nested parens) doesn't cost any C stack
+    Only argument lists of calls recurse
 */
-bool parser_parse_expr(Parser *parser, AstExpression *out);
-bool parser_parse_factor(Parser *parser, AstExpression *out);
-bool parser_parse_term(Parser *parser, AstExpression *out);
-bool parser_parse_primary(Parser *parser, AstExpression *out);
+bool parser_parse_expr(Parser *parser, AstExprId *out);
+bool parser_parse_primary(Parser *parser, AstExprId *out);
 
-bool parser_parse_statement(Parser *parser, AstStatement *out);
-bool parser_parse_block(Parser *parser, AstBlock *out);
+bool parser_parse_statement(Parser *parser, AstStmtId *out);
+bool parser_parse_block(Parser *parser, AstRange *out);
 
 #endif
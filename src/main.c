@@ -6,6 +6,7 @@
 #include "frontend/lexer.h"
 #include "frontend/parser.h"
 
+#include "backend/ir/opt.h"
 #include "backend/ir/ssa.h"
 #include "config.h"
 #include "target.h"
@@ -57,15 +58,21 @@ int main(int argc, char **argv) {
         goto defer;
     }
 
+    if (!optimize_module(&mod, c.opt_level, c.unroll_factor, &arena)) {
+        result = 1;
+        goto defer;
+    }
+
     if (c.dump_ir) {
         dump_ir(&mod);
         result = 0;
         goto defer;
     }
 
-    c.target->generate(c.output_name, &mod, &arena);
-    c.target->assemble(c.output_name, &arena);
-    c.target->link(c.output_name, &arena);
+    if (!c.target->generate(c.output_name, &mod, &c.target_options, &arena) ||
+        !c.target->assemble(c.output_name, &arena) || !c.target->link(c.output_name, &arena)) {
+        result = 1;
+    }
     if (!c.keep_build_artifacts) c.target->cleanup(c.output_name, &arena);
 
 defer:
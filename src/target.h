@@ -7,10 +7,17 @@ typedef enum {
     TK_Count,
 } TargetKind;
 
+typedef struct {
+    // the entry point reads the TSC around `call main` and writes the 8 byte delta to fd 3
+    bool rdtsc;
+    // same as `Config.opt_level`, from 1 on temps get registers instead of stack slots
+    size_t opt_level;
+} TargetOptions;
+
 typedef struct {
     const char *name;
     TargetKind tk;
-    bool (*generate)(char *root_path, const Module *mod, Arena* arena);
+    bool (*generate)(char *root_path, const Module *mod, const TargetOptions *opts, Arena* arena);
     bool (*assemble)(char *root_path, Arena* arena);
     bool (*link)(char *root_path, Arena* arena);
     void (*cleanup)(char *root_path, Arena* arena);
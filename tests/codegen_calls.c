@@ -0,0 +1,35 @@
+#include "../src/util.h"
+#include "common.h"
+
+int main() {
+    // the arguments past the 6th go on the stack, an odd number of them needs padding above them to keep the stack
+    // aligned, every argument has a weight of its own so one that ends up in the wrong place changes the result
+    // the functions call themselves, which keeps them from getting inlined
+    char *seven = "def seven(a, b, c, d, e, f, g) {\n"
+                  "    if a { return seven(a - 1, b, c, d, e, f, g) + g; }\n"
+                  "    return b * 2 + c * 3 + d * 4 + e * 5 + f * 6 + g * 7;\n"
+                  "}\n"
+                  "def main() {\n"
+                  "    return seven(2, 8, 7, 6, 5, 4, 3);\n"
+                  "}\n";
+    char *eight = "def eight(a, b, c, d, e, f, g, h) {\n"
+                  "    if a { return eight(a - 1, b, c, d, e, f, g, h) + h; }\n"
+                  "    return b * 2 + c * 3 + d * 4 + e * 5 + f * 6 + g * 7 + h * 8;\n"
+                  "}\n"
+                  "def main() {\n"
+                  "    return eight(2, 8, 7, 6, 5, 4, 3, 2);\n"
+                  "}\n";
+    char *nine = "def nine(a, b, c, d, e, f, g, h, i) {\n"
+                 "    if a { return nine(a - 1, b, c, d, e, f, g, h, i) + i; }\n"
+                 "    return b * 2 + c * 3 + d * 4 + e * 5 + f * 6 + g * 7 + h * 8 + i * 9;\n"
+                 "}\n"
+                 "def main() {\n"
+                 "    return nine(2, 9, 8, 7, 6, 5, 4, 3, 2);\n"
+                 "}\n";
+    for (size_t level = 0; level <= OPT_LEVEL_MAX; level++) {
+        if (compile_and_run(seven, "seven", level) != 137) return 1;
+        if (compile_and_run(eight, "eight", level) != 151) return 1;
+        if (compile_and_run(nine, "nine", level) != 204) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "../src/backend/codegen/nasm_x86_64_linux.h"
+#include "../src/util.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    const char *op;
+    // the jump `if` takes past its body, so the opposite of `op`
+    const char *jump;
+    // bit i is the result of `right` for the i-th input around 4294967295, bit 3 + i that of `left` around 0
+    int expected;
+} Case;
+
+static const Case cases[] = {
+    {"==", "jne", 0x02 | 0x08}, {"!=", "je", 0x05 | 0x30}, {"<", "jae", 0x01 | 0x30},
+    {"<=", "ja", 0x03 | 0x38},  {">", "jbe", 0x04 | 0x00}, {">=", "jb", 0x06 | 0x08},
+};
+
+static char src[1024];
+static char asm_text[64 * 1024];
+
+int main() {
+    // at -O1 neither function gets inlined, so both compare an argument with a constant that has to go in a register
+    // 4294967295 doesn't fit an imm32 and 0 on the left can't be an immediate at all
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++) {
+        const Case *c = &cases[i];
+        snprintf(src, sizeof(src),
+                 "def right(x) {\n    if x %s 4294967295 { return 1; }\n    return 0;\n}\n"
+                 "def left(x) {\n    if 0 %s x { return 1; }\n    return 0;\n}\n"
+                 "def main() {\n"
+                 "    let max = 0 - 1;\n"
+                 "    return right(4294967294) + right(4294967295) * 2 + right(4294967296) * 4 +\n"
+                 "        left(0) * 8 + left(1) * 16 + left(max) * 32;\n"
+                 "}\n",
+                 c->op, c->op);
+        Arena arena = arena_new(1024 * 1024);
+        Module mod = {0};
+        ASSERT(compile_module(src, "COMPARE", 1, &mod, &arena), "The source code should compile without any errors");
+        FILE *sink = tmpfile();
+        ASSERT(sink, "Couldn't open a temporary file");
+        TargetOptions opts = {.opt_level = 1};
+        ASSERT(nasm_x86_64_linux_generate_file(sink, &mod, &opts, &arena), "The code generator shouldn't fail");
+        rewind(sink);
+        size_t n = fread(asm_text, 1, sizeof(asm_text) - 1, sink);
+        ASSERT(n < sizeof(asm_text) - 1, "The assembly doesn't fit the buffer");
+        asm_text[n] = 0;
+        fclose(sink);
+        arena_free(&arena);
+
+        // the comparison feeds the jump right after it, so neither function materializes a 0 or 1 with setcc
+        char *right_text = strstr(asm_text, "\nright:");
+        char *left_text = strstr(asm_text, "\nleft:");
+        char *main_text = strstr(asm_text, "\nmain:");
+        ASSERT(right_text && left_text && main_text && right_text < left_text && left_text < main_text,
+               "Functions come in order");
+        *left_text++ = 0;
+        *main_text = 0;
+        char jump[16];
+        snprintf(jump, sizeof(jump), "\n  %s .l", c->jump);
+        if (!strstr(right_text, jump) || !strstr(left_text, jump)) return 1;
+        if (strstr(right_text, "set") || strstr(left_text, "set")) return 1;
+
+        // and the jumps are the unsigned ones
+        if (compile_and_run(src, "compare", 1) != c->expected) return 1;
+    }
+    return 0;
+}
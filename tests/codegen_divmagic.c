@@ -0,0 +1,39 @@
+#include "../src/backend/codegen/x86_64.h"
+#include "../src/util.h"
+
+// What the emitted mul/shr sequence computes
+static uint64_t divide(DivMagic m, uint64_t n) {
+    uint64_t q = ((unsigned __int128)n * m.multiplier) >> 64;
+    if (m.add) q = ((n - q) >> 1) + q;
+    return q >> m.shift;
+}
+
+static bool check(uint64_t d) {
+    DivMagic m = unsigned_div_magic(d);
+    uint64_t samples[] = {0, 1, d - 1, d, d + 1, 2 * d - 1, 2 * d, UINT64_MAX, UINT64_MAX - 1, UINT64_MAX / d * d,
+                          UINT64_MAX / d * d - 1, 0x8000000000000000ull, 0x7fffffffffffffffull};
+    for (size_t i = 0; i < sizeof(samples) / sizeof(*samples); i++) {
+        if (divide(m, samples[i]) != samples[i] / d) return false;
+    }
+    uint64_t x = d;
+    for (size_t i = 0; i < 1000; i++) {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+        if (divide(m, x) != x / d) return false;
+        if (divide(m, x >> (i % 64)) != (x >> (i % 64)) / d) return false;
+    }
+    return true;
+}
+
+int main() {
+    for (uint64_t d = 3; d < 5000; d++) {
+        if ((d & (d - 1)) != 0 && !check(d)) return 1;
+    }
+    uint64_t big[] = {1000000007, 0xffffffffull, 0x100000001ull, 0x8000000000000001ull, UINT64_MAX, UINT64_MAX - 2};
+    for (size_t i = 0; i < sizeof(big) / sizeof(*big); i++) {
+        if (!check(big[i])) return 1;
+    }
+
+    // 7 is the classic divisor that needs the add step, 10 doesn't
+    if (!unsigned_div_magic(7).add || unsigned_div_magic(10).add) return 1;
+    return 0;
+}
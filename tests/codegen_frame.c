@@ -0,0 +1,51 @@
+#include "../src/backend/codegen/nasm_x86_64_linux.h"
+#include "../src/util.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static char asm_text[64 * 1024];
+
+int main() {
+    // 14 values live at once spill a few of them, `leaf` calls nothing so they go in the red zone below rsp
+    char *src = "def leaf(n) {\n"
+                "    let v1 = n + 1; let v2 = n + 2; let v3 = n + 3; let v4 = n + 4; let v5 = n + 5;\n"
+                "    let v6 = n + 6; let v7 = n + 7; let v8 = n + 8; let v9 = n + 9; let v10 = n + 10;\n"
+                "    let v11 = n + 11; let v12 = n + 12; let v13 = n + 13; let v14 = n + 14;\n"
+                "    return v1 * v2 + v3 * v4 + v5 * v6 + v7 * v8 + v9 * v10 + v11 * v12 + v13 * v14;\n"
+                "}\n"
+                "def main() {\n"
+                "    return leaf(1);\n"
+                "}\n";
+    Arena arena = arena_new(1024 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "FRAME", 1, &mod, &arena), "The source code should compile without any errors");
+    FILE *sink = tmpfile();
+    ASSERT(sink, "Couldn't open a temporary file");
+    TargetOptions opts = {.opt_level = 1};
+    ASSERT(nasm_x86_64_linux_generate_file(sink, &mod, &opts, &arena), "The code generator shouldn't fail");
+    rewind(sink);
+    size_t n = fread(asm_text, 1, sizeof(asm_text) - 1, sink);
+    ASSERT(n < sizeof(asm_text) - 1, "The assembly doesn't fit the buffer");
+    asm_text[n] = 0;
+    fclose(sink);
+
+    // `main` makes a call, which needs rsp aligned and rbp to find its slots, so only `main` gets the usual frame
+    char *leaf_text = strstr(asm_text, "\nleaf:");
+    char *main_text = strstr(asm_text, "\nmain:");
+    char *data = strstr(asm_text, "section .data");
+    ASSERT(leaf_text && main_text && data && leaf_text < main_text && main_text < data, "Functions come in order");
+    *main_text++ = 0;
+    *data = 0;
+    if (strstr(leaf_text, "rbp") || strstr(leaf_text, "sub rsp")) return 1;
+    if (!strstr(leaf_text, "[rsp - 8]")) return 1;
+    if (!strstr(main_text, "push rbp") || !strstr(main_text, "mov rbp, rsp")) return 1;
+    arena_free(&arena);
+
+    // and the slots below rsp hold their values
+    for (size_t level = 0; level <= OPT_LEVEL_MAX; level++) {
+        if (compile_and_run(src, "frame", level) != 616 % 256) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "../src/backend/codegen/nasm_x86_64_linux.h"
+#include "../src/util.h"
+#include "common.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static char src[16 * 1024];
+static size_t src_len;
+
+[[gnu::format(printf, 1, 2)]] static void append(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    src_len += vsnprintf(src + src_len, sizeof(src) - src_len, fmt, args);
+    va_end(args);
+    ASSERT(src_len < sizeof(src), "The source code doesn't fit the buffer");
+}
+
+// Runs the whole compiler on `src` at `level` in an arena as big as the one of main.c, which aborts if it overflows
+static void compile(size_t level) {
+    Arena arena = arena_new(1024 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "LARGE", level, &mod, &arena), "The source code should compile without any errors");
+    FILE *sink = tmpfile();
+    ASSERT(sink, "Couldn't open a temporary file");
+    TargetOptions opts = {.opt_level = level};
+    ASSERT(nasm_x86_64_linux_generate_file(sink, &mod, &opts, &arena), "The code generator shouldn't fail");
+    fclose(sink);
+    arena_free(&arena);
+}
+
+int main() {
+    // a loop around 40 ifs, rotating it duplicates the condition blocks in front of the loop
+    append("def main() {\n    let s = 0;\n    let i = 0;\n    while i < 100 {\n");
+    for (size_t k = 0; k < 40; k++) append("        if i - %zu { s = s + i * %zu; }\n", k, k);
+    append("        i = i + 1;\n    }\n    return s;\n}\n");
+    compile(1);
+    compile(2);
+
+    // five counted loops around five ifs each, which get unrolled and then rewritten one loop at a time
+    src_len = 0;
+    append("def main() {\n    let s = 1;\n    let t = 3;\n");
+    for (size_t l = 0; l < 5; l++) {
+        append("    let i%zu = 0;\n    while i%zu < 4 {\n", l, l);
+        append("        s = s + i%zu * %zu + t;\n", l, l + 3);
+        append("        t = t + i%zu * 2;\n", l);
+        for (size_t k = 0; k < 5; k++) append("        if i%zu - %zu { s = s + t * %zu; }\n", l, k, k + 2);
+        append("        i%zu = i%zu + 1;\n    }\n", l, l);
+    }
+    append("    return s;\n}\n");
+    compile(1);
+    compile(2);
+
+    // one long function without any branches, which every pass walks and most of them rebuild
+    src_len = 0;
+    append("def main() {\n    let x0 = 1;\n");
+    for (size_t i = 1; i < 420; i++) append("    let x%zu = x%zu + %zu;\n", i, i - 1, i);
+    append("    return x419;\n}\n");
+    for (size_t level = 0; level <= OPT_LEVEL_MAX; level++) {
+        compile(level);
+        // 1 + 1 + 2 + ... + 419
+        if (compile_and_run(src, "long", level) != 87991 % 256) return 1;
+    }
+
+    return 0;
+}
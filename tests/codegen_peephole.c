@@ -0,0 +1,103 @@
+#include "../src/backend/codegen/x86_64.h"
+#include "../src/util.h"
+
+static Arena arena;
+
+// What an instruction should look like once the optimizer is done
+typedef struct {
+    Opcode op;
+    Operand a;
+    Operand b;
+} Expected;
+
+static void push(Instrs *code, Opcode op, Operand a, Operand b) {
+    Instr instr = {.op = op, .a = a, .b = b};
+    da_push(code, instr, &arena);
+}
+
+static bool is(const Instr *in, Opcode op, Operand a, Operand b) {
+    return in->op == op && operands_equal(&in->a, &a) && operands_equal(&in->b, &b);
+}
+
+int main() {
+    arena = arena_new(64 * 1024);
+    Operand none = {0};
+    Operand slot = op_mem(REG_RBP, -8);
+    Instrs code = {0};
+
+    push(&code, X_MOV, op_reg(REG_RAX), op_imm(5));
+    push(&code, X_MOV, slot, op_reg(REG_RAX));
+    push(&code, X_MOV, op_reg(REG_RAX), slot);
+    code.items[code.count - 1].comment = "jz";
+    push(&code, X_CMP, op_reg(REG_RAX), op_imm(0));
+    push(&code, X_JZ, op_label(LK_IR, 0), none);
+    push(&code, X_MOV, op_reg(REG_R10), op_reg(REG_R10));
+    push(&code, X_MOV, op_reg(REG_R11), op_imm(0));
+    push(&code, X_CMP, op_reg(REG_R11), op_reg(REG_RAX));
+    // the jz still needs the flags of the cmp, so this one stays a mov
+    push(&code, X_MOV, op_reg(REG_RSI), op_imm(0));
+    push(&code, X_JZ, op_label(LK_IR, 1), none);
+    push(&code, X_JMP, op_label(LK_RETURN, 0), none);
+    push(&code, X_LABEL, op_label(LK_IR, 0), none);
+    push(&code, X_LABEL, op_label(LK_RETURN, 0), none);
+    push(&code, X_RET, none, none);
+
+    if (!peephole_optimize(&code)) return 1;
+    Expected expected[] = {
+        {X_MOV, op_reg(REG_RAX), op_imm(5)},
+        {X_MOV, slot, op_reg(REG_RAX)},
+        // the reload is gone, its comment stays
+        {X_NOP, none, none},
+        {X_TEST, op_reg(REG_RAX), op_reg(REG_RAX)},
+        {X_JZ, op_label(LK_IR, 0), none},
+        {X_XOR, op_reg32(REG_R11), op_reg32(REG_R11)},
+        {X_CMP, op_reg(REG_R11), op_reg(REG_RAX)},
+        {X_MOV, op_reg(REG_RSI), op_imm(0)},
+        {X_JZ, op_label(LK_IR, 1), none},
+        {X_LABEL, op_label(LK_IR, 0), none},
+        {X_LABEL, op_label(LK_RETURN, 0), none},
+        {X_RET, none, none},
+    };
+    if (code.count != sizeof(expected) / sizeof(*expected)) return 1;
+    for (size_t i = 0; i < code.count; i++) {
+        // a deleted instruction keeps whatever operands it had
+        if (code.items[i].op != expected[i].op) return 1;
+        if (expected[i].op != X_NOP && !is(&code.items[i], expected[i].op, expected[i].a, expected[i].b)) return 1;
+        if ((code.items[i].comment != NULL) != (i == 2)) return 1;
+    }
+    if (strcmp(code.items[2].comment, "jz") != 0) return 1;
+
+    // nothing left to do
+    if (peephole_optimize(&code)) return 1;
+
+    // a fused compare and branch reads the flags like jz does, until it turns out to jump to the next instruction
+    code.count = 0;
+    push(&code, X_CMP, op_reg(REG_R10), op_reg(REG_R11));
+    push(&code, X_MOV, op_reg(REG_RDI), op_imm(0));
+    push(&code, X_JAE, op_label(LK_IR, 2), none);
+    push(&code, X_LABEL, op_label(LK_IR, 2), none);
+    push(&code, X_RET, none, none);
+    if (!peephole_optimize(&code)) return 1;
+    Expected expected_fused[] = {
+        {X_CMP, op_reg(REG_R10), op_reg(REG_R11)},
+        {X_XOR, op_reg32(REG_RDI), op_reg32(REG_RDI)},
+        {X_LABEL, op_label(LK_IR, 2), none},
+        {X_RET, none, none},
+    };
+    if (code.count != sizeof(expected_fused) / sizeof(*expected_fused)) return 1;
+    for (size_t i = 0; i < code.count; i++) {
+        if (!is(&code.items[i], expected_fused[i].op, expected_fused[i].a, expected_fused[i].b)) return 1;
+    }
+
+    // neither does a cmov, so the mov in between keeps the flags alone
+    code.count = 0;
+    push(&code, X_CMP, op_reg(REG_R10), op_reg(REG_R11));
+    push(&code, X_MOV, op_reg(REG_RDI), op_imm(0));
+    push(&code, X_CMOVB, op_reg(REG_RDI), op_reg(REG_R10));
+    push(&code, X_RET, none, none);
+    if (peephole_optimize(&code)) return 1;
+    if (!is(&code.items[1], X_MOV, op_reg(REG_RDI), op_imm(0))) return 1;
+
+    arena_free(&arena);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "../src/backend/codegen/regalloc.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/util.h"
+#include "common.h"
+
+static bool is_callee_saved(Register r) {
+    return r == REG_RBX || r == REG_R12 || r == REG_R13 || r == REG_R14 || r == REG_R15;
+}
+
+int main() {
+    char *src = "def main(n) {\n"
+                "    let a = n + 1;\n"
+                "    let b = g(a);\n"
+                "    return a + b;\n"
+                "}\n"
+                "def many(n) {\n"
+                "    let v1 = n + 1; let v2 = n + 2; let v3 = n + 3; let v4 = n + 4; let v5 = n + 5;\n"
+                "    let v6 = n + 6; let v7 = n + 7; let v8 = n + 8; let v9 = n + 9; let v10 = n + 10;\n"
+                "    let v11 = n + 11; let v12 = n + 12; let v13 = n + 13; let v14 = n + 14;\n"
+                "    return v1 + v2 + v3 + v4 + v5 + v6 + v7 + v8 + v9 + v10 + v11 + v12 + v13 + v14;\n"
+                "}\n"
+                "def phases(n) {\n"
+                "    let v1 = n + 1; let v2 = n + 2; let v3 = n + 3; let v4 = n + 4; let v5 = n + 5;\n"
+                "    let v6 = n + 6; let v7 = n + 7; let v8 = n + 8; let v9 = n + 9; let v10 = n + 10;\n"
+                "    let v11 = n + 11; let v12 = n + 12; let v13 = n + 13; let v14 = n + 14;\n"
+                "    let s = v1 + v2 + v3 + v4 + v5 + v6 + v7 + v8 + v9 + v10 + v11 + v12 + v13 + v14;\n"
+                "    let w1 = s * 1; let w2 = s * 2; let w3 = s * 3; let w4 = s * 4; let w5 = s * 5;\n"
+                "    let w6 = s * 6; let w7 = s * 7; let w8 = s * 8; let w9 = s * 9; let w10 = s * 10;\n"
+                "    let w11 = s * 11; let w12 = s * 12; let w13 = s * 13; let w14 = s * 14;\n"
+                "    return w1 + w2 + w3 + w4 + w5 + w6 + w7 + w8 + w9 + w10 + w11 + w12 + w13 + w14;\n"
+                "}\n";
+    Arena arena = arena_new(256 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "REGALLOC", 1, &mod, &arena), "The source code should compile without any errors");
+
+    FunctionNames clobbering = {0};
+    RegAllocation alloc = {0};
+
+    // `a` is live across the call, so only a callee saved register keeps it
+    const Function *f = &mod.functions.items[0];
+    regalloc_linear_scan(f, &clobbering, &alloc, &arena);
+    if (alloc.slot_count != 0 || alloc.saved_count != 1 || alloc.saved[0] != REG_RBX) return 1;
+    for (size_t i = 0; i < f->body.count; i++) {
+        const Statement *st = &f->body.items[i];
+        if (st->type != ST_ADD || st->binop.r.type != VT_TEMP) continue;
+        if (!is_callee_saved(alloc.regs[st->binop.l.index])) return 1;
+    }
+
+    // unless the callee doesn't follow the ABI
+    da_push(&clobbering, SV_FROM_CSTR("g"), &arena);
+    regalloc_linear_scan(f, &clobbering, &alloc, &arena);
+    if (alloc.slot_count != 1 || alloc.saved_count != 0) return 1;
+
+    // 14 values live at once don't fit into the 11 registers
+    f = &mod.functions.items[1];
+    regalloc_linear_scan(f, &clobbering, &alloc, &arena);
+    if (alloc.slot_count == 0 || alloc.saved_count != 5) return 1;
+    for (size_t t = 0; t < f->max_temps; t++) {
+        Register r = alloc.regs[t];
+        if (r == REG_RAX || r == REG_RCX || r == REG_RDX || r == REG_RSP || r == REG_RBP) return 1;
+    }
+
+    // the second batch of values spills after the first one is dead, so they share the slots
+    size_t one_batch = alloc.slot_count;
+    f = &mod.functions.items[2];
+    regalloc_linear_scan(f, &clobbering, &alloc, &arena);
+    if (alloc.slot_count == 0 || alloc.slot_count > one_batch) return 1;
+
+    arena_free(&arena);
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef TESTS_COMMON_H_
+#define TESTS_COMMON_H_
+
+#include "../src/backend/ir/cfg.h"
+#include "../src/backend/ir/opt.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/frontend/lexer.h"
+#include "../src/frontend/parser.h"
+#include "../src/target.h"
+#include "../src/util.h"
+
+// Helpers more than one test needs, `static inline` so a test that doesn't use some of them still compiles cleanly
+
+// Number of statements of `type` in `f`
+static inline size_t count(const Function *f, StatementType type) {
+    size_t n = 0;
+    for (size_t i = 0; i < f->body.count; i++) n += f->body.items[i].type == type;
+    return n;
+}
+
+// Number of statements of `type` inside some loop of `f`, whose CFG has to be built
+static inline size_t count_in_loops(Function *f, StatementType type, Arena *arena) {
+    cfg_compute_dominators(f, arena);
+    size_t n = 0;
+    BlockIds loop = {0};
+    for (BlockId b = 0; b < f->cfg.blocks.count; b++) {
+        cfg_natural_loop(f, b, &loop, arena);
+        for (size_t i = 0; i < loop.count; i++) {
+            const BasicBlock *block = &f->cfg.blocks.items[loop.items[i]];
+            for (uint32_t j = block->begin; j < block->end; j++) n += f->body.items[j].type == type;
+        }
+    }
+    return n;
+}
+
+// Everything `boa -O<level>` does, up to the code generator
+static inline bool compile_module(char *src, const char *name, size_t level, Module *mod, Arena *arena) {
+    SourceFileView file = {.src = SV_FROM_CSTR(src), .name = name};
+    Lexer l = {.begin_of_src = src, .file = file, .arena = arena};
+    Tokens ts = {0};
+    if (!lexer_run(&l, &ts)) return false;
+    Parser p = {.arena = arena, .origin = file, .tokens = {.items = ts.items, .count = ts.count}};
+    AstRoot root = {0};
+    if (!parser_parse(&p, &root)) return false;
+    return generate_module(&root, mod, arena) && optimize_module(mod, level, UNROLL_FACTOR_DEFAULT, arena);
+}
+
+/*
+ * Compiles `src` at `level` into build/tests/<name>_O<level> with the linux_nasm target and runs it
+ * Uses an arena of its own, as big as the one of main.c
+ * Return: the exit code of the program, -1 if it didn't compile or didn't exit normally
+ */
+static inline int compile_and_run(char *src, const char *name, size_t level) {
+    Arena arena = arena_new(1024 * 1024);
+    Module mod = {0};
+    Target *target = NULL;
+    ASSERT(find_target(&target, "linux_nasm"), "The linux_nasm target always exists");
+    char path[256];
+    snprintf(path, sizeof(path), "build/tests/%s_O%zu", name, level);
+    TargetOptions opts = {.opt_level = level};
+    bool built = compile_module(src, name, level, &mod, &arena) && target->generate(path, &mod, &opts, &arena) &&
+                 target->assemble(path, &arena) && target->link(path, &arena);
+    target->cleanup(path, &arena);
+    int exit_code = built ? run_program(path, 0, NULL) : -1;
+    remove(path);
+    arena_free(&arena);
+    return exit_code;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#include "../src/backend/ir/cfg.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/util.h"
+#include "common.h"
+
+static bool edges(const BlockIds *ids, size_t count, BlockId a, BlockId b) {
+    if (ids->count != count) return false;
+    if (count > 0 && ids->items[0] != a) return false;
+    if (count > 1 && ids->items[1] != b) return false;
+    return true;
+}
+
+int main() {
+    char *src = "def main() {\n"
+                "    let x = 3;\n"
+                "    while x {\n"
+                "        x = x - 1;\n"
+                "    }\n"
+                "    if x {\n"
+                "        return 1;\n"
+                "    }\n"
+                "    return 0;\n"
+                "    x = 2;\n"
+                "}\n";
+    Arena arena = arena_new(64 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "CFG", 0, &mod, &arena), "The source code should compile without any errors");
+
+    Function *f = &mod.functions.items[0];
+    cfg_build(f, &arena);
+    const Cfg *cfg = &f->cfg;
+
+    // entry with the loop guard | loop body with the test at the bottom | if | then | after the if | dead code after
+    // the return
+    if (cfg->blocks.count != 6) return 1;
+    const BasicBlock *b = cfg->blocks.items;
+    if (!edges(&b[0].succs, 2, 1, 2)) return 1;
+    if (!edges(&b[1].preds, 2, 0, 1) || !edges(&b[1].succs, 2, 2, 1)) return 1;
+    if (!edges(&b[2].preds, 2, 0, 1) || !edges(&b[2].succs, 2, 3, 4)) return 1;
+    if (!edges(&b[3].succs, 0, 0, 0) || !edges(&b[4].succs, 0, 0, 0)) return 1;
+    if (!edges(&b[5].preds, 0, 0, 0)) return 1;
+
+    if (cfg->label_blocks.count != 3) return 1;
+    if (cfg->label_blocks.items[0] != 1 || cfg->label_blocks.items[1] != 2 || cfg->label_blocks.items[2] != 4) return 1;
+
+    // fall through successors come right after their predecessor, the dead block isn't numbered
+    if (cfg->rpo.count != 5) return 1;
+    for (BlockId i = 0; i < 5; i++) {
+        if (cfg->rpo.items[i] != i || b[i].rpo_index != i) return 1;
+    }
+    if (b[5].rpo_index != BLOCK_UNREACHABLE) return 1;
+
+    // passes rebuild once per loop they touch, which mustn't cost the arena anything after the first time
+    cfg_compute_dominators(f, &arena);
+    size_t used = arena.used;
+    for (size_t i = 0; i < 64; i++) {
+        cfg_build(f, &arena);
+        cfg_compute_dominators(f, &arena);
+    }
+    if (arena.used != used) return 1;
+    if (cfg->blocks.count != 6 || cfg->rpo.count != 5 || !edges(&cfg->blocks.items[2].preds, 2, 0, 1)) return 1;
+    if (cfg->blocks.items[1].idom != 0 || cfg->blocks.items[4].idom != 2) return 1;
+
+    arena_free(&arena);
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include "../src/backend/ir/ssa.h"
+#include "../src/util.h"
+#include "common.h"
+
+int main() {
+    char *src = "def main() {\n    f(1, g(2), \"s\");\n    return 1 + 2;\n}\n";
+    Arena arena = arena_new(64 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "COMPACT", 0, &mod, &arena), "The source code should compile without any errors");
+
+    const Function *f = &mod.functions.items[0];
+    // $0 <- call g(2); call f(1, $0, ^0); $1 <- 1 + 2; ret <- $1
+    if (f->body.count != 4) return 1;
+
+    const Statement *inner = &f->body.items[0];
+    if (inner->type != ST_CALL || inner->call.return_v.type != VT_TEMP) return 1;
+    const IrCall *g = ir_call(f, inner->call.id);
+    if (g->args_count != 1 || ir_const_value(f, ir_call_arg(f, g, 0)) != 2) return 1;
+
+    // the outer call's arguments stay contiguous even though `g` was lowered in between
+    const Statement *outer = &f->body.items[1];
+    if (outer->type != ST_CALL || outer->call.return_v.type != VT_NONE) return 1;
+    const IrCall *call = ir_call(f, outer->call.id);
+    StringView name = ir_name(f, call->name);
+    if (name.count != 1 || name.items[0] != 'f' || call->args_count != 3) return 1;
+    if (ir_const_value(f, ir_call_arg(f, call, 0)) != 1) return 1;
+    Value second = ir_call_arg(f, call, 1);
+    if (second.type != VT_TEMP || second.index != inner->call.return_v.index) return 1;
+    if (ir_call_arg(f, call, 2).type != VT_STRING) return 1;
+
+    const Statement *add = &f->body.items[2];
+    if (add->type != ST_ADD || ir_const_value(f, add->binop.r) != 2) return 1;
+    if (f->body.items[3].type != ST_RETURN) return 1;
+
+    arena_free(&arena);
+    return 0;
+}
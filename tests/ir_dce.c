@@ -0,0 +1,44 @@
+#include "../src/backend/ir/passes.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/backend/ir/ssa_form.h"
+#include "../src/util.h"
+#include "common.h"
+
+int main() {
+    char *src = "def main(n) {\n"
+                "    let unused = n * 3 + 1;\n"
+                "    let trap = n / 0;\n"
+                "    let fine = n / 2;\n"
+                "    let r = g(n);\n"
+                "    return n;\n"
+                "    while n {\n"
+                "        n = n - 1;\n"
+                "    }\n"
+                "}\n";
+    Arena arena = arena_new(256 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "DCE", 0, &mod, &arena), "The source code should compile without any errors");
+
+    Function *f = &mod.functions.items[0];
+    to_ssa(f, &arena);
+    fold_constants(f, &arena);
+    if (!eliminate_dead_code(f, &arena)) return 1;
+
+    // the dead arithmetic is gone, the division that traps and the call stay
+    if (count(f, ST_MUL) != 0 || count(f, ST_ADD) != 0) return 1;
+    if (count(f, ST_DIV) != 1 || count(f, ST_CALL) != 1) return 1;
+    for (size_t i = 0; i < f->body.count; i++) {
+        const Statement *st = &f->body.items[i];
+        if (st->type == ST_CALL && st->call.return_v.type != VT_NONE) return 1;
+        if (st->type == ST_DIV && ir_const_value(f, st->binop.r) != 0) return 1;
+    }
+    // the loop after the return was never reachable
+    if (count(f, ST_SUB) != 0 || count(f, ST_JZ) != 0) return 1;
+
+    from_ssa(f, &arena);
+    remove_unused_labels(f, &arena);
+    if (count(f, ST_LABEL) != 0) return 1;
+
+    arena_free(&arena);
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include "../src/backend/ir/passes.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/backend/ir/ssa_form.h"
+#include "../src/util.h"
+#include "common.h"
+
+static Function *lower(char *src, Module *mod, Arena *arena) {
+    ASSERT(compile_module(src, "FOLD", 0, mod, arena), "The source code should compile without any errors");
+    Function *f = &mod->functions.items[0];
+    to_ssa(f, arena);
+    return f;
+}
+
+static const Statement *find(const Function *f, StatementType type) {
+    for (size_t i = 0; i < f->body.count; i++) {
+        if (f->body.items[i].type == type) return &f->body.items[i];
+    }
+    return NULL;
+}
+
+int main() {
+    Arena arena = arena_new(256 * 1024);
+
+    // wraps around at 64 bits, and the constant flows through the variables and the loop-free phi
+    Module mod = {0};
+    Function *f = lower("def main() {\n"
+                        "    let big = 0 - 1;\n"
+                        "    let x = big + 3;\n"
+                        "    if x {\n"
+                        "        x = x * 1;\n"
+                        "    }\n"
+                        "    return x + 0;\n"
+                        "}\n",
+                        &mod, &arena);
+    if (!fold_constants(f, &arena)) return 1;
+    const Statement *ret = find(f, ST_RETURN);
+    if (ret == NULL || ret->ret.value.type != VT_CONST || ir_const_value(f, ret->ret.value) != 2) return 1;
+    if (find(f, ST_ADD) != NULL || find(f, ST_SUB) != NULL || find(f, ST_MUL) != NULL) return 1;
+
+    // dividing by a constant zero still has to trap at runtime
+    mod = (Module){0};
+    f = lower("def main() {\n    let zero = 0;\n    return 7 / zero;\n}\n", &mod, &arena);
+    fold_constants(f, &arena);
+    const Statement *div = find(f, ST_DIV);
+    if (div == NULL || div->binop.r.type != VT_CONST || ir_const_value(f, div->binop.r) != 0) return 1;
+
+    // loops keep the values that change around them
+    mod = (Module){0};
+    f = lower("def main(n) {\n    let s = 1;\n    while n {\n        s = s + 1;\n        n = n - 1;\n    }\n"
+              "    return s;\n}\n",
+              &mod, &arena);
+    fold_constants(f, &arena);
+    ret = find(f, ST_RETURN);
+    if (ret == NULL || ret->ret.value.type != VT_TEMP) return 1;
+
+    arena_free(&arena);
+    return 0;
+}
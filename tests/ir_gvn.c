@@ -0,0 +1,38 @@
+#include "../src/backend/ir/passes.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/backend/ir/ssa_form.h"
+#include "../src/util.h"
+#include "common.h"
+
+int main() {
+    char *src = "def main(a, b) {\n"
+                "    let x = a * b + b * a;\n"
+                "    if a < b {\n"
+                "        x = x + a * b + (b > a);\n"
+                "    }\n"
+                "    if x {\n"
+                "        x = x - (a - b);\n"
+                "    }\n"
+                "    return x + (a - b) + a / b + a / b;\n"
+                "}\n";
+    Arena arena = arena_new(256 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "GVN", 0, &mod, &arena), "The source code should compile without any errors");
+
+    Function *f = &mod.functions.items[0];
+    to_ssa(f, &arena);
+    if (count(f, ST_MUL) != 3 || count(f, ST_DIV) != 2 || count(f, ST_SUB) != 3) return 1;
+    if (!eliminate_common_subexpressions(f, &arena)) return 1;
+    eliminate_dead_code(f, &arena);
+
+    // `b * a` and the `a * b` in the branch reuse the first product, `b > a` is the condition of the if, and the
+    // second division reuses the first
+    // the `a - b` inside the second if doesn't dominate the one after the if, so both stay
+    if (count(f, ST_MUL) != 1 || count(f, ST_DIV) != 1 || count(f, ST_LT) != 1 || count(f, ST_GT) != 0) return 1;
+    if (count(f, ST_SUB) != 3) return 1;
+    if (eliminate_common_subexpressions(f, &arena)) return 1;
+
+    from_ssa(f, &arena);
+    arena_free(&arena);
+    return 0;
+}
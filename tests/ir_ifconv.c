@@ -0,0 +1,176 @@
+#include "../src/backend/ir/cfg.h"
+#include "../src/backend/ir/passes.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/backend/ir/ssa_form.h"
+#include "../src/util.h"
+#include "common.h"
+
+// The statement that writes the temp `v`
+static const Statement *def_of(Function *f, Value v) {
+    for (size_t i = 0; i < f->body.count; i++) {
+        Value *d = statement_def(&f->body.items[i]);
+        if (d != NULL && ir_values_equal(f, *d, v)) return &f->body.items[i];
+    }
+    return NULL;
+}
+
+// Statements that write each temp, more than one breaks SSA form
+static bool written_once(Function *f) {
+    for (size_t t = 0; t < f->max_temps; t++) {
+        size_t defs = 0;
+        for (size_t i = 0; i < f->body.count; i++) {
+            Value *d = statement_def(&f->body.items[i]);
+            defs += d != NULL && d->type == VT_TEMP && d->index == t;
+        }
+        if (defs > 1) return false;
+    }
+    return true;
+}
+
+// A triangle whose join doesn't come right after it, which keeps the return in between where it is
+//   L0: jz a, L3
+//   L1: t0 = a < b
+//       jz t0, L4
+//   L2: t1 = b + 1
+//       jmp L4
+//   L3: return 7
+//   L4: t2 = phi [L1: a] [L2: t1]
+//       return t2
+static void build_apart(Function *f, Arena *arena) {
+    *f = (Function){.name = SV_FROM_CSTR("apart"), .arg_count = 2, .max_temps = 3, .label_count = 5};
+    Value a = {.type = VT_ARG, .index = 0}, b = {.type = VT_ARG, .index = 1};
+    Value t0 = {.type = VT_TEMP, .index = 0}, t1 = {.type = VT_TEMP, .index = 1}, t2 = {.type = VT_TEMP, .index = 2};
+    ir_push_label(&f->body, 0, arena);
+    ir_push_jz(&f->body, a, 3, arena);
+    ir_push_label(&f->body, 1, arena);
+    ir_push_binop(&f->body, ST_LT, a, b, t0, arena);
+    ir_push_jz(&f->body, t0, 4, arena);
+    ir_push_label(&f->body, 2, arena);
+    ir_push_binop(&f->body, ST_ADD, b, ir_const(f, 1, arena), t1, arena);
+    da_push(&f->body, ((Statement){.type = ST_JMP, .jmp = 4}), arena);
+    ir_push_label(&f->body, 3, arena);
+    da_push(&f->body, ((Statement){.type = ST_RETURN, .ret = {.value = ir_const(f, 7, arena)}}), arena);
+    ir_push_label(&f->body, 4, arena);
+    Statement phi = {.type = ST_PHI, .phi = {.result = t2, .args_begin = f->phi_args.count, .args_count = 2}};
+    da_push(&f->phi_args, ((IrPhiArg){.pred = 1, .value = a}), arena);
+    da_push(&f->phi_args, ((IrPhiArg){.pred = 2, .value = t1}), arena);
+    da_push(&f->body, phi, arena);
+    da_push(&f->body, ((Statement){.type = ST_RETURN, .ret = {.value = t2}}), arena);
+    cfg_build(f, arena);
+}
+
+int main() {
+    char *src = "def clamp(x, lo, hi) {\n"
+                "    let r = x;\n"
+                "    if x < lo { r = lo; }\n"
+                "    if r > hi { r = hi; }\n"
+                "    return r;\n"
+                "}\n"
+                "def absdiff(a, b) {\n"
+                "    let d = b - a;\n"
+                "    if a > b { d = a - b; }\n"
+                "    return d;\n"
+                "}\n"
+                "def costly(a, b) {\n"
+                "    let d = a;\n"
+                "    if a > b { d = a * b * b * b; }\n"
+                "    return d;\n"
+                "}\n"
+                "def traps(a, b) {\n"
+                "    let d = 0;\n"
+                "    if b { d = a / b; }\n"
+                "    return d;\n"
+                "}\n"
+                "def calls(a) {\n"
+                "    let d = 0;\n"
+                "    if a { d = absdiff(a, 1); }\n"
+                "    return d;\n"
+                "}\n";
+    Arena arena = arena_new(256 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "IFCONV", 0, &mod, &arena), "The source code should compile without any errors");
+
+    for (size_t i = 0; i < mod.functions.count; i++) {
+        Function *f = &mod.functions.items[i];
+        to_ssa(f, &arena);
+        fold_constants(f, &arena);
+        eliminate_dead_code(f, &arena);
+    }
+
+    // both ifs become selects, straight line code without a single jump
+    Function *clamp = &mod.functions.items[0];
+    if (!convert_ifs_to_selects(clamp, &arena)) return 1;
+    if (count(clamp, ST_SELECT) != 2 || count(clamp, ST_JZ) != 0 || count(clamp, ST_PHI) != 0) return 1;
+
+    // the subtraction runs either way now, and `a > b` picks `a - b` over `b - a`
+    Function *absdiff = &mod.functions.items[1];
+    if (!convert_ifs_to_selects(absdiff, &arena)) return 1;
+    if (count(absdiff, ST_SELECT) != 1 || count(absdiff, ST_SUB) != 2 || count(absdiff, ST_JZ) != 0) return 1;
+    const Statement *select = NULL;
+    for (size_t i = 0; i < absdiff->body.count; i++) {
+        if (absdiff->body.items[i].type == ST_SELECT) select = &absdiff->body.items[i];
+    }
+    const Statement *gt = def_of(absdiff, select->select.cond);
+    const Statement *taken = def_of(absdiff, ir_select_value(absdiff, select, true));
+    const Statement *skipped = def_of(absdiff, ir_select_value(absdiff, select, false));
+    if (gt == NULL || taken == NULL || skipped == NULL || gt->type != ST_GT) return 1;
+    if (taken->type != ST_SUB || !ir_values_equal(absdiff, taken->binop.l, gt->binop.l) ||
+        !ir_values_equal(absdiff, taken->binop.r, gt->binop.r)) {
+        return 1;
+    }
+    if (skipped->type != ST_SUB || !ir_values_equal(absdiff, skipped->binop.l, gt->binop.r) ||
+        !ir_values_equal(absdiff, skipped->binop.r, gt->binop.l)) {
+        return 1;
+    }
+
+    // three multiplications cost more than the branch, the division might trap and the call has effects
+    for (size_t i = 2; i < mod.functions.count; i++) {
+        if (convert_ifs_to_selects(&mod.functions.items[i], &arena)) return 1;
+    }
+
+    // and the selects make it out of SSA form
+    for (size_t i = 0; i < 2; i++) {
+        Function *f = &mod.functions.items[i];
+        fold_constants(f, &arena);
+        eliminate_dead_code(f, &arena);
+        from_ssa(f, &arena);
+        remove_unused_labels(f, &arena);
+        cfg_build(f, &arena);
+        if (count(f, ST_SELECT) == 0) return 1;
+    }
+
+    // both functions take either side of their ifs on the way, which the cmovs have to get right
+    char *run = "def clamp(x, lo, hi) {\n"
+                "    let r = x;\n"
+                "    if x < lo { r = lo; }\n"
+                "    if r > hi { r = hi; }\n"
+                "    return r;\n"
+                "}\n"
+                "def absdiff(a, b) {\n"
+                "    let d = b - a;\n"
+                "    if a > b { d = a - b; }\n"
+                "    return d;\n"
+                "}\n"
+                "def main() {\n"
+                "    let s = 0;\n"
+                "    let i = 0;\n"
+                "    while i < 20 {\n"
+                "        s = s + clamp(i, 5, 12) * 3 + absdiff(i, 9);\n"
+                "        i = i + 1;\n"
+                "    }\n"
+                "    return s - s / 256 * 256;\n"
+                "}\n";
+    for (size_t level = 0; level <= OPT_LEVEL_MAX; level++) {
+        if (compile_and_run(run, "ifconv", level) != 119) return 1;
+    }
+
+    // the head jumps over the return to the join, which loses its phi to the select
+    Function apart;
+    build_apart(&apart, &arena);
+    if (!convert_ifs_to_selects(&apart, &arena)) return 1;
+    if (count(&apart, ST_SELECT) != 1 || count(&apart, ST_PHI) != 0 || !written_once(&apart)) return 1;
+    if (count(&apart, ST_JMP) != 1 || count(&apart, ST_RETURN) != 2) return 1;
+
+    arena_free(&arena);
+    return 0;
+}
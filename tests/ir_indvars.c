@@ -0,0 +1,77 @@
+#include "../src/backend/ir/cfg.h"
+#include "../src/backend/ir/passes.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/backend/ir/ssa_form.h"
+#include "../src/util.h"
+#include "common.h"
+
+int main() {
+    char *src = "def main(n, k) {\n"
+                "    let s = 0;\n"
+                "    let j = 1000;\n"
+                "    while j {\n"
+                "        s = s + j * 3;\n"
+                "        j = j - 1;\n"
+                "    }\n"
+                "    let i = 0;\n"
+                "    while i < n {\n"
+                "        s = s + (k + i * 8);\n"
+                "        i = i + 1;\n"
+                "    }\n"
+                "    return s;\n"
+                "}\n";
+    Arena arena = arena_new(256 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "INDVARS", 0, &mod, &arena), "The source code should compile without any errors");
+
+    Function *f = &mod.functions.items[0];
+    to_ssa(f, &arena);
+    fold_constants(f, &arena);
+    eliminate_dead_code(f, &arena);
+    if (count_in_loops(f, ST_MUL, &arena) != 2 || count_in_loops(f, ST_PHI, &arena) != 4) return 1;
+    if (!reduce_induction_variables(f, &arena)) return 1;
+    fold_constants(f, &arena);
+    eliminate_dead_code(f, &arena);
+
+    // no multiplications left, `j` only counted down to the exit test so the test reads `j * 3` instead and `j`
+    // is gone, `i` still decides when its loop ends and the running `k + i * 8` gets a phi of its own
+    if (count_in_loops(f, ST_MUL, &arena) != 0) return 1;
+    if (count_in_loops(f, ST_PHI, &arena) != 5) return 1;
+    if (reduce_induction_variables(f, &arena)) return 1;
+
+    // and the result still makes it out of SSA form
+    from_ssa(f, &arena);
+    remove_unused_labels(f, &arena);
+    cfg_build(f, &arena);
+
+    // the rewritten loops still add up the same, whether the arguments are known or not
+    char *run = "def sum(n, k) {\n"
+                "    let s = 0;\n"
+                "    let j = 10;\n"
+                "    while j {\n"
+                "        s = s + j * 3;\n"
+                "        j = j - 1;\n"
+                "    }\n"
+                "    let i = 0;\n"
+                "    while i < n {\n"
+                "        s = s + (k + i * 8);\n"
+                "        i = i + 1;\n"
+                "    }\n"
+                "    return s;\n"
+                "}\n"
+                "def main() {\n"
+                "    let r = 0;\n"
+                "    let n = 0;\n"
+                "    while n < 8 {\n"
+                "        r = r + sum(n, n + 1);\n"
+                "        n = n + 1;\n"
+                "    }\n"
+                "    return r - r / 256 * 256;\n"
+                "}\n";
+    for (size_t level = 0; level <= OPT_LEVEL_MAX; level++) {
+        if (compile_and_run(run, "indvars", level) != 144) return 1;
+    }
+
+    arena_free(&arena);
+    return 0;
+}
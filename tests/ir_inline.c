@@ -0,0 +1,67 @@
+#include "../src/backend/ir/passes.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/util.h"
+#include "common.h"
+
+static size_t calls_to(const Function *f, const char *name) {
+    size_t n = 0;
+    for (size_t i = 0; i < f->body.count; i++) {
+        const Statement *st = &f->body.items[i];
+        if (st->type != ST_CALL) continue;
+        StringView callee = ir_name(f, ir_call(f, st->call.id)->name);
+        n += callee.count == strlen(name) && strncmp(callee.items, name, callee.count) == 0;
+    }
+    return n;
+}
+
+int main() {
+    char *src = "def add1(x) {\n"
+                "    x = x + 1;\n"
+                "    return x;\n"
+                "}\n"
+                "def raw() {\n"
+                "    __asm__(mov rax, 1);\n"
+                "    return;\n"
+                "}\n"
+                "def down(n) {\n"
+                "    while n {\n"
+                "        n = down(n - 1);\n"
+                "    }\n"
+                "    return n;\n"
+                "}\n"
+                "def main(n) {\n"
+                "    let a = add1(n);\n"
+                "    let b = add1(a);\n"
+                "    raw();\n"
+                "    return down(b);\n"
+                "}\n";
+    Arena arena = arena_new(256 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "INLINE", 0, &mod, &arena), "The source code should compile without any errors");
+
+    const Function *down = &mod.functions.items[2];
+    const Function *f = &mod.functions.items[3];
+    size_t temps = f->max_temps;
+    if (!inline_calls(&mod, &arena)) return 1;
+
+    // both calls of add1 are gone, the asm function is still called, and down got inlined once but still
+    // calls itself
+    if (calls_to(f, "add1") != 0 || calls_to(f, "raw") != 1) return 1;
+    if (calls_to(f, "down") != 1 || calls_to(down, "down") != 1) return 1;
+    if (f->max_temps <= temps) return 1;
+    // every jump lands on a label of the new body
+    for (size_t i = 0; i < f->body.count; i++) {
+        const Statement *st = &f->body.items[i];
+        IrLabel to = st->type == ST_JMP ? st->jmp : st->type == ST_JZ ? st->jz.to : UINT32_MAX;
+        if (to == UINT32_MAX) continue;
+        if (to >= f->label_count) return 1;
+        bool found = false;
+        for (size_t j = 0; j < f->body.count; j++) {
+            found |= f->body.items[j].type == ST_LABEL && f->body.items[j].label == to;
+        }
+        if (!found) return 1;
+    }
+
+    arena_free(&arena);
+    return 0;
+}
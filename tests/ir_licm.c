@@ -0,0 +1,38 @@
+#include "../src/backend/ir/cfg.h"
+#include "../src/backend/ir/passes.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/backend/ir/ssa_form.h"
+#include "../src/util.h"
+#include "common.h"
+
+int main() {
+    char *src = "def main(n, k) {\n"
+                "    let acc = 0;\n"
+                "    while acc < n - 1 {\n"
+                "        acc = acc + k * k;\n"
+                "        acc = acc + n / k;\n"
+                "    }\n"
+                "    return acc;\n"
+                "}\n";
+    Arena arena = arena_new(256 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "LICM", 0, &mod, &arena), "The source code should compile without any errors");
+
+    Function *f = &mod.functions.items[0];
+    to_ssa(f, &arena);
+    if (count_in_loops(f, ST_MUL, &arena) != 1 || count_in_loops(f, ST_SUB, &arena) != 1) return 1;
+    if (!hoist_loop_invariants(f, &arena)) return 1;
+
+    // `n - 1` and `k * k` run once in the preheader, the division by `k` might trap so it stays in the loop
+    if (count_in_loops(f, ST_MUL, &arena) != 0 || count_in_loops(f, ST_SUB, &arena) != 0) return 1;
+    if (count_in_loops(f, ST_DIV, &arena) != 1) return 1;
+    if (hoist_loop_invariants(f, &arena)) return 1;
+
+    // and the result still makes it out of SSA form
+    from_ssa(f, &arena);
+    remove_unused_labels(f, &arena);
+    cfg_build(f, &arena);
+
+    arena_free(&arena);
+    return 0;
+}
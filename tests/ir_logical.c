@@ -0,0 +1,52 @@
+#include "../src/backend/ir/ssa.h"
+#include "../src/util.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Long enough to overflow the native stack if the lowering recursed per operator
+#define DEPTH 100000
+
+int main() {
+    Arena arena = arena_new(256 * 1024 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module("def main(a, b) {\n"
+                          "    if a < b && (b == 3 || !a) {\n"
+                          "        return 1;\n"
+                          "    }\n"
+                          "    return a || b;\n"
+                          "}\n",
+                          "LOGICAL", 0, &mod, &arena),
+           "The source code should compile without any errors");
+
+    // the condition is only jumps, `b == 3` is turned around into a jump past `!a` and nothing is materialized
+    const Function *f = &mod.functions.items[0];
+    StatementType expected[] = {ST_LT, ST_JZ, ST_NE, ST_JZ, ST_EQ, ST_JZ, ST_LABEL, ST_RETURN};
+    size_t n = sizeof(expected) / sizeof(*expected);
+    if (f->body.count < n) return 1;
+    for (size_t i = 0; i < n; i++) {
+        if (f->body.items[i].type != expected[i]) return 1;
+    }
+    if (f->body.items[3].jz.to != f->body.items[6].label) return 1;
+    if (f->body.items[1].jz.to != f->body.items[5].jz.to) return 1;
+
+    // as a value `||` assigns 1 and skips `b` if `a` isn't 0
+    size_t assigns = 0;
+    for (size_t i = n; i < f->body.count; i++) assigns += f->body.items[i].type == ST_ASSIGN;
+    if (assigns != 2) return 1;
+
+    // a && a && ... && a
+    char *chain = malloc(5 * DEPTH + 64);
+    size_t len = sprintf(chain, "def main(a) {\n    if a");
+    for (size_t i = 0; i < DEPTH; i++) len += sprintf(chain + len, " && a");
+    sprintf(chain + len, " {\n        return 1;\n    }\n    return 0;\n}\n");
+    mod = (Module){0};
+    ASSERT(compile_module(chain, "LOGICAL", 0, &mod, &arena), "Long chains of logical operators should lower");
+    f = &mod.functions.items[0];
+    if (count(f, ST_JZ) != DEPTH + 1) return 1;
+
+    free(chain);
+    arena_free(&arena);
+    return 0;
+}
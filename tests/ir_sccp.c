@@ -0,0 +1,48 @@
+#include "../src/backend/ir/passes.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/backend/ir/ssa_form.h"
+#include "../src/util.h"
+#include "common.h"
+
+int main() {
+    char *src = "def main(x) {\n"
+                "    let debug = 0;\n"
+                "    let y = 5;\n"
+                "    if debug {\n"
+                "        y = x * 1000;\n"
+                "    }\n"
+                "    while y != 5 {\n"
+                "        y = y - 1;\n"
+                "    }\n"
+                "    if y < x {\n"
+                "        return x / 0;\n"
+                "    }\n"
+                "    return y;\n"
+                "}\n";
+    Arena arena = arena_new(256 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "SCCP", 0, &mod, &arena), "The source code should compile without any errors");
+
+    Function *f = &mod.functions.items[0];
+    to_ssa(f, &arena);
+    fold_constants(f, &arena);
+    // plain folding can't see that the multiplication never reaches the phi of `y`, the loop tests on the way in
+    // and at the bottom
+    if (count(f, ST_JZ) != 4) return 1;
+    if (!propagate_conditional_constants(f, &arena)) return 1;
+    eliminate_dead_code(f, &arena);
+
+    // `y` is 5 on every path that runs, so the first if and the loop are gone, the last if depends on `x`
+    if (count(f, ST_JZ) != 1 || count(f, ST_MUL) != 0 || count(f, ST_SUB) != 0) return 1;
+    // the division by zero is still there, it only traps if it runs
+    if (count(f, ST_DIV) != 1) return 1;
+    for (size_t i = 0; i < f->body.count; i++) {
+        const Statement *st = &f->body.items[i];
+        if (st->type == ST_RETURN && st->ret.value.type == VT_CONST && ir_const_value(f, st->ret.value) == 5) {
+            from_ssa(f, &arena);
+            arena_free(&arena);
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,82 @@
+#include "../src/backend/ir/cfg.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/backend/ir/ssa_form.h"
+#include "../src/util.h"
+#include "common.h"
+
+int main() {
+    char *src = "def main(n) {\n"
+                "    let a = 0;\n"
+                "    let b = 1;\n"
+                "    while n {\n"
+                "        let t = a + b;\n"
+                "        a = b;\n"
+                "        b = t;\n"
+                "        n = n - 1;\n"
+                "    }\n"
+                "    return a;\n"
+                "}\n";
+    Arena arena = arena_new(256 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "SSA", 0, &mod, &arena), "The source code should compile without any errors");
+
+    Function *f = &mod.functions.items[0];
+    to_ssa(f, &arena);
+
+    // every temp is written once, and the argument is only read by the copy at the entry
+    size_t arg_reads = 0;
+    bool *written = calloc(f->max_temps, sizeof(bool));
+    ValueRefs uses = {0};
+    for (size_t i = 0; i < f->body.count; i++) {
+        Statement *st = &f->body.items[i];
+        Value *def = statement_def(st);
+        if (def != NULL) {
+            if (written[def->index]) return 1;
+            written[def->index] = true;
+        }
+        statement_uses(f, st, &uses, &arena);
+        for (size_t j = 0; j < uses.count; j++) arg_reads += uses.items[j]->type == VT_ARG;
+    }
+    if (arg_reads != 1) return 1;
+
+    // the rotated loop is entered at the top of its body, which merges n, a and b (t is written and read in the body
+    // only), and the exit merges them once more from the guard and the bottom test
+    const Cfg *cfg = &f->cfg;
+    BlockId header = cfg->blocks.items[0].succs.items[0];
+    const BasicBlock *h = &cfg->blocks.items[header];
+    if (h->preds.count != 2) return 1;
+    for (size_t i = h->begin + 1; i < h->begin + 4; i++) {
+        if (f->body.items[i].type != ST_PHI || f->body.items[i].phi.args_count != 2) return 1;
+    }
+    if (f->body.items[h->begin + 4].type == ST_PHI || count(f, ST_PHI) != 6) return 1;
+
+    // the entry dominates the loop and the exit, but the loop doesn't dominate the exit
+    BlockId exit_block = h->succs.items[0];
+    if (h->idom != 0 || cfg->blocks.items[exit_block].idom != 0) return 1;
+    if (!cfg_dominates(cfg, 0, exit_block) || cfg_dominates(cfg, header, exit_block)) return 1;
+
+    from_ssa(f, &arena);
+    for (size_t i = 0; i < f->body.count; i++) {
+        if (f->body.items[i].type == ST_PHI) return 1;
+    }
+
+    // the copies of the back edge run in front of the bottom test, which stays right before its jump
+    size_t back_jumps = 0;
+    for (size_t i = 0; i < f->body.count; i++) {
+        const Statement *st = &f->body.items[i];
+        if (st->type != ST_LABEL) continue;
+        for (size_t j = i + 1; j < f->body.count; j++) {
+            const Statement *jz = &f->body.items[j];
+            if (jz->type != ST_JZ || jz->jz.to != st->label) continue;
+            const Statement *test = &f->body.items[j - 1];
+            if (test->type != ST_EQ || test->binop.result.index != jz->jz.cond.index) return 1;
+            if (f->body.items[j - 2].type != ST_ASSIGN) return 1;
+            back_jumps++;
+        }
+    }
+    if (back_jumps != 1) return 1;
+
+    free(written);
+    arena_free(&arena);
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include "../src/backend/ir/cfg.h"
+#include "../src/backend/ir/passes.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/util.h"
+#include "common.h"
+
+static size_t tail_calls(const Function *f) {
+    size_t n = 0;
+    for (size_t i = 0; i < f->body.count; i++) n += statement_is_tail_call(f, i);
+    return n;
+}
+
+int main() {
+    char *src = "def gcd(a, b) {\n"
+                "    if b == 0 {\n"
+                "        return a;\n"
+                "    }\n"
+                "    return gcd(b, a - a / b * b);\n"
+                "}\n"
+                "def fact(n) {\n"
+                "    if n == 0 {\n"
+                "        return 1;\n"
+                "    }\n"
+                "    return n * fact(n - 1);\n"
+                "}\n"
+                "def main() {\n"
+                "    return gcd(48, fact(4));\n"
+                "}\n";
+    Arena arena = arena_new(256 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "TAIL", 0, &mod, &arena), "The source code should compile without any errors");
+
+    Function *gcd = &mod.functions.items[0];
+    Function *fact = &mod.functions.items[1];
+    Function *f = &mod.functions.items[2];
+    if (tail_calls(gcd) != 1 || tail_calls(fact) != 0 || tail_calls(f) != 1) return 1;
+
+    // gcd loops instead of calling itself, and writes both arguments before jumping back
+    if (!eliminate_tail_recursion(gcd, &arena)) return 1;
+    if (count(gcd, ST_CALL) != 0 || count(gcd, ST_JMP) != 1) return 1;
+    size_t arg_writes = 0;
+    for (size_t i = 0; i < gcd->body.count; i++) {
+        const Statement *st = &gcd->body.items[i];
+        arg_writes += st->type == ST_ASSIGN && st->assign.place.type == VT_ARG;
+    }
+    if (arg_writes != 2) return 1;
+    if (gcd->body.items[0].type != ST_LABEL || gcd->body.items[0].label != gcd->label_count - 1) return 1;
+
+    // the multiplication still needs the result of the call, and main's call isn't to itself
+    if (eliminate_tail_recursion(fact, &arena) || eliminate_tail_recursion(f, &arena)) return 1;
+
+    arena_free(&arena);
+    return 0;
+}
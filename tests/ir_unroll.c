@@ -0,0 +1,78 @@
+#include "../src/backend/ir/cfg.h"
+#include "../src/backend/ir/passes.h"
+#include "../src/backend/ir/ssa.h"
+#include "../src/backend/ir/ssa_form.h"
+#include "../src/util.h"
+#include "common.h"
+
+int main() {
+    char *src = "def fixed() {\n"
+                "    let s = 0;\n"
+                "    let i = 0;\n"
+                "    while i < 5 {\n"
+                "        s = s + i;\n"
+                "        i = i + 1;\n"
+                "    }\n"
+                "    return s;\n"
+                "}\n"
+                "def scan(n) {\n"
+                "    let s = 0;\n"
+                "    let i = 0;\n"
+                "    while i < n {\n"
+                "        s = s + i;\n"
+                "        i = i + 2;\n"
+                "    }\n"
+                "    return s;\n"
+                "}\n"
+                "def stride(n, k) {\n"
+                "    let i = 0;\n"
+                "    while i < n {\n"
+                "        i = i + k;\n"
+                "    }\n"
+                "    return i;\n"
+                "}\n";
+    Arena arena = arena_new(256 * 1024);
+    Module mod = {0};
+    ASSERT(compile_module(src, "UNROLL", 0, &mod, &arena), "The source code should compile without any errors");
+
+    Function *fixed = &mod.functions.items[0];
+    Function *scan = &mod.functions.items[1];
+    Function *stride = &mod.functions.items[2];
+
+    // a factor of 1 turns the pass off
+    if (unroll_loops(fixed, 1, &arena)) return 1;
+
+    // five trips are five copies of the body and no jump back
+    size_t adds = count(fixed, ST_ADD);
+    if (!unroll_loops(fixed, 4, &arena)) return 1;
+    if (count(fixed, ST_ADD) != adds * 5 || count(fixed, ST_JZ) != 1) return 1;
+
+    // four copies in the unrolled loop, one in the loop that runs the rest
+    adds = count(scan, ST_ADD);
+    size_t jumps = count(scan, ST_JZ);
+    if (!unroll_loops(scan, 4, &arena)) return 1;
+    if (count(scan, ST_ADD) != adds * 5 || count(scan, ST_JZ) != jumps + 4) return 1;
+
+    // the step isn't a constant
+    if (unroll_loops(stride, 4, &arena)) return 1;
+
+    // and the copies still make it through SSA form, every temp written once
+    for (size_t i = 0; i < 2; i++) {
+        Function *f = &mod.functions.items[i];
+        to_ssa(f, &arena);
+        bool *written = arena_alloc(&arena, f->max_temps + 1);
+        memset(written, 0, f->max_temps);
+        for (size_t j = 0; j < f->body.count; j++) {
+            Value *d = statement_def(&f->body.items[j]);
+            if (d == NULL || d->type != VT_TEMP) continue;
+            if (written[d->index]) return 1;
+            written[d->index] = true;
+        }
+        from_ssa(f, &arena);
+        remove_unused_labels(f, &arena);
+        cfg_build(f, &arena);
+    }
+
+    arena_free(&arena);
+    return 0;
+}
@@ -3,7 +3,7 @@
 #include <string.h>
 
 int main() {
-    char *src = "+ -/*";
+    char *src = "+ -/*&& ||!!=";
     Arena arena = arena_new(1024);
     Lexer l = {.begin_of_src = src, .file = {.name = "CONST", .src = SV_FROM_CSTR(src)}, .arena = &arena};
     Tokens out = {0};
@@ -15,9 +15,13 @@ int main() {
         (Token){.type = TT_OPERATOR, .begin = src + 2, .len = 1, .operator = OT_MINUS},
         (Token){.type = TT_OPERATOR, .begin = src + 3, .len = 1, .operator = OT_DIV},
         (Token){.type = TT_OPERATOR, .begin = src + 4, .len = 1, .operator = OT_MULT},
+        (Token){.type = TT_OPERATOR, .begin = src + 5, .len = 2, .operator = OT_AND},
+        (Token){.type = TT_OPERATOR, .begin = src + 8, .len = 2, .operator = OT_OR},
+        (Token){.type = TT_OPERATOR, .begin = src + 10, .len = 1, .operator = OT_NOT},
+        (Token){.type = TT_OPERATOR, .begin = src + 11, .len = 2, .operator = OT_NE},
     };
 
-    if (out.count < 4) return 1;
+    if (out.count != 8) return 1;
 
     for (size_t i = 0; i < out.count; i++) {
         if (memcmp(&expected[i], &out.items[i], sizeof(Token)) != 0) return 1;
@@ -4,12 +4,14 @@
 
 int main() {
     char *src = "1 + 1 * 3";
-    Arena arena = arena_new(1024);
+    Arena arena = arena_new(16 * 1024);
     Lexer l = {.begin_of_src = src, .file = {.name = "CONST", .src = SV_FROM_CSTR(src)}, .arena = &arena};
     Tokens ts = {0};
     ASSERT(lexer_run(&l, &ts), "The source code should be lexible without any errors");
 
+    Ast ast = {0};
     Parser p = {
+        .ast = &ast,
         .arena = &arena,
         .last_token = {0},
         .tokens = {.items = ts.items, .count = ts.count},
@@ -19,17 +21,23 @@ int main() {
                 .name = "CONST",
             },
     };
-    AstExpression expr = {0};
-    ASSERT(parser_parse_expr(&p, &expr), "The source code should be parsible without any errors");
+    AstExprId id = 0;
+    ASSERT(parser_parse_expr(&p, &id), "The source code should be parsible without any errors");
+    const AstExpression *expr = ast_expr(&ast, id);
 
-    if (expr.begin != src) return 1;
-    if (expr.len != 9) return 1;
-    if (expr.type != AET_BINARY) return 1;
-    if (expr.bin.op != OT_PLUS) return 1;
+    if (expr->begin != 0) return 1;
+    if (expr->len != 9) return 1;
+    if (expr->type != AET_BINARY) return 1;
+    if (expr->bin.op != OT_PLUS) return 1;
 
-    if (expr.bin.r->bin.op != OT_MULT) return 1;
-    if (expr.bin.r->bin.l->number != 1) return 1;
-    if (expr.bin.r->bin.r->number != 3) return 1;
+    const AstExpression *r = ast_expr(&ast, expr->bin.r);
+    if (r->bin.op != OT_MULT) return 1;
+    if (ast_number(&ast, ast_expr(&ast, r->bin.l)->number) != 1) return 1;
+    if (ast_number(&ast, ast_expr(&ast, r->bin.r)->number) != 3) return 1;
+
+    // every node sits in the pool exactly once, with its children before it
+    if (ast.exprs.count != 5) return 1;
+    if (id != 4) return 1;
 
 
     return 0;
@@ -0,0 +1,91 @@
+#include "../src/frontend/lexer.h"
+#include "../src/frontend/parser.h"
+#include "../src/util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static bool parse(char *src, Ast *ast, AstExprId *id, Arena *arena) {
+    Lexer l = {.begin_of_src = src, .file = {.name = "CONST", .src = SV_FROM_CSTR(src)}, .arena = arena};
+    Tokens ts = {0};
+    if (!lexer_run(&l, &ts)) return false;
+
+    Parser p = {
+        .ast = ast,
+        .arena = arena,
+        .tokens = {.items = ts.items, .count = ts.count},
+        .origin = {.src = SV_FROM_CSTR(src), .name = "CONST"},
+    };
+    return parser_parse_expr(&p, id);
+}
+
+// Deep enough to overflow the native stack if the parser recursed per nesting level
+#define DEPTH 200000
+
+int main() {
+    Arena arena = arena_new(256 * 1024 * 1024);
+
+    // ((1 + (2 * 3)) < (-4)) == ((5 - 6) - 7)
+    Ast ast = {0};
+    AstExprId id = 0;
+    ASSERT(parse("1 + 2 * 3 < -4 == (5 - 6) - 7", &ast, &id, &arena), "Should be parsible");
+    const AstExpression *eq = ast_expr(&ast, id);
+    if (eq->type != AET_BINARY || eq->bin.op != OT_EQ) return 1;
+    if (eq->begin != 0 || eq->len != 29) return 1;
+
+    const AstExpression *lt = ast_expr(&ast, eq->bin.l);
+    if (lt->type != AET_BINARY || lt->bin.op != OT_LT) return 1;
+    const AstExpression *plus = ast_expr(&ast, lt->bin.l);
+    if (plus->bin.op != OT_PLUS || ast_expr(&ast, plus->bin.r)->bin.op != OT_MULT) return 1;
+    const AstExpression *neg = ast_expr(&ast, lt->bin.r);
+    if (neg->type != AET_UNARY || neg->unary.op != OT_MINUS) return 1;
+    if (ast_number(&ast, ast_expr(&ast, neg->unary.operand)->number) != 4) return 1;
+
+    // subtraction is left associative, the parenthesized group stays on the left
+    const AstExpression *outer = ast_expr(&ast, eq->bin.r);
+    if (outer->bin.op != OT_MINUS) return 1;
+    if (ast_number(&ast, ast_expr(&ast, outer->bin.r)->number) != 7) return 1;
+    const AstExpression *group = ast_expr(&ast, outer->bin.l);
+    if (group->bin.op != OT_MINUS || ast_number(&ast, ast_expr(&ast, group->bin.l)->number) != 5) return 1;
+
+    // (!1) || ((2 && (3 < 4)) && 5), `!` binds like unary minus
+    ast = (Ast){0};
+    ASSERT(parse("!1 || 2 && 3 < 4 && 5", &ast, &id, &arena), "Should be parsible");
+    const AstExpression *or = ast_expr(&ast, id);
+    if (or->type != AET_BINARY || or->bin.op != OT_OR) return 1;
+    const AstExpression *not = ast_expr(&ast, or->bin.l);
+    if (not->type != AET_UNARY || not->unary.op != OT_NOT) return 1;
+    const AstExpression *and = ast_expr(&ast, or->bin.r);
+    if (and->bin.op != OT_AND || ast_number(&ast, ast_expr(&ast, and->bin.r)->number) != 5) return 1;
+    const AstExpression *inner = ast_expr(&ast, and->bin.l);
+    if (inner->bin.op != OT_AND || ast_expr(&ast, inner->bin.r)->bin.op != OT_LT) return 1;
+
+    // DEPTH nested parentheses around a single number
+    char *nested = malloc(2 * DEPTH + 2);
+    memset(nested, '(', DEPTH);
+    nested[DEPTH] = '1';
+    memset(nested + DEPTH + 1, ')', DEPTH);
+    nested[2 * DEPTH + 1] = '\0';
+    ast = (Ast){0};
+    ASSERT(parse(nested, &ast, &id, &arena), "Deeply nested parentheses should be parsible");
+    if (ast.exprs.count != 1 || ast_expr(&ast, id)->type != AET_PRIMARY) return 1;
+
+    // a left leaning chain 1 - 1 - ... - 1
+    char *chain = malloc(4 * DEPTH + 2);
+    size_t len = 0;
+    chain[len++] = '1';
+    for (size_t i = 0; i < DEPTH; i++) len += sprintf(chain + len, "-1");
+    ast = (Ast){0};
+    ASSERT(parse(chain, &ast, &id, &arena), "Long operator chains should be parsible");
+    if (ast.exprs.count != 2 * DEPTH + 1) return 1;
+    if (ast_expr(&ast, ast_expr(&ast, id)->bin.l)->type != AET_BINARY) return 1;
+
+    // unbalanced parentheses are an error, not a crash
+    ast = (Ast){0};
+    if (parse("(1 + 2", &ast, &id, &arena)) return 1;
+
+    free(nested);
+    free(chain);
+    arena_free(&arena);
+    return 0;
+}
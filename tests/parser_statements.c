@@ -4,12 +4,14 @@
 
 int main() {
     char *src = "return; return 123; let number = 123;";
-    Arena arena = arena_new(1024);
+    Arena arena = arena_new(16 * 1024);
     Lexer l = {.begin_of_src = src, .file = {.name = "CONST", .src = SV_FROM_CSTR(src)}, .arena = &arena};
     Tokens ts = {0};
     ASSERT(lexer_run(&l, &ts), "The source code should be lexible without any errors");
 
+    Ast ast = {0};
     Parser p = {
+        .ast = &ast,
         .arena = &arena,
         .last_token = {0},
         .tokens = {.items = ts.items, .count = ts.count},
@@ -20,33 +22,36 @@ int main() {
             },
     };
     {
-        AstStatement return_no_value = {0};
-        ASSERT(parser_parse_statement(&p, &return_no_value), "The source code should be parsible without any errors");
+        AstStmtId id = 0;
+        ASSERT(parser_parse_statement(&p, &id), "The source code should be parsible without any errors");
+        AstStatement return_no_value = *ast_stmt(&ast, id);
 
-        if (return_no_value.begin != src) return 1;
+        if (return_no_value.begin != 0) return 1;
         if (return_no_value.len != 7) return 1;
         if (return_no_value.type != AST_RETURN) return 1;
         if (return_no_value.ret.has_expr) return 1;
     }
 
     {
-        AstStatement return_value = {0};
-        ASSERT(parser_parse_statement(&p, &return_value), "The source code should be parsible without any errors");
+        AstStmtId id = 0;
+        ASSERT(parser_parse_statement(&p, &id), "The source code should be parsible without any errors");
+        AstStatement return_value = *ast_stmt(&ast, id);
 
-        if (return_value.begin != src + 8) return 1;
+        if (return_value.begin != 8) return 1;
         if (return_value.len != 11) return 1;
         if (return_value.type != AST_RETURN) return 1;
         if (!return_value.ret.has_expr) return 1;
-        if (return_value.ret.return_expr.type != AET_PRIMARY) return 1;
+        if (ast_expr(&ast, return_value.ret.return_expr)->type != AET_PRIMARY) return 1;
     }
     {
-        AstStatement let_statement = {0};
-        ASSERT(parser_parse_statement(&p, &let_statement), "The source code should be parsible without any errors");
+        AstStmtId id = 0;
+        ASSERT(parser_parse_statement(&p, &id), "The source code should be parsible without any errors");
+        AstStatement let_statement = *ast_stmt(&ast, id);
 
-        if (let_statement.begin != src + 20) return 1;
+        if (let_statement.begin != 20) return 1;
         if (let_statement.len != 17) return 1;
         if (let_statement.type != AST_LET) return 1;
-        if (strncmp((char *)let_statement.let.name.items, "number", 6) != 0) return 1;
+        if (strncmp((char *)ast_name(&ast, let_statement.let.name).items, "number", 6) != 0) return 1;
     }
 
     return 0;